@@ -1,12 +1,19 @@
 #include "Bluetooth.h"
 
 #include <QDateTime>
+#include <QTimer>
 
 Bluetooth::Bluetooth(QObject *parent) : QObject(parent)
 {
+    this->triggerEngine = new TriggerEngine(this);
+
+    this->txScheduler = new TxScheduler(this);
+    connect(txScheduler, SIGNAL(transmit(QByteArray)), this, SLOT(transmit(QByteArray)));
+    connect(txScheduler, SIGNAL(writeFinished(quint64, bool)), this, SIGNAL(writeFinished(quint64, bool)));
+
+    //The debug log is only opened once there is something to write to it (see openDebugLog)
     this->logger = new Logger(this);
     logger->setLogFile(this->LogFilePath);
-    logger->startLogging();
 }
 
 Bluetooth::~Bluetooth()
@@ -25,43 +32,99 @@ Bluetooth::~Bluetooth()
         qDebug() << "del";
     }
 
-    this->logMessage("Destroying bluetooth object...");
-    this->logger->stopLogging();
+    if(this->logger->isLogging()){
+        this->logMessage("Destroying bluetooth object...");
+        this->logger->stopLogging();
+    }
 }
 
+//Known devices stay listed while scanning, a scan only replaces them with what it finds
 void Bluetooth::refreshDeviceList()
 {
-    this->discoveredDevices.clear();
+    this->discoveredDevices = knownDevices;
 
     QBluetoothDeviceDiscoveryAgent *discoveryAgent = new QBluetoothDeviceDiscoveryAgent(this);
     discoveryAgent->setLowEnergyDiscoveryTimeout(5000);
     connect(discoveryAgent, SIGNAL(deviceDiscovered(QBluetoothDeviceInfo)),
             this, SLOT(deviceDiscovered(QBluetoothDeviceInfo)));
+    connect(discoveryAgent, SIGNAL(finished()), discoveryAgent, SLOT(deleteLater()));
+    connect(discoveryAgent, SIGNAL(canceled()), discoveryAgent, SLOT(deleteLater()));
 
     discoveryAgent->start(QBluetoothDeviceDiscoveryAgent::LowEnergyMethod);
 }
 
+//List a device remembered from an earlier session without scanning for it
+void Bluetooth::addKnownDevice(QString address, QString name)
+{
+    for(const QBluetoothDeviceInfo &known : discoveredDevices){
+        if(deviceAddress(known) == address){
+            return;
+        }
+    }
+
+    //Remembered as the UUID on macOS, where the address is not available
+    QBluetoothDeviceInfo known = QBluetoothAddress(address).isNull()
+            ? QBluetoothDeviceInfo(QBluetoothUuid(address), name, 0)
+            : QBluetoothDeviceInfo(QBluetoothAddress(address), name, 0);
+    known.setCoreConfigurations(QBluetoothDeviceInfo::LowEnergyCoreConfiguration);
+    this->knownDevices.append(known);
+    this->discoveredDevices.append(known);
+
+    emit deviceListAvailable();
+}
+
+//Devices with no name, or a name another device also has, are told apart by their address
 QStringList Bluetooth::getDeviceList()
 {
     QStringList devices;
 
-    for(QBluetoothDeviceInfo device : discoveredDevices){
-        devices.append(device.name());
+    for(const QBluetoothDeviceInfo &device : discoveredDevices){
+        int sameName = 0;
+        for(const QBluetoothDeviceInfo &other : discoveredDevices){
+            if(other.name() == device.name()){
+                sameName++;
+            }
+        }
+
+        if(device.name().isEmpty() || sameName > 1){
+            devices.append(QString("%1 (%2)").arg(device.name(), deviceAddress(device)).trimmed());
+        }
+        else{
+            devices.append(device.name());
+        }
     }
 
     return devices;
 }
 
+//In the same order as getDeviceList()
+QStringList Bluetooth::getDeviceAddresses()
+{
+    QStringList addresses;
+
+    for(const QBluetoothDeviceInfo &device : discoveredDevices){
+        addresses.append(deviceAddress(device));
+    }
+
+    return addresses;
+}
+
 QString Bluetooth::getDeviceName()
 {
     return device.name();
 }
 
-void Bluetooth::setDeviceByName(QString device)
+QString Bluetooth::getDeviceAddress()
+{
+    return deviceAddress(device);
+}
+
+void Bluetooth::setDeviceByAddress(QString address)
 {
     for(int i = 0; i < discoveredDevices.size(); i++){
-        if(discoveredDevices[i].name() == device){
+        if(deviceAddress(discoveredDevices.at(i)) == address){
             this->device = discoveredDevices.at(i); //Set class device info variable
+            break;
         }
     }
 
@@ -70,41 +133,60 @@ void Bluetooth::setDeviceByName(QString device)
 
 QByteArray Bluetooth::readAll()
 {
-    QByteArray data = this->dataBuffer;
-    this->dataBuffer.clear();
+    QByteArray data(static_cast<int>(dataBuffer.size()), Qt::Uninitialized);
+    dataBuffer.read(data.data(), data.size());
     return data;
 }
 
-QString Bluetooth::getLine(QString terminator)
+//Copy up to maxSize received bytes into data. Does not allocate.
+qint64 Bluetooth::read(char *data, qint64 maxSize)
 {
-    QString line;
+    return dataBuffer.read(data, maxSize);
+}
+
+//Replace the contents of buffer with everything received. The buffer keeps its capacity, so once
+//it has grown to the largest burst this does not allocate (unless the previous contents are still shared).
+qint64 Bluetooth::readInto(QByteArray &buffer)
+{
+    int size = static_cast<int>(dataBuffer.size());
+
+    //Marks the capacity as reserved, so emptying the buffer does not free it either
+    buffer.reserve(qMax(size, buffer.capacity()));
+    buffer.resize(size);
 
-    qDebug() << dataBuffer;
+    return dataBuffer.read(buffer.data(), size);
+}
 
-    QString buffer = QString::fromLocal8Bit(dataBuffer);
+qint64 Bluetooth::bytesAvailable()
+{
+    return dataBuffer.size();
+}
+
+QString Bluetooth::getLine(QString terminator)
+{
+    //Lines are found in the raw bytes, only the line itself is decoded
+    QByteArray buffer = this->readAll();
+    QByteArray bytes = terminator.toUtf8();
+    QString line;
 
-    if(buffer.contains(terminator)){
-        line = buffer.split(terminator).at(0);
+    int end = buffer.indexOf(bytes);
+    int consumed = 0;
+    if(end >= 0){
+        line = QString::fromUtf8(buffer.constData(), end);
 
         //Remove line from buffer
-        dataBuffer.remove(0, line.size());
+        consumed = end + bytes.size();
     }
 
-    qDebug() << line;
-    qDebug() << dataBuffer;
+    dataBuffer.append(buffer.constData() + consumed, buffer.size() - consumed);
 
     return line;
 }
 
 QStringList Bluetooth::getAllLines(QString terminator)
 {
-    QStringList lines;
-
     //Split data into lines
-    lines = QString::fromLocal8Bit(dataBuffer).split(terminator);
-
-    //Remove data from buffer
-    dataBuffer.clear();
+    QStringList lines = QString::fromUtf8(this->readAll()).split(terminator);
 
     return lines;
 }
@@ -114,23 +196,59 @@ void Bluetooth::clearBuffer()
     this->dataBuffer.clear();
 }
 
-void Bluetooth::write(QByteArray data)
+void Bluetooth::setDebugLoggingEnabled(bool enabled)
+{
+    this->debugLoggingEnabled = enabled;
+    if(enabled){
+        this->debugLogFailed = false;
+    }
+}
+
+bool Bluetooth::isDebugLoggingEnabled()
 {
-    QString logString = "Writing data.. '%1' (%2 bytes)";
-    logString = logString.arg(QString::fromUtf8(data)).arg(data.size());
-    this->logMessage(logString);
+    return this->debugLoggingEnabled;
+}
 
-    if(m_control){
+quint64 Bluetooth::write(QByteArray data, TxScheduler::Priority priority)
+{
+    //Nothing to send to, the data is discarded as before
+    if(!loopbackEnabled && !(m_control && service)){
+        return 0;
+    }
+
+    this->logData("Writing data.. ", data);
+
+    txScheduler->setMaxWriteSize(this->getMaxWriteSize());
+    return txScheduler->enqueue(data, priority);
+}
+
+quint64 Bluetooth::write(QByteArray data)
+{
+    return write(data, TxScheduler::BULK);
+}
+
+//Called by the scheduler with one MTU sized chunk at a time
+void Bluetooth::transmit(QByteArray data)
+{
+    if(loopbackEnabled){
+        loopbackQueue.enqueue(data);
+        QTimer::singleShot(0, this, SLOT(deliverLoopbackData()));
+        return;
+    }
+
+    if(m_control && service){
         //Service discovered.
         QBluetoothUuid uuid = QBluetoothUuid(UART_TX_UUID);
         QLowEnergyCharacteristic hrChar = service->characteristic(uuid);
         if(hrChar.isValid()){
             service->writeCharacteristic(hrChar, data);
-        }
-        else{
-            this->logMessage("Failed to write data");
+            return;
         }
     }
+
+    //Nothing will confirm this write, let the scheduler move on
+    this->logMessage("Failed to write data");
+    txScheduler->handleWritten();
 }
 
 void Bluetooth::write(const QString &data)
@@ -140,7 +258,8 @@ void Bluetooth::write(const QString &data)
 
 void Bluetooth::write(const char data[])
 {
-    write(QByteArray::fromRawData(data, static_cast<int>(strlen(data))));
+    //Copied, the write may wait in a queue after the caller's buffer is gone
+    write(QByteArray(data));
 }
 
 void Bluetooth::write(QStringList data)
@@ -155,6 +274,69 @@ void Bluetooth::write(const char data)
     write(QString("%1").arg(data));
 }
 
+int Bluetooth::getMaxWriteSize()
+{
+    if(m_control && !loopbackEnabled){
+        return qMax(LOOPBACK_NOTIFICATION_SIZE, m_control->mtu() - 3);
+    }
+
+    return LOOPBACK_NOTIFICATION_SIZE;
+}
+
+void Bluetooth::setLoopbackEnabled(bool enabled)
+{
+    this->loopbackEnabled = enabled;
+    this->logMessage(QString("Loopback %1").arg(enabled ? "enabled" : "disabled"));
+
+    if(!enabled){
+        loopbackQueue.clear();
+        txScheduler->clear();
+    }
+}
+
+bool Bluetooth::isLoopbackEnabled()
+{
+    return this->loopbackEnabled;
+}
+
+void Bluetooth::simulateNotification(QByteArray data)
+{
+    handleCharacteristicChange(QLowEnergyCharacteristic(), data);
+}
+
+TxScheduler *Bluetooth::getTxScheduler()
+{
+    return this->txScheduler;
+}
+
+TriggerEngine *Bluetooth::getTriggerEngine()
+{
+    return this->triggerEngine;
+}
+
+void Bluetooth::setFrameDecoder(FrameDecoder *decoder)
+{
+    if(this->frameDecoder == decoder){
+        return;
+    }
+
+    delete this->frameDecoder;
+    this->frameDecoder = decoder;
+
+    if(decoder){
+        decoder->setParent(this);
+        this->logMessage(QString("Frame decoder set to %1").arg(decoder->getName()));
+    }
+    else{
+        this->logMessage("Frame decoder removed");
+    }
+}
+
+FrameDecoder *Bluetooth::getFrameDecoder()
+{
+    return this->frameDecoder;
+}
+
 void Bluetooth::connectToDevice()
 {
     this->logMessage(QString("Connecting to device %1...").arg(device.name()));
@@ -171,9 +353,9 @@ void Bluetooth::connectToDevice()
     m_control->connectToDevice();
 }
 
-void Bluetooth::connectToDevice(QString device)
+void Bluetooth::connectToDevice(QString address)
 {
-    setDeviceByName(device);
+    setDeviceByAddress(address);
     connectToDevice();
 }
 
@@ -185,9 +367,25 @@ void Bluetooth::disconnectFromDevice()
     service = nullptr;
 }
 
+//Opens the debug log on first use, so startup does not wait on creating (and truncating) the file
+bool Bluetooth::openDebugLog()
+{
+    if(!this->logger->isLogging() && !this->debugLogFailed){
+        this->logger->startLogging();
+
+        if(!this->logger->isLogging()){
+            qDebug() << "Bluetooth: could not open the debug log" << LogFilePath;
+            this->debugLogFailed = true;
+        }
+    }
+
+    return this->logger->isLogging();
+}
+
+//Like logData, nothing is written (and the file is not created) with debug logging turned off
 void Bluetooth::logMessage(QString message)
 {
-    if(this->logger->isLogging()){
+    if(this->debugLoggingEnabled && this->openDebugLog()){
         QString str;
         QDateTime time = QDateTime::currentDateTime();
         str += time.currentDateTime().toString(Qt::ISODateWithMs);
@@ -199,8 +397,47 @@ void Bluetooth::logMessage(QString message)
     }
 }
 
+//Log transferred data as is, without decoding it into a QString first
+void Bluetooth::logData(const char *prefix, const QByteArray &data)
+{
+    if(this->debugLoggingEnabled && this->openDebugLog()){
+        QByteArray line = QDateTime::currentDateTime().toString(Qt::ISODateWithMs).toLatin1();
+        line += " - ";
+        line += prefix;
+        line += '\'';
+        line += data;
+        line += "' (";
+        line += QByteArray::number(data.size());
+        line += " bytes)\r\n";
+        logger->log(line, true);
+    }
+}
+
+//macOS does not report device addresses, devices are identified by a UUID instead
+QString Bluetooth::deviceAddress(const QBluetoothDeviceInfo &device)
+{
+    if(device.address().isNull()){
+        return device.deviceUuid().toString();
+    }
+
+    return device.address().toString();
+}
+
 void Bluetooth::deviceDiscovered(const QBluetoothDeviceInfo &device)
 {
+    //A known device that was found is replaced by what the scan reported. Its name may have
+    //changed, so the list is still updated.
+    for(int i = 0; i < discoveredDevices.size(); i++){
+        if(deviceAddress(discoveredDevices.at(i)) == deviceAddress(device)){
+            bool renamed = discoveredDevices.at(i).name() != device.name();
+            this->discoveredDevices[i] = device;
+            if(renamed){
+                emit deviceListAvailable();
+            }
+            return;
+        }
+    }
+
     this->discoveredDevices.append(device);
     emit deviceListAvailable();
 }
@@ -217,6 +454,7 @@ void Bluetooth::serviceDiscovered(QBluetoothUuid uuid)
             connect(service, SIGNAL(characteristicChanged(QLowEnergyCharacteristic, QByteArray)), this, SLOT(handleCharacteristicChange(QLowEnergyCharacteristic, QByteArray)));
             connect(service, SIGNAL(descriptorWritten(QLowEnergyDescriptor, QByteArray)), this, SLOT(handleDescriptorWrite(QLowEnergyDescriptor, QByteArray)));
             connect(service, SIGNAL(characteristicRead(QLowEnergyCharacteristic, QByteArray)), this, SLOT(handleCharacteristicChange(QLowEnergyCharacteristic, QByteArray)));
+            connect(service, SIGNAL(characteristicWritten(QLowEnergyCharacteristic, QByteArray)), this, SLOT(handleCharacteristicWritten(QLowEnergyCharacteristic, QByteArray)));
             service->discoverDetails();
         }
         else{
@@ -242,6 +480,7 @@ void Bluetooth::handleDeviceConnection()
 void Bluetooth::handleDeviceDisconnection()
 {
     this->logMessage("Disconnected from device");
+    txScheduler->clear();
     emit deviceDisconnected();
 }
 
@@ -262,7 +501,7 @@ void Bluetooth::handleServiceStateChange(QLowEnergyService::ServiceState state)
             QLowEnergyCharacteristic txChar = service->characteristic(txUuid);
             if(txChar.isValid()){
                 this->logMessage("UART TX service discovered");
-                service->writeCharacteristic(txChar, "Test data");
+                write(QByteArray("Test data"), TxScheduler::CONTROL);
                 emit deviceTransmitReady();
             }
             else{
@@ -294,8 +533,13 @@ void Bluetooth::handleServiceStateChange(QLowEnergyService::ServiceState state)
 
 void Bluetooth::handleCharacteristicChange(QLowEnergyCharacteristic, QByteArray data)
 {
-    this->logMessage(QString("Received data: '%1'").arg(QString::fromUtf8(data)));
-    this->dataBuffer.append(data);
+    this->logData("Received data: ", data);
+    this->dataBuffer.append(data.constData(), data.size());
+    this->triggerEngine->feed(data);
+    if(this->frameDecoder){
+        this->frameDecoder->feed(data);
+    }
+    emit dataReceived(data);
     emit dataAvailable();
 }
 
@@ -305,6 +549,11 @@ void Bluetooth::handleDescriptorWrite(QLowEnergyDescriptor, QByteArray data)
     this->logMessage(QString("Descriptor written with data: %1").arg(QString::fromUtf8(data)));
 }
 
+void Bluetooth::handleCharacteristicWritten(QLowEnergyCharacteristic, QByteArray)
+{
+    txScheduler->handleWritten();
+}
+
 void Bluetooth::handleError(QLowEnergyController::Error error)
 {
     qDebug() << "err";
@@ -321,3 +570,20 @@ void Bluetooth::handleServiceError(QLowEnergyService::ServiceError error)
     errorText = errorText.arg(error);
     this->logMessage(errorText);
 }
+
+//Echo one queued write back through the receive path, split into notification sized pieces
+//the same way a peripheral would send it
+void Bluetooth::deliverLoopbackData()
+{
+    if(loopbackQueue.isEmpty()){
+        return;
+    }
+
+    QByteArray data = loopbackQueue.dequeue();
+
+    for(int i = 0; i < data.size(); i += LOOPBACK_NOTIFICATION_SIZE){
+        simulateNotification(data.mid(i, LOOPBACK_NOTIFICATION_SIZE));
+    }
+
+    txScheduler->handleWritten();
+}
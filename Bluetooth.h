@@ -23,10 +23,15 @@
 
 //Project includes
 #include "Logger.h"
+#include "TriggerEngine.h"
+#include "FrameDecoder.h"
+#include "BufferPool.h"
+#include "TxScheduler.h"
 
 //Qt includes
 #include <QObject>
 #include <QString>
+#include <QQueue>
 
 //Qt bluetooth includes
 #include <QBluetoothDeviceDiscoveryAgent>
@@ -47,26 +52,62 @@ public:
 
     //Connection functions
     void refreshDeviceList();
+    //Devices are identified by their address, or their UUID on macOS
     QStringList getDeviceList();
+    QStringList getDeviceAddresses();
+    void addKnownDevice(QString address, QString name);
 
     QString getDeviceName();
-    void setDeviceByName(QString device);
+    QString getDeviceAddress();
+    void setDeviceByAddress(QString address);
 
     //Reading functions
     QByteArray readAll();
+    qint64 read(char *data, qint64 maxSize);
+    qint64 readInto(QByteArray &buffer);
+    qint64 bytesAvailable();
     QString getLine(QString terminator);
     QStringList getAllLines(QString terminator);
     void clearBuffer();
 
     //Writing functions
-    void write(QByteArray data);
+    //Writes are queued by priority (see TxScheduler), the plain overloads queue as bulk data.
+    //Returns the id writeFinished() reports the write with, 0 if there is nothing to send to.
+    quint64 write(QByteArray data, TxScheduler::Priority priority);
+    quint64 write(QByteArray data);
     void write(const QString &data);
     void write(const char data[]);
     void write(QStringList data);
     void write(const char data);
 
+    //Largest payload that fits in a single ATT write (negotiated MTU minus the 3 byte header)
+    int getMaxWriteSize();
+
+    //Simulated transport
+    //When enabled, writes are echoed back through the receive path instead of going to the device
+    void setLoopbackEnabled(bool enabled);
+    bool isLoopbackEnabled();
+
+    //Pass data through the receive path as if the device had sent it in one notification
+    void simulateNotification(QByteArray data);
+
+    //Every write and notification is recorded in the debug log (BluetoothDebug.txt) while enabled
+    void setDebugLoggingEnabled(bool enabled);
+    bool isDebugLoggingEnabled();
+
+    TxScheduler *getTxScheduler();
+
+    //Pattern triggers run over the receive stream as it arrives
+    TriggerEngine *getTriggerEngine();
+
+    //Optional binary frame decoder stage. Takes ownership of the decoder, pass nullptr to remove it.
+    void setFrameDecoder(FrameDecoder *decoder);
+    FrameDecoder *getFrameDecoder();
+
 signals:
     void dataAvailable();
+    void dataReceived(QByteArray data);
+    void writeFinished(quint64 id, bool written);
     void deviceConnected();
     void deviceDisconnected();
     void deviceListAvailable();
@@ -74,13 +115,15 @@ signals:
 
 public slots:
     void connectToDevice();
-    void connectToDevice(QString device);
+    void connectToDevice(QString address);
     void disconnectFromDevice();
 
 private:
     QList<QBluetoothDeviceInfo> discoveredDevices;
+    QList<QBluetoothDeviceInfo> knownDevices;       //Remembered from earlier sessions, listed without scanning
     QBluetoothDeviceInfo device;
-    QByteArray dataBuffer;
+    BufferPool rxPool;
+    ChunkQueue dataBuffer{&rxPool};     //Received notifications, in order. Declared after the pool it returns chunks to.
 
     const QString UART_UUID             = "{6e400001-b5a3-f393-e0a9-e50e24dcca9e}"; //UART GATT UUID
     const QString UART_TX_UUID          = "{6e400002-b5a3-f393-e0a9-e50e24dcca9e}"; //UART TX Characteristic UUID
@@ -91,12 +134,26 @@ private:
     QBluetoothUuid UARTuuid = QBluetoothUuid(UART_UUID);
     QLowEnergyDescriptor m_notificationDesc;
 
+    bool loopbackEnabled = false;
+    QQueue<QByteArray> loopbackQueue;
+    const int LOOPBACK_NOTIFICATION_SIZE = 20;   //Default ATT MTU (23) minus the 3 byte header
+
+    TriggerEngine *triggerEngine = nullptr;
+    FrameDecoder *frameDecoder = nullptr;
+    TxScheduler *txScheduler = nullptr;
+
     Logger *logger = nullptr;
     QString LogFilePath = "BluetoothDebug.txt";
+    bool debugLoggingEnabled = true;
+    bool debugLogFailed = false;        //Not retried on every message, only when logging is enabled again
 
+    static QString deviceAddress(const QBluetoothDeviceInfo &device);
+    bool openDebugLog();
     void logMessage(QString message);
+    void logData(const char *prefix, const QByteArray &data);
 
 private slots:
+    void transmit(QByteArray data);
     void deviceDiscovered(const QBluetoothDeviceInfo &device);
     void serviceDiscovered(QBluetoothUuid uuid);
     void serviceScanDone();
@@ -105,8 +162,10 @@ private slots:
     void handleServiceStateChange(QLowEnergyService::ServiceState state);
     void handleCharacteristicChange(QLowEnergyCharacteristic characteristic, QByteArray data);
     void handleDescriptorWrite(QLowEnergyDescriptor descriptor, QByteArray data);
+    void handleCharacteristicWritten(QLowEnergyCharacteristic characteristic, QByteArray data);
     void handleError(QLowEnergyController::Error error);
     void handleServiceError(QLowEnergyService::ServiceError error);
+    void deliverLoopbackData();
 };
 
 #endif // BLUETOOTH_H
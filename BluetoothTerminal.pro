@@ -4,7 +4,7 @@
 #
 #-------------------------------------------------
 
-QT       += core gui bluetooth
+QT       += core gui bluetooth network
 
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
@@ -29,13 +29,53 @@ SOURCES += \
         MainWindow.cpp \
     Bluetooth.cpp \
     Terminal.cpp \
-    Logger.cpp
+    Logger.cpp \
+    StressTest.cpp \
+    TriggerEngine.cpp \
+    SearchIndex.cpp \
+    SearchDialog.cpp \
+    FrameDecoder.cpp \
+    TelemetryParser.cpp \
+    TelemetryBuffer.cpp \
+    PlotWidget.cpp \
+    TelemetryExporter.cpp \
+    FileSender.cpp \
+    MacroEngine.cpp \
+    BufferPool.cpp \
+    FanoutServer.cpp \
+    PtyBridge.cpp \
+    DurableLog.cpp \
+    ExportJob.cpp \
+    StartupTimeline.cpp \
+    TxScheduler.cpp \
+    SessionFile.cpp \
+    ScrollbackText.cpp
 
 HEADERS += \
         MainWindow.h \
     Bluetooth.h \
     Terminal.h \
-    Logger.h
+    Logger.h \
+    StressTest.h \
+    TriggerEngine.h \
+    SearchIndex.h \
+    SearchDialog.h \
+    FrameDecoder.h \
+    TelemetryParser.h \
+    TelemetryBuffer.h \
+    PlotWidget.h \
+    TelemetryExporter.h \
+    FileSender.h \
+    MacroEngine.h \
+    BufferPool.h \
+    FanoutServer.h \
+    PtyBridge.h \
+    DurableLog.h \
+    ExportJob.h \
+    StartupTimeline.h \
+    TxScheduler.h \
+    SessionFile.h \
+    ScrollbackText.h
 
 FORMS += \
         MainWindow.ui
@@ -0,0 +1,178 @@
+#include "BufferPool.h"
+
+#include <cstring>
+
+BufferPool::BufferPool(int chunksPerSlab)
+{
+    this->chunksPerSlab = qMax(1, chunksPerSlab);
+    slabs.reserve(16);
+}
+
+BufferPool::~BufferPool()
+{
+    for(Chunk *slab : slabs){
+        delete[] slab;
+    }
+}
+
+BufferPool::Chunk *BufferPool::acquire()
+{
+    if(!freeList){
+        grow();
+    }
+
+    Chunk *chunk = freeList;
+    freeList = chunk->next;
+    freeCount--;
+
+    chunk->next = nullptr;
+    chunk->size = 0;
+    chunk->offset = 0;
+
+    return chunk;
+}
+
+void BufferPool::release(BufferPool::Chunk *chunk)
+{
+    chunk->next = freeList;
+    freeList = chunk;
+    freeCount++;
+}
+
+int BufferPool::getChunkCount()
+{
+    return this->chunkCount;
+}
+
+int BufferPool::getFreeCount()
+{
+    return this->freeCount;
+}
+
+//Add a slab of chunks to the free list
+void BufferPool::grow()
+{
+    Chunk *slab = new Chunk[chunksPerSlab];
+    slabs.append(slab);
+
+    for(int i = chunksPerSlab - 1; i >= 0; i--){
+        slab[i].next = freeList;
+        freeList = &slab[i];
+    }
+
+    chunkCount += chunksPerSlab;
+    freeCount += chunksPerSlab;
+}
+
+ChunkQueue::ChunkQueue(BufferPool *pool)
+{
+    this->pool = pool;
+}
+
+ChunkQueue::~ChunkQueue()
+{
+    clear();
+}
+
+void ChunkQueue::append(const char *data, qint64 size)
+{
+    while(size > 0){
+        if(!tail || tail->size == BufferPool::CHUNK_SIZE){
+            BufferPool::Chunk *chunk = pool->acquire();
+            if(tail){
+                tail->next = chunk;
+            }
+            else{
+                head = chunk;
+            }
+            tail = chunk;
+        }
+
+        int count = static_cast<int>(qMin<qint64>(size, BufferPool::CHUNK_SIZE - tail->size));
+        std::memcpy(tail->data + tail->size, data, static_cast<size_t>(count));
+        tail->size += count;
+        bytes += count;
+
+        data += count;
+        size -= count;
+    }
+}
+
+qint64 ChunkQueue::read(char *dest, qint64 maxSize)
+{
+    qint64 copied = 0;
+
+    while(head && copied < maxSize){
+        int count = static_cast<int>(qMin<qint64>(maxSize - copied, head->size - head->offset));
+        std::memcpy(dest + copied, head->data + head->offset, static_cast<size_t>(count));
+        head->offset += count;
+        copied += count;
+
+        //Fully consumed chunks go straight back to the pool
+        if(head->offset == head->size){
+            BufferPool::Chunk *next = head->next;
+            pool->release(head);
+            head = next;
+            if(!head){
+                tail = nullptr;
+            }
+        }
+    }
+
+    bytes -= copied;
+    return copied;
+}
+
+const char *ChunkQueue::front(qint64 *size)
+{
+    if(!head){
+        *size = 0;
+        return nullptr;
+    }
+
+    *size = head->size - head->offset;
+    return head->data + head->offset;
+}
+
+void ChunkQueue::consume(qint64 size)
+{
+    size = qMin(size, bytes);
+    bytes -= size;
+
+    while(head && size > 0){
+        int count = static_cast<int>(qMin<qint64>(size, head->size - head->offset));
+        head->offset += count;
+        size -= count;
+
+        if(head->offset == head->size){
+            BufferPool::Chunk *next = head->next;
+            pool->release(head);
+            head = next;
+            if(!head){
+                tail = nullptr;
+            }
+        }
+    }
+}
+
+void ChunkQueue::clear()
+{
+    while(head){
+        BufferPool::Chunk *next = head->next;
+        pool->release(head);
+        head = next;
+    }
+
+    tail = nullptr;
+    bytes = 0;
+}
+
+qint64 ChunkQueue::size()
+{
+    return this->bytes;
+}
+
+bool ChunkQueue::isEmpty()
+{
+    return this->bytes == 0;
+}
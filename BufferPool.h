@@ -0,0 +1,84 @@
+#ifndef BUFFERPOOL_H
+#define BUFFERPOOL_H
+
+/*
+ * Receive buffer pool
+ *
+ * Fixed size chunks carved out of larger slabs and recycled through a free list, so buffering
+ * received data does not touch the heap once the pool has grown to the working set.
+ *
+ * Chunks carry an intrusive 'next' pointer, which lets a chunk queue be built without any
+ * allocation either (see ChunkQueue). The pool only grows (one slab at a time) when every
+ * chunk is in use; slabs are released when the pool is destroyed.
+ */
+
+#include <QVector>
+
+class BufferPool
+{
+public:
+    static const int CHUNK_SIZE = 256;      //Fits a notification at the largest common ATT MTU (247)
+
+    struct Chunk{
+        Chunk *next     = nullptr;
+        int size        = 0;                //Bytes stored in data
+        int offset      = 0;                //Bytes already consumed from data
+        char data[CHUNK_SIZE];
+    };
+
+    explicit BufferPool(int chunksPerSlab = 64);
+    ~BufferPool();
+
+    Chunk *acquire();
+    void release(Chunk *chunk);
+
+    int getChunkCount();
+    int getFreeCount();
+
+private:
+    BufferPool(const BufferPool &) = delete;
+    BufferPool &operator=(const BufferPool &) = delete;
+
+    QVector<Chunk *> slabs;
+    Chunk *freeList     = nullptr;
+    int chunksPerSlab   = 64;
+    int chunkCount      = 0;
+    int freeCount       = 0;
+
+    void grow();
+};
+
+/*
+ * FIFO byte queue made of pool chunks. Bytes are packed densely, so many small notifications
+ * share a chunk. Reading copies the bytes out (or front()/consume() let a consumer use them in
+ * place) and hands consumed chunks back to the pool.
+ */
+class ChunkQueue
+{
+public:
+    explicit ChunkQueue(BufferPool *pool);
+    ~ChunkQueue();
+
+    void append(const char *data, qint64 size);
+    qint64 read(char *dest, qint64 maxSize);
+
+    //Zero copy draining: the contiguous bytes at the front of the queue, then drop what was used
+    const char *front(qint64 *size);
+    void consume(qint64 size);
+
+    void clear();
+
+    qint64 size();
+    bool isEmpty();
+
+private:
+    ChunkQueue(const ChunkQueue &) = delete;
+    ChunkQueue &operator=(const ChunkQueue &) = delete;
+
+    BufferPool *pool            = nullptr;
+    BufferPool::Chunk *head     = nullptr;
+    BufferPool::Chunk *tail     = nullptr;
+    qint64 bytes                = 0;
+};
+
+#endif // BUFFERPOOL_H
@@ -0,0 +1,243 @@
+#include "DurableLog.h"
+
+#include <QDateTime>
+#include <QDebug>
+
+#include <array>
+#include <cstring>
+
+#ifdef Q_OS_WIN
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+static const char RECORD_MAGIC[] = "BTLR";
+static const quint16 FORMAT_VERSION = 1;
+
+static void putLittleEndian(char *out, quint64 value, int bytes)
+{
+    for(int i = 0; i < bytes; i++){
+        out[i] = char((value >> (8 * i)) & 0xFF);
+    }
+}
+
+static quint64 getLittleEndian(const uchar *in, int bytes)
+{
+    quint64 value = 0;
+    for(int i = 0; i < bytes; i++){
+        value |= quint64(in[i]) << (8 * i);
+    }
+    return value;
+}
+
+QByteArray DurableLog::fileHeader()
+{
+    QByteArray header("BTLOG", 5);
+    header.append('\0');
+    header.append(char(FORMAT_VERSION & 0xFF));
+    header.append(char(FORMAT_VERSION >> 8));
+    return header;
+}
+
+QByteArray DurableLog::encodeRecord(quint64 sequence, qint64 timestamp, bool incoming, const QByteArray &data)
+{
+    Q_ASSERT(data.size() <= MAX_RECORD_SIZE);
+
+    QByteArray record(RECORD_OVERHEAD + data.size(), Qt::Uninitialized);
+    char *out = record.data();
+
+    memcpy(out, RECORD_MAGIC, 4);
+    putLittleEndian(out + 4, quint64(data.size()), 4);
+    putLittleEndian(out + 8, sequence, 8);
+    putLittleEndian(out + 16, quint64(timestamp), 8);
+    out[24] = incoming ? 1 : 0;
+    memcpy(out + 25, data.constData(), size_t(data.size()));
+
+    //The CRC covers everything after the magic, so a record is only valid if it was written completely
+    quint32 crc = crc32(out + 4, 21 + data.size());
+    putLittleEndian(out + 25 + data.size(), crc, 4);
+
+    return record;
+}
+
+DurableLog::ScanResult DurableLog::scan(QFile *file)
+{
+    ScanResult result;
+    result.fileSize = file->size();
+
+    if(result.fileSize < HEADER_SIZE){
+        return result;
+    }
+
+    //Map rather than read, logs can be much larger than memory is happy to hold
+    uchar *map = file->map(0, result.fileSize);
+    QByteArray readBack;
+    const uchar *data = map;
+    if(!map){
+        file->seek(0);
+        readBack = file->readAll();
+        data = reinterpret_cast<const uchar *>(readBack.constData());
+        result.fileSize = readBack.size();
+    }
+
+    QByteArray header = fileHeader();
+    result.headerValid = memcmp(data, header.constData(), 6) == 0;
+
+    if(result.headerValid){
+        qint64 offset = HEADER_SIZE;
+        bool first = true;
+
+        while(result.fileSize - offset >= RECORD_OVERHEAD){
+            const uchar *record = data + offset;
+            if(memcmp(record, RECORD_MAGIC, 4) != 0){
+                break;
+            }
+
+            qint64 length = qint64(getLittleEndian(record + 4, 4));
+            if(length > MAX_RECORD_SIZE || result.fileSize - offset < RECORD_OVERHEAD + length){
+                break;
+            }
+
+            quint32 crc = quint32(getLittleEndian(record + 25 + length, 4));
+            if(crc32(reinterpret_cast<const char *>(record + 4), 21 + length) != crc){
+                break;
+            }
+
+            quint64 sequence = getLittleEndian(record + 8, 8);
+            if(!first && sequence != result.lastSequence + 1){
+                result.sequenceGaps++;
+            }
+            first = false;
+
+            result.lastSequence = sequence;
+            result.records++;
+            offset += RECORD_OVERHEAD + length;
+        }
+
+        result.validBytes = offset;
+    }
+
+    if(map){
+        file->unmap(map);
+    }
+
+    return result;
+}
+
+quint64 DurableLog::prepareForAppend(QFile *file, ScanResult *result)
+{
+    ScanResult scanned;
+
+    if(file->size() == 0){
+        file->write(fileHeader());
+        scanned.headerValid = true;
+        scanned.validBytes = HEADER_SIZE;
+        scanned.fileSize = HEADER_SIZE;
+    }
+    else{
+        scanned = scan(file);
+        if(!scanned.headerValid){
+            if(result){
+                *result = scanned;
+            }
+            return 0;
+        }
+
+        //Cut off a record torn by a crash, the next record would be unreachable behind it
+        if(scanned.validBytes < scanned.fileSize){
+            qDebug() << "DurableLog: discarding" << scanned.fileSize - scanned.validBytes << "bytes of incomplete records";
+            file->resize(scanned.validBytes);
+            syncFile(file);
+        }
+    }
+
+    file->seek(scanned.validBytes);
+
+    if(result){
+        *result = scanned;
+    }
+
+    return scanned.records > 0 ? scanned.lastSequence + 1 : 1;
+}
+
+qint64 DurableLog::exportText(QString path, QIODevice *out, ScanResult *result)
+{
+    QFile file(path);
+    if(!file.open(QIODevice::ReadOnly)){
+        return 0;
+    }
+
+    ScanResult scanned = scan(&file);
+    if(result){
+        *result = scanned;
+    }
+
+    //Stream the records rather than loading the whole log
+    file.seek(HEADER_SIZE);
+    QByteArray record;
+    qint64 offset = HEADER_SIZE;
+    qint64 exported = 0;
+
+    while(scanned.headerValid && offset < scanned.validBytes){
+        record = file.read(25);
+        const uchar *fields = reinterpret_cast<const uchar *>(record.constData());
+        qint64 length = qint64(getLittleEndian(fields + 4, 4));
+        qint64 sequence = qint64(getLittleEndian(fields + 8, 8));
+        qint64 timestamp = qint64(getLittleEndian(fields + 16, 8));
+        bool incoming = fields[24] != 0;
+
+        QByteArray line = QString("%1\t%2\t%3\t")
+                .arg(sequence)
+                .arg(QDateTime::fromMSecsSinceEpoch(timestamp).toString(Qt::ISODateWithMs))
+                .arg(incoming ? "RX" : "TX")
+                .toUtf8();
+        line.append(file.read(length));
+        if(!line.endsWith('\n')){
+            line.append('\n');
+        }
+        out->write(line);
+
+        file.read(4);
+        offset += RECORD_OVERHEAD + length;
+        exported++;
+    }
+
+    return exported;
+}
+
+bool DurableLog::syncFile(QFile *file)
+{
+    if(!file->flush()){
+        return false;
+    }
+
+#ifdef Q_OS_WIN
+    return _commit(file->handle()) == 0;
+#else
+    return fsync(file->handle()) == 0;
+#endif
+}
+
+//CRC-32 (IEEE 802.3, the zlib polynomial)
+quint32 DurableLog::crc32(const char *data, qint64 size, quint32 crc)
+{
+    //Built once, thread safe (C++11 static initialization). Export jobs checksum off the GUI thread.
+    static const std::array<quint32, 256> table = []{
+        std::array<quint32, 256> entries;
+        for(quint32 i = 0; i < 256; i++){
+            quint32 value = i;
+            for(int bit = 0; bit < 8; bit++){
+                value = (value & 1) ? (0xEDB88320u ^ (value >> 1)) : (value >> 1);
+            }
+            entries[i] = value;
+        }
+        return entries;
+    }();
+
+    crc = ~crc;
+    for(qint64 i = 0; i < size; i++){
+        crc = table[(crc ^ uchar(data[i])) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
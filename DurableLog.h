@@ -0,0 +1,63 @@
+#ifndef DURABLELOG_H
+#define DURABLELOG_H
+
+/*
+ * Durable log records
+ *
+ * Crash safe log file format used by Logger's DURABLE format. The file is only ever appended
+ * to, and every record checksums itself, so after a crash or power loss the log is valid up
+ * to the last complete record. A torn record at the end is cut off the next time the file is
+ * opened for logging.
+ *
+ * File layout, all integers little endian:
+ *
+ *      Header:     "BTLOG" 0x00 <uint16 version = 1>
+ *      Record:     "BTLR" <uint32 length> <uint64 sequence> <int64 timestamp, ms since epoch>
+ *                  <uint8 direction, 1 = received, 0 = sent> <length bytes of data>
+ *                  <uint32 CRC-32 of everything from length to the end of the data>
+ *
+ * Sequence numbers continue across sessions, so a gap shows where records were lost.
+ */
+
+#include <QByteArray>
+#include <QString>
+#include <QFile>
+#include <QIODevice>
+
+class DurableLog
+{
+public:
+    struct ScanResult{
+        bool headerValid        = false;
+        qint64 records          = 0;
+        qint64 validBytes       = 0;        //File offset just past the last valid record
+        qint64 fileSize         = 0;
+        quint64 lastSequence    = 0;
+        qint64 sequenceGaps     = 0;
+    };
+
+    static const int HEADER_SIZE = 8;
+    static const int RECORD_OVERHEAD = 29;  //Magic, length, sequence, timestamp, direction and CRC
+    static const int MAX_RECORD_SIZE = 16 * 1024 * 1024;
+
+    static QByteArray fileHeader();
+    //data must not be longer than MAX_RECORD_SIZE, scan() would take the record for a torn one
+    static QByteArray encodeRecord(quint64 sequence, qint64 timestamp, bool incoming, const QByteArray &data);
+
+    //Finds the last valid record of an existing log
+    static ScanResult scan(QFile *file);
+
+    //Gets an open (read/write) log ready for appending: writes the header to an empty file or
+    //cuts a torn record off the end. Returns the next sequence number, or 0 if the file is not a durable log.
+    static quint64 prepareForAppend(QFile *file, ScanResult *result = nullptr);
+
+    //Writes the valid records of a log as text, one line per record. Returns the number of records.
+    static qint64 exportText(QString path, QIODevice *out, ScanResult *result = nullptr);
+
+    //Makes everything written to the file so far durable (fsync)
+    static bool syncFile(QFile *file);
+
+    static quint32 crc32(const char *data, qint64 size, quint32 crc = 0);
+};
+
+#endif // DURABLELOG_H
@@ -0,0 +1,156 @@
+#include "ExportJob.h"
+#include "DurableLog.h"
+
+#include <QFile>
+#include <QDateTime>
+#include <QElapsedTimer>
+
+ExportJob::ExportJob(Terminal::Snapshot snapshot, QString path, ExportJob::Format format, QObject *parent)
+    : QThread(parent), snapshot(snapshot), path(path), format(format)
+{
+}
+
+QStringList ExportJob::formatFilters()
+{
+    return QStringList() << "Text Files (*.txt)"
+                         << "Hex Files (*.hex)"
+                         << "HTML Files (*.html)"
+                         << "Binary Capture (*.btlog)";
+}
+
+void ExportJob::cancel()
+{
+    cancelled.store(1);
+}
+
+void ExportJob::run()
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    sequence = 1;
+    hexLineStart = true;
+
+    QFile file(path);
+    if(!file.open(QIODevice::WriteOnly | QIODevice::Truncate)){
+        emit completed(false, "Could not open " + path);
+        return;
+    }
+
+    qint64 total = 0;
+    for(const Terminal::TextRun &run : snapshot.runs){
+        total += run.length;
+    }
+
+    bool ok = writeHeader(&file);
+    qint64 done = 0;
+    QString scratch;
+
+    for(int i = 0; ok && i < snapshot.runs.size() && !cancelled.load(); i++){
+        const Terminal::TextRun &run = snapshot.runs.at(i);
+        int position = run.start;
+        int end = run.start + run.length;
+
+        while(ok && position < end && !cancelled.load()){
+            int length = qMin(static_cast<int>(CHUNK_SIZE), end - position);
+
+            //Keep surrogate pairs together so every chunk converts to valid UTF-8
+            if(position + length < end && snapshot.text.at(position + length - 1).isHighSurrogate()){
+                length--;
+            }
+
+            ok = writeChunk(&file, snapshot.text.midRef(position, length, &scratch), run.incoming);
+            position += length;
+            done += length;
+
+            emit progress(done, total);
+        }
+    }
+
+    if(ok && !cancelled.load()){
+        ok = writeFooter(&file);
+    }
+
+    if(!ok || cancelled.load()){
+        QString error = file.errorString();
+        file.remove();
+        emit completed(false, ok ? QString("Export cancelled") : "Could not write " + path + ": " + error);
+        return;
+    }
+
+    file.close();
+    emit completed(true, QString("Exported %1 characters to %2 in %3 ms")
+                   .arg(total)
+                   .arg(path)
+                   .arg(timer.elapsed()));
+}
+
+bool ExportJob::writeHeader(QIODevice *out)
+{
+    switch(format){
+        case HTML:
+            return out->write(QString("<!DOCTYPE html>\n<html>\n<head>\n<meta charset=\"utf-8\">\n<title>Terminal Capture</title>\n</head>\n"
+                                      "<body style=\"background-color: black; color: %1;\">\n<pre>")
+                              .arg(snapshot.incomingColor.name())
+                              .toUtf8()) >= 0;
+        case CAPTURE:
+            return out->write(DurableLog::fileHeader()) >= 0;
+        default:
+            return true;
+    }
+}
+
+bool ExportJob::writeChunk(QIODevice *out, const QStringRef &chunk, bool incoming)
+{
+    QByteArray data;
+
+    switch(format){
+        case TEXT:
+            data = chunk.toUtf8();
+            break;
+        case HEX:{
+            const static char hexLookup[] = "0123456789ABCDEF";
+
+            QByteArray bytes = chunk.toUtf8();
+            data.reserve(bytes.size() * 3);
+
+            for(char c : bytes){
+                if(c == '\r' || c == '\n'){
+                    data.append(c);
+                    hexLineStart = true;
+                }
+                else{
+                    if(!hexLineStart){
+                        data.append(',');
+                    }
+
+                    data.append(hexLookup[(c & 0xF0) >> 4]);
+                    data.append(hexLookup[c & 0x0F]);
+                    hexLineStart = false;
+                }
+            }
+            break;
+        }
+        case HTML:
+            data = QString("<span style=\"color: %1;\">%2</span>")
+                    .arg((incoming ? snapshot.incomingColor : snapshot.outgoingColor).name())
+                    .arg(chunk.toString().toHtmlEscaped())
+                    .toUtf8();
+            break;
+        case CAPTURE:
+            //The scrollback does not keep arrival times, records are stamped with the export time
+            data = DurableLog::encodeRecord(sequence++, QDateTime::currentMSecsSinceEpoch(), incoming, chunk.toUtf8());
+            break;
+    }
+
+    return out->write(data) == data.size();
+}
+
+bool ExportJob::writeFooter(QIODevice *out)
+{
+    if(format == HTML){
+        return out->write("</pre>\n</body>\n</html>\n") >= 0;
+    }
+
+    return true;
+}
@@ -0,0 +1,68 @@
+#ifndef EXPORTJOB_H
+#define EXPORTJOB_H
+
+/*
+ * Terminal export job
+ *
+ * Writes a snapshot of the terminal scrollback to a file on a background thread, so exporting
+ * a large session does not block the window. The scrollback is converted and written a chunk
+ * at a time, the whole document is never built up as one string.
+ *
+ * Formats:
+ *  - TEXT:     the text as UTF-8
+ *  - HEX:      the UTF-8 bytes as comma separated hex values, newlines preserved (as Log Raw Data)
+ *  - HTML:     a page with each direction in its terminal color
+ *  - CAPTURE:  direction tagged durable log records (see DurableLog), readable by Recover Durable Log
+ *
+ * Progress is reported in characters of the scrollback. Cancelling stops at the next chunk
+ * and removes the partial file.
+ */
+
+#include "Terminal.h"
+
+#include <QThread>
+#include <QAtomicInt>
+#include <QIODevice>
+
+class ExportJob : public QThread
+{
+    Q_OBJECT
+public:
+    enum Format{
+        TEXT,
+        HEX,
+        HTML,
+        CAPTURE,
+    };
+
+    ExportJob(Terminal::Snapshot snapshot, QString path, Format format, QObject *parent = nullptr);
+
+    //File dialog filters, in Format order
+    static QStringList formatFilters();
+
+public slots:
+    void cancel();
+
+signals:
+    void progress(qint64 done, qint64 total);
+    void completed(bool success, QString report);   //QThread::finished() is emitted after this
+
+protected:
+    void run() override;
+
+private:
+    static const int CHUNK_SIZE = 64 * 1024;    //Characters converted and written at a time
+
+    Terminal::Snapshot snapshot;
+    QString path;
+    Format format;
+    QAtomicInt cancelled;
+    quint64 sequence    = 1;
+    bool hexLineStart   = true;
+
+    bool writeHeader(QIODevice *out);
+    bool writeChunk(QIODevice *out, const QStringRef &chunk, bool incoming);
+    bool writeFooter(QIODevice *out);
+};
+
+#endif // EXPORTJOB_H
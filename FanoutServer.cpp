@@ -0,0 +1,240 @@
+#include "FanoutServer.h"
+
+#include <QDebug>
+#include <QLocalSocket>
+#include <QTcpSocket>
+#include <cstring>
+
+FanoutServer::FanoutServer(Bluetooth *bluetooth, QObject *parent) : QObject(parent)
+{
+    this->bluetooth = bluetooth;
+    setRingSize(1 << 20);
+}
+
+bool FanoutServer::start(QString localName, quint16 tcpPort)
+{
+    if(isRunning()){
+        return true;
+    }
+
+    localServer = new QLocalServer(this);
+    localServer->setSocketOptions(QLocalServer::UserAccessOption);
+    QLocalServer::removeServer(localName);   //Clean up a socket left behind by a crashed instance
+    if(localServer->listen(localName)){
+        connect(localServer, SIGNAL(newConnection()), this, SLOT(handleLocalConnection()));
+    }
+    else{
+        qDebug() << "FanoutServer: could not listen on" << localName << localServer->errorString();
+        delete localServer;
+        localServer = nullptr;
+    }
+
+    if(tcpPort > 0){
+        tcpServer = new QTcpServer(this);
+        if(tcpServer->listen(QHostAddress::LocalHost, tcpPort)){
+            connect(tcpServer, SIGNAL(newConnection()), this, SLOT(handleTcpConnection()));
+        }
+        else{
+            qDebug() << "FanoutServer: could not listen on port" << tcpPort << tcpServer->errorString();
+            delete tcpServer;
+            tcpServer = nullptr;
+        }
+    }
+
+    if(!isRunning()){
+        return false;
+    }
+
+    connect(bluetooth, SIGNAL(dataReceived(QByteArray)), this, SLOT(handleData(QByteArray)));
+    return true;
+}
+
+void FanoutServer::stop()
+{
+    for(QIODevice *socket : clients.keys()){
+        dropClient(socket);
+    }
+
+    disconnect(bluetooth, SIGNAL(dataReceived(QByteArray)), this, SLOT(handleData(QByteArray)));
+
+    delete localServer;
+    localServer = nullptr;
+    delete tcpServer;
+    tcpServer = nullptr;
+}
+
+bool FanoutServer::isRunning()
+{
+    return localServer || tcpServer;
+}
+
+QString FanoutServer::getLocalName()
+{
+    return localServer ? localServer->fullServerName() : QString();
+}
+
+quint16 FanoutServer::getTcpPort()
+{
+    return tcpServer ? tcpServer->serverPort() : 0;
+}
+
+int FanoutServer::getClientCount()
+{
+    return clients.size();
+}
+
+void FanoutServer::setLagPolicy(FanoutServer::LagPolicy policy)
+{
+    this->lagPolicy = policy;
+}
+
+//Rounded up to a power of two. Resizing discards the buffered data.
+void FanoutServer::setRingSize(int bytes)
+{
+    int size = 1024;
+    while(size < bytes && size < (1 << 30)){
+        size <<= 1;
+    }
+
+    ring = QByteArray(size, '\0');
+    ringMask = size - 1;
+
+    for(Client &client : clients){
+        client.cursor = writePosition;
+    }
+}
+
+void FanoutServer::addClient(QIODevice *socket)
+{
+    //Clients get the stream from the moment they connect
+    Client client;
+    client.cursor = writePosition;
+    clients.insert(socket, client);
+
+    connect(socket, SIGNAL(readyRead()), this, SLOT(handleClientReadyRead()));
+    connect(socket, SIGNAL(bytesWritten(qint64)), this, SLOT(handleClientBytesWritten(qint64)));
+    connect(socket, SIGNAL(disconnected()), this, SLOT(handleClientDisconnected()));
+
+    qDebug() << "FanoutServer: client connected," << clients.size() << "client(s)";
+    emit clientCountChanged(clients.size());
+}
+
+void FanoutServer::dropClient(QIODevice *socket)
+{
+    if(!clients.contains(socket)){
+        return;
+    }
+
+    Client client = clients.take(socket);
+    if(client.lostBytes > 0){
+        qDebug() << "FanoutServer: client lost" << client.lostBytes << "bytes while lagging";
+    }
+
+    disconnect(socket, nullptr, this, nullptr);
+    socket->close();
+    socket->deleteLater();
+
+    qDebug() << "FanoutServer: client disconnected," << clients.size() << "client(s)";
+    emit clientCountChanged(clients.size());
+}
+
+//Send a client as much of the ring as its socket will take without queueing more than MAX_PENDING_BYTES
+void FanoutServer::pump(QIODevice *socket)
+{
+    QHash<QIODevice *, Client>::iterator it = clients.find(socket);
+    if(it == clients.end()){
+        return;
+    }
+
+    Client &client = it.value();
+    const qint64 ringSize = ring.size();
+
+    if(writePosition - client.cursor > ringSize){
+        if(lagPolicy == DropClient){
+            dropClient(socket);
+            return;
+        }
+
+        qint64 oldest = writePosition - ringSize;
+        client.lostBytes += oldest - client.cursor;
+        client.cursor = oldest;
+    }
+
+    while(client.cursor < writePosition && socket->bytesToWrite() < MAX_PENDING_BYTES){
+        qint64 start = client.cursor & ringMask;
+        qint64 count = qMin(writePosition - client.cursor, ringSize - start);
+        count = qMin(count, MAX_PENDING_BYTES - socket->bytesToWrite());
+
+        qint64 written = socket->write(ring.constData() + start, count);
+        if(written <= 0){
+            break;
+        }
+        client.cursor += written;
+    }
+}
+
+void FanoutServer::handleData(QByteArray data)
+{
+    const qint64 ringSize = ring.size();
+    const char *bytes = data.constData();
+    qint64 size = data.size();
+
+    //Only the newest ring's worth of an oversized chunk can be kept
+    if(size > ringSize){
+        writePosition += size - ringSize;
+        bytes += size - ringSize;
+        size = ringSize;
+    }
+
+    qint64 start = writePosition & ringMask;
+    qint64 first = qMin(size, ringSize - start);
+    std::memcpy(ring.data() + start, bytes, static_cast<size_t>(first));
+    std::memcpy(ring.data(), bytes + first, static_cast<size_t>(size - first));
+    writePosition += size;
+
+    for(QIODevice *socket : clients.keys()){
+        pump(socket);
+    }
+}
+
+void FanoutServer::handleLocalConnection()
+{
+    while(localServer && localServer->hasPendingConnections()){
+        addClient(localServer->nextPendingConnection());
+    }
+}
+
+void FanoutServer::handleTcpConnection()
+{
+    while(tcpServer && tcpServer->hasPendingConnections()){
+        QTcpSocket *socket = tcpServer->nextPendingConnection();
+        socket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+        addClient(socket);
+    }
+}
+
+//Data from a client goes to the device, in writes the link can carry
+void FanoutServer::handleClientReadyRead()
+{
+    QIODevice *socket = qobject_cast<QIODevice *>(sender());
+    if(!socket){
+        return;
+    }
+
+    QByteArray data = socket->readAll();
+    const int maxWrite = bluetooth->getMaxWriteSize();
+
+    for(int i = 0; i < data.size(); i += maxWrite){
+        bluetooth->write(data.mid(i, maxWrite));
+    }
+}
+
+void FanoutServer::handleClientBytesWritten(qint64)
+{
+    pump(qobject_cast<QIODevice *>(sender()));
+}
+
+void FanoutServer::handleClientDisconnected()
+{
+    dropClient(qobject_cast<QIODevice *>(sender()));
+}
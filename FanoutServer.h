@@ -0,0 +1,83 @@
+#ifndef FANOUTSERVER_H
+#define FANOUTSERVER_H
+
+/*
+ * Receive stream fan-out server
+ *
+ * Republishes everything received from the device to any number of local clients, over a
+ * QLocalServer (named pipe / unix socket) and a TCP socket bound to localhost. Anything a
+ * client sends is written to the device.
+ *
+ * Received data is written once into a ring buffer. Each client only has a cursor into the
+ * ring and is fed from it as its socket drains, with at most MAX_PENDING_BYTES queued in the
+ * socket at a time, so a slow client never holds up the device or the other clients.
+ * A client that falls more than a full ring behind is either disconnected or skipped ahead
+ * to the oldest data still in the ring (counting the bytes it lost), depending on the policy.
+ */
+
+#include "Bluetooth.h"
+
+#include <QObject>
+#include <QHash>
+#include <QIODevice>
+#include <QLocalServer>
+#include <QTcpServer>
+
+class FanoutServer : public QObject
+{
+    Q_OBJECT
+public:
+    explicit FanoutServer(Bluetooth *bluetooth, QObject *parent = nullptr);
+
+    //What to do with a client that has fallen a full ring behind
+    enum LagPolicy{
+        DropClient,
+        SkipAhead,
+    };
+
+    bool start(QString localName, quint16 tcpPort);
+    void stop();
+    bool isRunning();
+
+    QString getLocalName();
+    quint16 getTcpPort();
+    int getClientCount();
+
+    void setLagPolicy(LagPolicy policy);
+    void setRingSize(int bytes);
+
+signals:
+    void clientCountChanged(int clients);
+
+private:
+    struct Client{
+        qint64 cursor       = 0;        //Stream position of the next byte to send
+        qint64 lostBytes    = 0;        //Bytes skipped because the client lagged too far behind
+    };
+
+    static const int MAX_PENDING_BYTES = 64 * 1024;
+
+    Bluetooth *bluetooth        = nullptr;
+    QLocalServer *localServer   = nullptr;
+    QTcpServer *tcpServer       = nullptr;
+    QHash<QIODevice *, Client> clients;
+    LagPolicy lagPolicy         = SkipAhead;
+
+    QByteArray ring;                    //Power of two sized
+    qint64 ringMask             = 0;
+    qint64 writePosition        = 0;    //Total bytes ever written to the ring
+
+    void addClient(QIODevice *socket);
+    void dropClient(QIODevice *socket);
+    void pump(QIODevice *socket);
+
+private slots:
+    void handleData(QByteArray data);
+    void handleLocalConnection();
+    void handleTcpConnection();
+    void handleClientReadyRead();
+    void handleClientBytesWritten(qint64 bytes);
+    void handleClientDisconnected();
+};
+
+#endif // FANOUTSERVER_H
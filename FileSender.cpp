@@ -0,0 +1,378 @@
+#include "FileSender.h"
+#include "FrameDecoder.h"
+
+#include <QDebug>
+#include <cstring>
+
+//XMODEM control characters
+static const char SOH = 0x01;
+static const char EOT = 0x04;
+static const char ACK = 0x06;
+static const char NAK = 0x15;
+static const char CAN = 0x18;
+static const char PAD = 0x1A;
+
+FileSender::FileSender(Bluetooth *bluetooth, QObject *parent) : QObject(parent)
+{
+    this->bluetooth = bluetooth;
+
+    progressTimer = new QTimer(this);
+    progressTimer->setInterval(250);
+    connect(progressTimer, SIGNAL(timeout()), this, SLOT(reportProgress()));
+
+    pacingTimer = new QTimer(this);
+    pacingTimer->setSingleShot(true);
+    connect(pacingTimer, SIGNAL(timeout()), this, SLOT(resumeAfterLine()));
+
+    responseTimer = new QTimer(this);
+    responseTimer->setSingleShot(true);
+    connect(responseTimer, SIGNAL(timeout()), this, SLOT(handleResponseTimeout()));
+}
+
+FileSender::~FileSender()
+{
+    if(data){
+        file.unmap(reinterpret_cast<uchar *>(const_cast<char *>(data)));
+    }
+}
+
+bool FileSender::start(QString path, FileSender::Mode mode)
+{
+    if(running){
+        return false;
+    }
+
+    file.setFileName(path);
+    if(!file.open(QIODevice::ReadOnly)){
+        return false;
+    }
+
+    size = file.size();
+    if(size > 0){
+        uchar *mapping = file.map(0, size);
+        if(!mapping){
+            file.close();
+            return false;
+        }
+        data = reinterpret_cast<const char *>(mapping);
+    }
+
+    this->mode = mode;
+    offset = 0;
+    confirmed = 0;
+    pendingWrites.clear();
+    pausedForLine = false;
+    xmodemStarted = false;
+    xmodemCrc = false;
+    xmodemSentEot = false;
+    xmodemBlockNumber = 1;
+    xmodemRetries = 0;
+
+    connect(bluetooth, SIGNAL(writeFinished(quint64, bool)), this, SLOT(handleWriteFinished(quint64, bool)));
+    connect(bluetooth, SIGNAL(deviceDisconnected()), this, SLOT(handleDisconnect()));
+    if(mode == XMODEM){
+        connect(bluetooth, SIGNAL(dataReceived(QByteArray)), this, SLOT(handleData(QByteArray)));
+    }
+
+    running = true;
+    clock.start();
+    progressTimer->start();
+
+    if(mode == XMODEM){
+        //The receiver starts the transfer by sending NAK (checksum) or 'C' (CRC)
+        responseTimer->start(XMODEM_TIMEOUT_MS);
+    }
+    else{
+        sendChunks();
+    }
+
+    return true;
+}
+
+bool FileSender::isRunning()
+{
+    return this->running;
+}
+
+void FileSender::setWindow(int writes)
+{
+    this->window = qMax(1, writes);
+}
+
+void FileSender::setLineDelay(int msecs)
+{
+    this->lineDelayMs = qMax(0, msecs);
+}
+
+void FileSender::cancel()
+{
+    if(!running){
+        return;
+    }
+
+    if(mode == XMODEM && xmodemStarted){
+        QByteArray abort;
+        abort.append(CAN);
+        abort.append(CAN);
+        send(abort, TxScheduler::CONTROL);
+    }
+
+    stop(false, "Transfer cancelled");
+}
+
+bool FileSender::send(const QByteArray &data, TxScheduler::Priority priority)
+{
+    quint64 id = bluetooth->write(data, priority);
+    if(id == 0){
+        return false;
+    }
+
+    pendingWrites.insert(id, data.size());
+    return true;
+}
+
+//Keep up to 'window' MTU sized writes in flight. The scheduler copies each slice of the mapping.
+void FileSender::sendChunks()
+{
+    if(!running || pausedForLine){
+        return;
+    }
+
+    const qint64 maxWrite = bluetooth->getMaxWriteSize();
+
+    while(pendingWrites.size() < window && offset < size){
+        qint64 chunk = qMin(maxWrite, size - offset);
+        bool lineEnd = false;
+
+        if(mode == LINE_PACED){
+            const void *newline = std::memchr(data + offset, '\n', static_cast<size_t>(chunk));
+            if(newline){
+                chunk = static_cast<const char *>(newline) - (data + offset) + 1;
+                lineEnd = true;
+            }
+        }
+
+        if(!send(QByteArray::fromRawData(data + offset, static_cast<int>(chunk)), TxScheduler::BULK)){
+            stop(false, "Device disconnected");
+            return;
+        }
+        offset += chunk;
+
+        if(lineEnd){
+            pausedForLine = true;
+            break;
+        }
+    }
+
+    if(offset >= size && pendingWrites.isEmpty()){
+        stop(true, QString("Sent %1 bytes").arg(size));
+    }
+}
+
+void FileSender::sendXmodemBlock()
+{
+    QByteArray block;
+    block.reserve(XMODEM_BLOCK + 5);
+    block.append(SOH);
+    block.append(static_cast<char>(xmodemBlockNumber));
+    block.append(static_cast<char>(~xmodemBlockNumber));
+
+    qint64 count = qMin(static_cast<qint64>(XMODEM_BLOCK), size - offset);
+    block.append(data + offset, static_cast<int>(count));
+    block.append(static_cast<int>(XMODEM_BLOCK - count), PAD);
+
+    const char *payload = block.constData() + 3;
+    if(xmodemCrc){
+        //CRC-16/XMODEM is the CCITT polynomial with a zero initial value
+        quint16 crc = LengthPrefixDecoder::crc16(payload, XMODEM_BLOCK, 0);
+        block.append(static_cast<char>(crc >> 8));
+        block.append(static_cast<char>(crc & 0xFF));
+    }
+    else{
+        quint8 sum = 0;
+        for(int i = 0; i < XMODEM_BLOCK; i++){
+            sum += static_cast<quint8>(payload[i]);
+        }
+        block.append(static_cast<char>(sum));
+    }
+
+    //Split the block into writes the link can carry
+    const int maxWrite = bluetooth->getMaxWriteSize();
+    for(int i = 0; i < block.size(); i += maxWrite){
+        send(block.mid(i, maxWrite), TxScheduler::BULK);
+    }
+
+    responseTimer->start(XMODEM_TIMEOUT_MS);
+}
+
+void FileSender::handleWriteFinished(quint64 id, bool written)
+{
+    //Someone else's write
+    if(!pendingWrites.contains(id)){
+        return;
+    }
+    qint64 bytes = pendingWrites.take(id);
+
+    if(!running || mode == XMODEM){
+        return;
+    }
+
+    //The file would arrive with a gap in it
+    if(!written){
+        stop(false, "A write was dropped before the device confirmed it");
+        return;
+    }
+
+    confirmed = qMin(offset, confirmed + bytes);
+
+    if(pausedForLine){
+        if(pendingWrites.isEmpty() && !pacingTimer->isActive()){
+            pacingTimer->start(lineDelayMs);
+        }
+        return;
+    }
+
+    sendChunks();
+}
+
+void FileSender::handleData(QByteArray received)
+{
+    if(!running || mode != XMODEM){
+        return;
+    }
+
+    for(char c : received){
+        if(!xmodemStarted){
+            if(c == NAK || c == 'C'){
+                xmodemStarted = true;
+                xmodemCrc = c == 'C';
+                sendXmodemBlock();
+            }
+            continue;
+        }
+
+        if(c == CAN){
+            stop(false, "Transfer cancelled by the receiver");
+            return;
+        }
+
+        if(c != ACK && c != NAK){
+            continue;
+        }
+
+        responseTimer->stop();
+
+        if(xmodemSentEot){
+            if(c == ACK){
+                stop(true, QString("Sent %1 bytes (XMODEM%2)").arg(size).arg(xmodemCrc ? "-CRC" : ""));
+                return;
+            }
+
+            QByteArray eot(1, EOT);
+            send(eot, TxScheduler::CONTROL);
+            responseTimer->start(XMODEM_TIMEOUT_MS);
+            continue;
+        }
+
+        if(c == ACK){
+            offset = qMin(size, offset + XMODEM_BLOCK);
+            confirmed = offset;
+            xmodemBlockNumber++;
+            xmodemRetries = 0;
+
+            if(offset >= size){
+                xmodemSentEot = true;
+                QByteArray eot(1, EOT);
+                send(eot, TxScheduler::CONTROL);
+                responseTimer->start(XMODEM_TIMEOUT_MS);
+            }
+            else{
+                sendXmodemBlock();
+            }
+        }
+        else if(++xmodemRetries > XMODEM_MAX_RETRIES){
+            stop(false, QString("Block %1 rejected too many times").arg(xmodemBlockNumber));
+            return;
+        }
+        else{
+            sendXmodemBlock();
+        }
+    }
+}
+
+void FileSender::handleResponseTimeout()
+{
+    if(!running){
+        return;
+    }
+
+    if(!xmodemStarted){
+        stop(false, "Receiver did not start the XMODEM transfer");
+    }
+    else if(++xmodemRetries > XMODEM_MAX_RETRIES){
+        stop(false, "Receiver stopped responding");
+    }
+    else if(xmodemSentEot){
+        QByteArray eot(1, EOT);
+        send(eot, TxScheduler::CONTROL);
+        responseTimer->start(XMODEM_TIMEOUT_MS);
+    }
+    else{
+        sendXmodemBlock();
+    }
+}
+
+void FileSender::handleDisconnect()
+{
+    if(running){
+        stop(false, "Device disconnected");
+    }
+}
+
+void FileSender::resumeAfterLine()
+{
+    pausedForLine = false;
+    sendChunks();
+}
+
+void FileSender::reportProgress()
+{
+    qint64 elapsed = clock.elapsed();
+    double bytesPerSecond = elapsed > 0 ? confirmed * 1000.0 / elapsed : 0;
+    qint64 eta = bytesPerSecond > 0 ? static_cast<qint64>((size - confirmed) * 1000.0 / bytesPerSecond) : -1;
+
+    emit progress(confirmed, size, bytesPerSecond, eta);
+}
+
+void FileSender::stop(bool success, QString message)
+{
+    if(!running){
+        return;
+    }
+
+    reportProgress();
+
+    running = false;
+    progressTimer->stop();
+    pacingTimer->stop();
+    responseTimer->stop();
+
+    //Queued writes hold their own copies, the mapping can go right away
+    cleanup();
+
+    qDebug() << "FileSender:" << message;
+    emit finished(success, message);
+}
+
+void FileSender::cleanup()
+{
+    disconnect(bluetooth, nullptr, this, nullptr);
+
+    if(data){
+        file.unmap(reinterpret_cast<uchar *>(const_cast<char *>(data)));
+        data = nullptr;
+    }
+    file.close();
+
+    pendingWrites.clear();
+}
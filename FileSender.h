@@ -0,0 +1,103 @@
+#ifndef FILESENDER_H
+#define FILESENDER_H
+
+/*
+ * Bulk file transfer
+ *
+ * Streams a file through Bluetooth::write() without loading it into memory: the file is
+ * memory mapped and only the slices in the send window are copied (by TxScheduler) on their
+ * way to the link.
+ *
+ * Modes:
+ *  - RAW:          MTU sized writes, up to 'window' of them in flight at once
+ *  - LINE_PACED:   as RAW, but waits 'lineDelay' ms after every line for slow line parsers
+ *  - XMODEM:       128 byte XMODEM blocks (checksum or CRC, as requested by the receiver),
+ *                  each block waits for the receiver's ACK and is resent on NAK
+ *
+ * Progress (bytes confirmed, throughput and estimated time left) is reported while sending.
+ * Only confirmations of the sender's own writes count, matched by the id Bluetooth::write()
+ * returns, so other traffic on the link does not advance the transfer. A RAW or LINE_PACED
+ * write that was dropped fails the transfer; XMODEM resends the block when no ACK comes.
+ */
+
+#include "Bluetooth.h"
+
+#include <QObject>
+#include <QFile>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QHash>
+
+class FileSender : public QObject
+{
+    Q_OBJECT
+public:
+    explicit FileSender(Bluetooth *bluetooth, QObject *parent = nullptr);
+    ~FileSender();
+
+    enum Mode{
+        RAW,
+        LINE_PACED,
+        XMODEM,
+    };
+
+    bool start(QString path, Mode mode);
+    bool isRunning();
+
+    void setWindow(int writes);
+    void setLineDelay(int msecs);
+
+signals:
+    void progress(qint64 sent, qint64 total, double bytesPerSecond, qint64 etaMs);
+    void finished(bool success, QString message);
+
+public slots:
+    void cancel();
+
+private:
+    Bluetooth *bluetooth        = nullptr;
+    QFile file;
+    const char *data            = nullptr;
+    qint64 size                 = 0;
+    Mode mode                   = RAW;
+    bool running                = false;
+
+    int window                  = 4;
+    int lineDelayMs             = 20;
+
+    qint64 offset               = 0;    //Next byte to send
+    qint64 confirmed            = 0;    //Bytes the link confirmed as written
+    QHash<quint64, qint64> pendingWrites;   //Write id to size, until the link confirms it
+    bool pausedForLine          = false;
+
+    //XMODEM state
+    static const int XMODEM_BLOCK = 128;
+    static const int XMODEM_MAX_RETRIES = 10;
+    static const int XMODEM_TIMEOUT_MS = 10000;
+    bool xmodemStarted          = false;
+    bool xmodemCrc              = false;
+    bool xmodemSentEot          = false;
+    quint8 xmodemBlockNumber    = 1;
+    int xmodemRetries           = 0;
+
+    QElapsedTimer clock;
+    QTimer *progressTimer       = nullptr;
+    QTimer *pacingTimer         = nullptr;
+    QTimer *responseTimer       = nullptr;
+
+    bool send(const QByteArray &data, TxScheduler::Priority priority);
+    void sendChunks();
+    void sendXmodemBlock();
+    void stop(bool success, QString message);
+    void cleanup();
+
+private slots:
+    void handleWriteFinished(quint64 id, bool written);
+    void handleData(QByteArray data);
+    void handleDisconnect();
+    void resumeAfterLine();
+    void handleResponseTimeout();
+    void reportProgress();
+};
+
+#endif // FILESENDER_H
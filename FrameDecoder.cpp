@@ -0,0 +1,418 @@
+#include "FrameDecoder.h"
+
+#include <QDateTime>
+
+#include <array>
+#include <cstring>
+
+FrameDecoder::FrameDecoder(QObject *parent) : QObject(parent)
+{
+    frameBuffer.resize(maxFrameSize);
+}
+
+FrameDecoder::~FrameDecoder()
+{
+
+}
+
+void FrameDecoder::feed(const char *data, int size)
+{
+    statistics.bytes += size;
+    decode(data, size);
+}
+
+void FrameDecoder::feed(const QByteArray &data)
+{
+    feed(data.constData(), data.size());
+}
+
+void FrameDecoder::reset()
+{
+    frameLength = 0;
+    resetState();
+}
+
+void FrameDecoder::setMaxFrameSize(int size)
+{
+    this->maxFrameSize = size;
+    frameBuffer.resize(size);
+    reset();
+}
+
+int FrameDecoder::getMaxFrameSize()
+{
+    return this->maxFrameSize;
+}
+
+FrameDecoder::Statistics FrameDecoder::getStatistics()
+{
+    return this->statistics;
+}
+
+void FrameDecoder::clearStatistics()
+{
+    this->statistics = Statistics();
+}
+
+//Returns false (and counts a framing error) if the frame does not fit
+inline bool FrameDecoder::appendByte(char c)
+{
+    if(frameLength >= maxFrameSize){
+        framingError();
+        return false;
+    }
+
+    frameBuffer.data()[frameLength++] = c;
+    return true;
+}
+
+void FrameDecoder::emitFrame(const char *data, int size)
+{
+    statistics.frames++;
+    emit frameDecoded(QByteArray::fromRawData(data, size), QDateTime::currentMSecsSinceEpoch());
+}
+
+void FrameDecoder::framingError()
+{
+    statistics.framingErrors++;
+    frameLength = 0;
+}
+
+void FrameDecoder::crcError()
+{
+    statistics.crcErrors++;
+    frameLength = 0;
+}
+
+/*
+ * SLIP
+ */
+
+SlipDecoder::SlipDecoder(QObject *parent) : FrameDecoder(parent)
+{
+
+}
+
+QString SlipDecoder::getName() const
+{
+    return "SLIP";
+}
+
+QByteArray SlipDecoder::encode(const QByteArray &payload) const
+{
+    QByteArray frame;
+    frame.reserve(payload.size() * 2 + 2);
+
+    frame.append(END);  //Leading END flushes any line noise at the receiver
+    for(char c : payload){
+        if(c == END){
+            frame.append(ESC);
+            frame.append(ESC_END);
+        }
+        else if(c == ESC){
+            frame.append(ESC);
+            frame.append(ESC_ESC);
+        }
+        else{
+            frame.append(c);
+        }
+    }
+    frame.append(END);
+
+    return frame;
+}
+
+void SlipDecoder::decode(const char *data, int size)
+{
+    for(int i = 0; i < size; i++){
+        char c = data[i];
+
+        if(c == END){
+            if(!discarding && !escaped && frameLength > 0){
+                emitFrame(frameBuffer.constData(), frameLength);
+            }
+            else if(escaped){
+                framingError();
+            }
+
+            frameLength = 0;
+            escaped = false;
+            discarding = false;
+            continue;
+        }
+
+        if(discarding){
+            continue;
+        }
+
+        if(escaped){
+            escaped = false;
+
+            if(c == ESC_END){
+                c = END;
+            }
+            else if(c == ESC_ESC){
+                c = ESC;
+            }
+            else{
+                framingError();
+                discarding = true;
+                continue;
+            }
+        }
+        else if(c == ESC){
+            escaped = true;
+            continue;
+        }
+
+        if(!appendByte(c)){
+            discarding = true;
+        }
+    }
+}
+
+void SlipDecoder::resetState()
+{
+    escaped = false;
+    discarding = false;
+}
+
+/*
+ * COBS
+ */
+
+CobsDecoder::CobsDecoder(QObject *parent) : FrameDecoder(parent)
+{
+
+}
+
+QString CobsDecoder::getName() const
+{
+    return "COBS";
+}
+
+QByteArray CobsDecoder::encode(const QByteArray &payload) const
+{
+    QByteArray frame;
+    frame.reserve(payload.size() + payload.size() / 254 + 2);
+
+    int codeIndex = frame.size();
+    frame.append('\0');     //Placeholder for the first code byte
+    uchar code = 1;
+
+    for(char c : payload){
+        if(c == '\0'){
+            frame[codeIndex] = static_cast<char>(code);
+            codeIndex = frame.size();
+            frame.append('\0');
+            code = 1;
+        }
+        else{
+            frame.append(c);
+            code++;
+
+            if(code == 0xFF){
+                frame[codeIndex] = static_cast<char>(code);
+                codeIndex = frame.size();
+                frame.append('\0');
+                code = 1;
+            }
+        }
+    }
+
+    frame[codeIndex] = static_cast<char>(code);
+    frame.append('\0');     //Frame delimiter
+
+    return frame;
+}
+
+void CobsDecoder::decode(const char *data, int size)
+{
+    for(int i = 0; i < size; i++){
+        uchar b = static_cast<uchar>(data[i]);
+
+        if(b == 0){
+            //Delimiter. A block still expecting data means the frame was cut short.
+            if(!discarding && inFrame){
+                if(remaining != 0){
+                    framingError();
+                }
+                else{
+                    emitFrame(frameBuffer.constData(), frameLength);
+                }
+            }
+
+            frameLength = 0;
+            remaining = 0;
+            inFrame = false;
+            discarding = false;
+            continue;
+        }
+
+        if(discarding){
+            continue;
+        }
+
+        if(remaining == 0){
+            //Code byte. The zero implied by the previous block is only added now that we know another block follows.
+            if(inFrame && blockCode != 0xFF && !appendByte('\0')){
+                discarding = true;
+                continue;
+            }
+
+            blockCode = b;
+            remaining = b - 1;
+            inFrame = true;
+        }
+        else{
+            if(!appendByte(static_cast<char>(b))){
+                discarding = true;
+                continue;
+            }
+            remaining--;
+        }
+    }
+}
+
+void CobsDecoder::resetState()
+{
+    remaining = 0;
+    blockCode = 0;
+    inFrame = false;
+    discarding = false;
+}
+
+/*
+ * Length prefix + CRC-16
+ */
+
+LengthPrefixDecoder::LengthPrefixDecoder(QObject *parent) : FrameDecoder(parent)
+{
+
+}
+
+QString LengthPrefixDecoder::getName() const
+{
+    return "Length + CRC16";
+}
+
+QByteArray LengthPrefixDecoder::encode(const QByteArray &payload) const
+{
+    quint16 crc = crc16(payload.constData(), payload.size());
+
+    QByteArray frame;
+    frame.reserve(payload.size() + 4);
+    frame.append(static_cast<char>((payload.size() >> 8) & 0xFF));
+    frame.append(static_cast<char>(payload.size() & 0xFF));
+    frame.append(payload);
+    frame.append(static_cast<char>(crc >> 8));
+    frame.append(static_cast<char>(crc & 0xFF));
+
+    return frame;
+}
+
+//CRC-16/CCITT-FALSE (polynomial 0x1021, initial value 0xFFFF)
+quint16 LengthPrefixDecoder::crc16(const char *data, int size, quint16 crc)
+{
+    //Built once, thread safe (C++11 static initialization). Also used by XMODEM (see FileSender).
+    static const std::array<quint16, 256> table = []{
+        std::array<quint16, 256> entries;
+        for(int i = 0; i < 256; i++){
+            quint16 value = static_cast<quint16>(i << 8);
+            for(int bit = 0; bit < 8; bit++){
+                value = (value & 0x8000) ? static_cast<quint16>((value << 1) ^ 0x1021) : static_cast<quint16>(value << 1);
+            }
+            entries[i] = value;
+        }
+        return entries;
+    }();
+
+    for(int i = 0; i < size; i++){
+        crc = static_cast<quint16>((crc << 8) ^ table[((crc >> 8) ^ static_cast<uchar>(data[i])) & 0xFF]);
+    }
+
+    return crc;
+}
+
+void LengthPrefixDecoder::decode(const char *data, int size)
+{
+    int i = 0;
+
+    while(i < size){
+        //Fast path: a whole frame inside this notification is checked and emitted in place
+        if(state == LENGTH_HIGH && size - i >= 4){
+            int length = (static_cast<uchar>(data[i]) << 8) | static_cast<uchar>(data[i + 1]);
+
+            if(length <= getMaxFrameSize() && size - i >= length + 4){
+                const char *payload = data + i + 2;
+                quint16 crc = static_cast<quint16>((static_cast<uchar>(payload[length]) << 8) | static_cast<uchar>(payload[length + 1]));
+
+                if(crc16(payload, length) == crc){
+                    emitFrame(payload, length);
+                }
+                else{
+                    crcError();
+                }
+
+                i += length + 4;
+                continue;
+            }
+        }
+
+        uchar b = static_cast<uchar>(data[i++]);
+
+        switch(state){
+            case LENGTH_HIGH:
+                payloadLength = b << 8;
+                state = LENGTH_LOW;
+                break;
+            case LENGTH_LOW:
+                payloadLength |= b;
+                frameLength = 0;
+                if(payloadLength > getMaxFrameSize()){
+                    //Cannot be a valid frame, resynchronise on the next byte
+                    framingError();
+                    state = LENGTH_HIGH;
+                }
+                else{
+                    state = payloadLength > 0 ? PAYLOAD : CRC_HIGH;
+                }
+                break;
+            case PAYLOAD:
+            {
+                //Copy as much of the payload as this notification holds in one go
+                int count = qMin(payloadLength - frameLength, size - i + 1);
+                std::memcpy(frameBuffer.data() + frameLength, data + i - 1, static_cast<size_t>(count));
+                frameLength += count;
+                i += count - 1;
+
+                if(frameLength == payloadLength){
+                    state = CRC_HIGH;
+                }
+                break;
+            }
+            case CRC_HIGH:
+                receivedCrc = static_cast<quint16>(b << 8);
+                state = CRC_LOW;
+                break;
+            case CRC_LOW:
+                receivedCrc |= b;
+                if(crc16(frameBuffer.constData(), frameLength) == receivedCrc){
+                    emitFrame(frameBuffer.constData(), frameLength);
+                }
+                else{
+                    crcError();
+                }
+                frameLength = 0;
+                state = LENGTH_HIGH;
+                break;
+        }
+    }
+}
+
+void LengthPrefixDecoder::resetState()
+{
+    state = LENGTH_HIGH;
+    payloadLength = 0;
+    receivedCrc = 0;
+}
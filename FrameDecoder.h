@@ -0,0 +1,144 @@
+#ifndef FRAMEDECODER_H
+#define FRAMEDECODER_H
+
+/*
+ * Binary frame decoders
+ *
+ * Incremental decoders for framed binary protocols carried over the UART service.
+ * Raw bytes are fed in as they arrive (one notification at a time) and every complete
+ * frame is emitted with the time it was completed.
+ *
+ * Bytes are decoded straight from the notification into a frame buffer allocated once
+ * (or, when a length-prefixed frame is contained in a single notification, not copied at all).
+ * The emitted QByteArray refers to that storage and is only valid until the slot returns,
+ * so connect with a direct connection and copy the frame if it has to be kept.
+ *
+ * Built in decoders:
+ *  - SLIP (RFC 1055)
+ *  - COBS, frames delimited by 0x00
+ *  - 16 bit big endian length prefix, payload, CRC-16/CCITT-FALSE of the payload (big endian)
+ */
+
+#include <QObject>
+#include <QByteArray>
+#include <QString>
+
+class FrameDecoder : public QObject
+{
+    Q_OBJECT
+public:
+    explicit FrameDecoder(QObject *parent = nullptr);
+    virtual ~FrameDecoder();
+
+    struct Statistics{
+        qint64 frames           = 0;
+        qint64 bytes            = 0;    //Raw bytes fed
+        qint64 framingErrors    = 0;
+        qint64 crcErrors        = 0;
+    };
+
+    virtual QString getName() const = 0;
+    virtual QByteArray encode(const QByteArray &payload) const = 0;
+
+    void feed(const char *data, int size);
+    void feed(const QByteArray &data);
+    void reset();
+
+    void setMaxFrameSize(int size);
+    int getMaxFrameSize();
+    Statistics getStatistics();
+    void clearStatistics();
+
+signals:
+    void frameDecoded(QByteArray frame, qint64 timestamp);
+
+protected:
+    virtual void decode(const char *data, int size) = 0;
+    virtual void resetState() = 0;
+
+    QByteArray frameBuffer;     //Storage for the frame being assembled, never shrinks
+    int frameLength = 0;
+    Statistics statistics;
+
+    inline bool appendByte(char c);
+    void emitFrame(const char *data, int size);
+    void framingError();
+    void crcError();
+
+private:
+    int maxFrameSize = 4096;
+};
+
+class SlipDecoder : public FrameDecoder
+{
+    Q_OBJECT
+public:
+    explicit SlipDecoder(QObject *parent = nullptr);
+
+    QString getName() const override;
+    QByteArray encode(const QByteArray &payload) const override;
+
+protected:
+    void decode(const char *data, int size) override;
+    void resetState() override;
+
+private:
+    static const char END       = static_cast<char>(0xC0);
+    static const char ESC       = static_cast<char>(0xDB);
+    static const char ESC_END   = static_cast<char>(0xDC);
+    static const char ESC_ESC   = static_cast<char>(0xDD);
+
+    bool escaped = false;
+    bool discarding = false;    //Skip bytes until the next END after an error
+};
+
+class CobsDecoder : public FrameDecoder
+{
+    Q_OBJECT
+public:
+    explicit CobsDecoder(QObject *parent = nullptr);
+
+    QString getName() const override;
+    QByteArray encode(const QByteArray &payload) const override;
+
+protected:
+    void decode(const char *data, int size) override;
+    void resetState() override;
+
+private:
+    int remaining = 0;          //Data bytes left in the current block, 0 means a code byte is next
+    int blockCode = 0;
+    bool inFrame = false;
+    bool discarding = false;
+};
+
+class LengthPrefixDecoder : public FrameDecoder
+{
+    Q_OBJECT
+public:
+    explicit LengthPrefixDecoder(QObject *parent = nullptr);
+
+    QString getName() const override;
+    QByteArray encode(const QByteArray &payload) const override;
+
+    static quint16 crc16(const char *data, int size, quint16 crc = 0xFFFF);
+
+protected:
+    void decode(const char *data, int size) override;
+    void resetState() override;
+
+private:
+    enum State{
+        LENGTH_HIGH,
+        LENGTH_LOW,
+        PAYLOAD,
+        CRC_HIGH,
+        CRC_LOW,
+    };
+
+    State state = LENGTH_HIGH;
+    int payloadLength = 0;
+    quint16 receivedCrc = 0;
+};
+
+#endif // FRAMEDECODER_H
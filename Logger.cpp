@@ -1,13 +1,27 @@
 #include "Logger.h"
+#include "DurableLog.h"
 
 #include <QDebug>
 #include <QDir>
 #include <QTextStream>
 #include <QMessageBox>
+#include <QDateTime>
 
 Logger::Logger(QObject *parent) : QObject(parent)
 {
     this->logFile = new QFile();
+
+    //Structured formats split each line into columns before writing
+    telemetryParser = new TelemetryParser(this);
+    exporter = new TelemetryExporter(this);
+    connect(telemetryParser, SIGNAL(rowParsed(qint64, bool, QVector<double>, QList<QByteArray>)),
+            exporter, SLOT(addRow(qint64, bool, QVector<double>, QList<QByteArray>)));
+    connect(telemetryParser, SIGNAL(fieldNamesChanged(QStringList)), exporter, SLOT(setFieldNames(QStringList)));
+    connect(exporter, SIGNAL(dataReady(QByteArray)), this, SLOT(writeToFile(QByteArray)));
+
+    syncTimer = new QTimer(this);
+    syncTimer->setSingleShot(true);
+    connect(syncTimer, SIGNAL(timeout()), this, SLOT(syncToDisk()));
 }
 
 Logger::~Logger()
@@ -37,16 +51,43 @@ bool Logger::isLogging()
 
 void Logger::log(QString text)
 {
-    if(this->logFile->isOpen()){
-        if(this->preserved_logInHexEnabled){
-            QStringList hexVals = convertTextToHex(text);
-            addHexToBuffer(hexVals);
-        }
-        else{
-            this->logText.append(text);
+    log(text.toUtf8(), true);
+}
+
+void Logger::log(QString text, bool incoming)
+{
+    log(text.toUtf8(), incoming);
+}
+
+//Data is logged as the bytes received or sent, it is never decoded on the way to the file
+void Logger::log(QByteArray data, bool incoming)
+{
+    if(!this->logFile->isOpen()){
+        return;
+    }
+
+    //A record longer than DurableLog::MAX_RECORD_SIZE would read back as torn and be cut off,
+    //along with everything after it. Larger writes are split over several records.
+    if(this->preserved_logFormat == DURABLE){
+        qint64 timestamp = QDateTime::currentMSecsSinceEpoch();
+        for(int i = 0; i < data.size(); i += DurableLog::MAX_RECORD_SIZE){
+            writeToFile(DurableLog::encodeRecord(nextSequence++, timestamp, incoming, data.mid(i, DurableLog::MAX_RECORD_SIZE)));
         }
+        return;
+    }
 
-        writeToFile(this->logText);
+    if(this->preserved_logFormat != TEXT){
+        telemetryParser->feed(data, incoming);
+        return;
+    }
+
+    if(this->preserved_logInHexEnabled){
+        QByteArray hex;
+        appendHex(hex, data);
+        writeToFile(hex);
+    }
+    else{
+        writeToFile(data);
     }
 }
 
@@ -73,58 +114,74 @@ bool Logger::promptOverwrite()
     return overwriteFile;
 }
 
-void Logger::writeToFile(QString text)
+//Log files are only ever appended to
+void Logger::writeToFile(const QByteArray &data)
 {
     if(logFile->isOpen()){
-        logFile->resize(0);
-        logFile->write(text.toUtf8());
+        logFile->write(data);
         logFile->flush();
+        commit(data.size());
     }
 }
 
-QStringList Logger::convertTextToHex(QString text)
+//Group commit: rather than syncing every write, bytes accumulate until the group is old or big
+//enough, and one sync makes the whole group durable. A write still waiting when the log goes
+//quiet is synced by the timer, so nothing stays volatile for longer than groupCommitMs.
+void Logger::commit(qint64 bytes)
 {
-    const static std::string asciiLookup = "0123456789ABCDEF";
-    QStringList hexList;
+    unsyncedBytes += bytes;
 
-    for(QChar qc : text){
-        QString hex;
-        char c = qc.toLatin1();
-
-        //Preserve newlines (don't convert to hex)
-        if(c == '\r' || c == '\n'){
-            hex = c;
-        }
-        else{
-            char upper = asciiLookup[(c & 0xF0) >> 4];
-            char lower = asciiLookup[c & 0x0F];
-            hex.append(upper);
-            hex.append(lower);
-        }
+    switch(preserved_durability){
+        case FLUSH_ONLY:
+            break;
+        case SYNC_ALWAYS:
+            syncToDisk();
+            break;
+        case GROUP_COMMIT:
+            if(unsyncedBytes >= groupCommitBytes || sinceSync.elapsed() >= groupCommitMs){
+                syncToDisk();
+            }
+            else if(!syncTimer->isActive()){
+                syncTimer->start(int(qMax<qint64>(0, groupCommitMs - sinceSync.elapsed())));
+            }
+            break;
+    }
+}
 
-        hexList.append(hex);
+void Logger::syncToDisk()
+{
+    syncTimer->stop();
 
+    if(logFile->isOpen() && unsyncedBytes > 0){
+        if(!DurableLog::syncFile(logFile)){
+            qDebug() << "Logger: failed to sync the log file to disk";
+        }
+        unsyncedBytes = 0;
     }
 
-    return hexList;
+    sinceSync.restart();
 }
 
-void Logger::addHexToBuffer(QStringList hex)
+//Append each byte as two hex digits, separated by commas. Newlines are preserved as is.
+void Logger::appendHex(QByteArray &out, const QByteArray &data)
 {
-    //Append each hex character to the buffer
-    //If the character is a newline, append it as is
-    //If the character is not a newline, append it as is, but add a comma before it if there is data on the same line
+    const static char hexLookup[] = "0123456789ABCDEF";
 
-    for(QString val : hex){
-        if(val == "\r" || val == "\n"){
-            logText.append(val);
+    out.reserve(out.size() + data.size() * 3);
+
+    for(char c : data){
+        if(c == '\r' || c == '\n'){
+            out.append(c);
+            hexLineStart = true;
         }
         else{
-            if(!logText.endsWith("\r") && !logText.endsWith("\n") && !logText.isEmpty()){
-                logText.append(',');
+            if(!hexLineStart){
+                out.append(',');
             }
 
-            logText.append(val);
+            out.append(hexLookup[(c & 0xF0) >> 4]);
+            out.append(hexLookup[c & 0x0F]);
+            hexLineStart = false;
         }
     }
 }
@@ -132,6 +189,8 @@ void Logger::addHexToBuffer(QStringList hex)
 void Logger::preserveStates()
 {
     this->preserved_logInHexEnabled         = logInHexEnabled;
+    this->preserved_logFormat               = logFormat;
+    this->preserved_durability              = durability;
 }
 
 void Logger::logInHex(bool enabled)
@@ -144,6 +203,32 @@ bool Logger::isHexLoggingEnabled()
     return logInHexEnabled;
 }
 
+void Logger::setLogFormat(Logger::LogFormat format)
+{
+    this->logFormat = format;
+}
+
+Logger::LogFormat Logger::getLogFormat()
+{
+    return this->logFormat;
+}
+
+void Logger::setDurability(Logger::Durability durability)
+{
+    this->durability = durability;
+}
+
+Logger::Durability Logger::getDurability()
+{
+    return this->durability;
+}
+
+void Logger::setGroupCommit(int intervalMs, qint64 bytes)
+{
+    this->groupCommitMs = qMax(1, intervalMs);
+    this->groupCommitBytes = qMax<qint64>(1, bytes);
+}
+
 void Logger::promptWhenOverwriting(bool enabled)
 {
     this->promptWhenOverwritingEnabled = enabled;
@@ -161,6 +246,12 @@ void Logger::startLogging()
     //Attempt to open the log file
     logFile->setFileName(this->logFilePath);
 
+    //Durable logs are never overwritten, a new session appends to the records already there
+    if(logFormat == DURABLE){
+        startDurableLogging();
+        return;
+    }
+
     //Prompt for an overwrite if applicable
     bool overwriteFile = false;
     if(promptWhenOverwritingEnabled){
@@ -177,22 +268,66 @@ void Logger::startLogging()
     }
 
     if(overwriteFile){
-        logFile->open(QIODevice::WriteOnly | QIODevice::Truncate);
+        //A CSV header may have to be rewritten once the log is complete, see TelemetryExporter
+        QIODevice::OpenMode mode = logFormat == CSV ? QIODevice::ReadWrite : QIODevice::WriteOnly;
+        logFile->open(mode | QIODevice::Truncate);
 
         if(logFile->isOpen()){
             qDebug() << "Logger: Logging started.";
             this->logging = true;
-            this->logText.clear();
+            this->hexLineStart = true;
+            this->unsyncedBytes = 0;
+            this->sinceSync.start();
             this->preserveStates();
+
+            if(preserved_logFormat != TEXT){
+                telemetryParser->reset();
+                exporter->start(logFile, preserved_logFormat == CSV ? TelemetryExporter::CSV : TelemetryExporter::COLUMNAR);
+            }
+
             emit loggingStarted();
         }
     }
 }
 
+void Logger::startDurableLogging()
+{
+    logFile->open(QIODevice::ReadWrite | QIODevice::Append);
+    if(!logFile->isOpen()){
+        return;
+    }
+
+    DurableLog::ScanResult existing;
+    nextSequence = DurableLog::prepareForAppend(logFile, &existing);
+    if(nextSequence == 0){
+        qDebug() << "Logger:" << logFilePath << "is not a durable log, not appending to it.";
+        logFile->close();
+        return;
+    }
+
+    if(existing.records > 0){
+        qDebug() << "Logger: appending to" << existing.records << "existing records," << existing.fileSize - existing.validBytes << "bytes of incomplete records discarded.";
+    }
+
+    qDebug() << "Logger: Logging started.";
+    this->logging = true;
+    this->unsyncedBytes = 0;
+    this->sinceSync.start();
+    this->preserveStates();
+
+    emit loggingStarted();
+}
+
 void Logger::stopLogging()
 {
     if(logFile->isOpen()){
         qDebug() << "Logger: Logging stopped.";
+        exporter->finish();
+        syncTimer->stop();
+        if(preserved_durability != FLUSH_ONLY){
+            DurableLog::syncFile(logFile);      //Also covers a rewritten CSV header
+        }
+        unsyncedBytes = 0;
         logFile->close();
         this->logging = false;
     }
@@ -3,6 +3,11 @@
 
 #include <QObject>
 #include <QFile>
+#include <QTimer>
+#include <QElapsedTimer>
+
+#include "TelemetryParser.h"
+#include "TelemetryExporter.h"
 
 class Logger : public QObject
 {
@@ -21,6 +26,28 @@ public:
 
     void promptWhenOverwriting(bool enabled);
 
+    enum LogFormat{
+        TEXT,           //Raw text (or hex, see logInHex)
+        CSV,            //Lines split into timestamp, direction and field columns
+        COLUMNAR,       //Same columns in the columnar binary format
+        DURABLE,        //Append only checksummed records that survive a crash (see DurableLog)
+    };
+
+    void setLogFormat(LogFormat format);
+    LogFormat getLogFormat();
+
+    //When written data is forced onto the disk (fsync). Data is always flushed to the OS after
+    //each write, which survives the application crashing but not the machine losing power.
+    enum Durability{
+        FLUSH_ONLY,     //Leave it to the OS
+        GROUP_COMMIT,   //Sync once groupCommitMs have passed or groupCommitBytes are waiting, whichever is first
+        SYNC_ALWAYS,    //Sync after every write
+    };
+
+    void setDurability(Durability durability);
+    Durability getDurability();
+    void setGroupCommit(int intervalMs, qint64 bytes);
+
 signals:
     void loggingStarted();
     void loggingStopped();
@@ -29,6 +56,8 @@ public slots:
     void startLogging();
     void stopLogging();
     void log(QString text);
+    void log(QString text, bool incoming);
+    void log(QByteArray data, bool incoming);
 
 private:
     bool logging                        = false;
@@ -36,17 +65,35 @@ private:
     bool promptWhenOverwritingEnabled   = false;
     QString logFilePath                 = "C:\\BluetoothLogs\\log.txt";   //Default log file path
     QFile *logFile                      = nullptr;
-    QString logText;    //Log file buffer
+    bool hexLineStart                   = true;     //No hex value written on the current line yet
+    LogFormat logFormat                 = TEXT;
+    Durability durability               = FLUSH_ONLY;
+    int groupCommitMs                   = 1000;
+    qint64 groupCommitBytes             = 64 * 1024;
+
+    quint64 nextSequence                = 1;        //Of the next durable record
+    qint64 unsyncedBytes                = 0;
+    QElapsedTimer sinceSync;
+    QTimer *syncTimer                   = nullptr;  //Commits a group that stopped growing
+
+    TelemetryParser *telemetryParser    = nullptr;
+    TelemetryExporter *exporter         = nullptr;
 
     bool promptOverwrite();
-    void writeToFile(QString text);
-    QStringList convertTextToHex(QString text);
-    void addHexToBuffer(QStringList hex);
+    void startDurableLogging();
+    void appendHex(QByteArray &out, const QByteArray &data);
+    void commit(qint64 bytes);
 
     //Preserved states.
     //This lets the user change states without interrupting the current logging process
     bool preserved_logInHexEnabled          = false;
+    LogFormat preserved_logFormat           = TEXT;
+    Durability preserved_durability         = FLUSH_ONLY;
     void preserveStates();
+
+private slots:
+    void writeToFile(const QByteArray &data);
+    void syncToDisk();
 };
 
 #endif // LOGGER_H
@@ -0,0 +1,350 @@
+#include "MacroEngine.h"
+#include "TriggerEngine.h"
+
+#include <QDebug>
+#include <QStringList>
+#include <algorithm>
+#include <cctype>
+
+MacroEngine::MacroEngine(Bluetooth *bluetooth, QObject *parent) : QObject(parent)
+{
+    this->bluetooth = bluetooth;
+
+    stepTimer = new QTimer(this);
+    stepTimer->setSingleShot(true);
+    stepTimer->setTimerType(Qt::PreciseTimer);
+    connect(stepTimer, SIGNAL(timeout()), this, SLOT(handleStepTimeout()));
+
+    expectTimer = new QTimer(this);
+    expectTimer->setSingleShot(true);
+    connect(expectTimer, SIGNAL(timeout()), this, SLOT(handleExpectTimeout()));
+}
+
+bool MacroEngine::compile(QString source, QString *error)
+{
+    QVector<Step> compiled;
+
+    //Compile everything first so a bad macro leaves the current one untouched
+    QStringList lines = source.split('\n');
+    for(int i = 0; i < lines.size(); i++){
+        QString line = lines.at(i).trimmed();
+        if(line.isEmpty() || line.startsWith('#')){
+            continue;
+        }
+
+        QString command = line.section(' ', 0, 0).toLower();
+        QString argument = line.section(' ', 1).trimmed();
+        QString problem;
+        Step step;
+        step.line = i + 1;
+
+        if(command == "send" || command == "hex"){
+            step.type = Send;
+
+            if(command == "send"){
+                step.payload = TriggerEngine::unescape(argument);
+            }
+            else{
+                QByteArray digits = argument.remove(' ').toLatin1();
+                bool valid = digits.size() % 2 == 0;
+                for(char c : digits){
+                    valid = valid && std::isxdigit(static_cast<unsigned char>(c));
+                }
+
+                if(valid){
+                    step.payload = QByteArray::fromHex(digits);
+                }
+                else{
+                    problem = QString("invalid hex bytes '%1'").arg(argument);
+                }
+            }
+
+            if(problem.isEmpty() && step.payload.isEmpty()){
+                problem = "nothing to send";
+            }
+        }
+        else if(command == "delay"){
+            bool ok = false;
+            step.type = Delay;
+            step.ms = argument.toInt(&ok);
+            if(!ok || step.ms < 0){
+                problem = QString("invalid delay '%1'").arg(argument);
+            }
+        }
+        else if(command == "expect"){
+            QStringList tokens = argument.split(QRegularExpression("\\s+"), QString::SkipEmptyParts);
+            bool ok = true;
+            step.type = Expect;
+            step.ms = DEFAULT_EXPECT_TIMEOUT_MS;
+
+            if(tokens.size() < 2 || tokens.size() > 3){
+                problem = "expected 'expect <literal|regex> <pattern> [timeout ms]'";
+            }
+            else if(tokens.at(0) != "literal" && tokens.at(0) != "regex"){
+                problem = QString("unknown pattern type '%1'").arg(tokens.at(0));
+            }
+            else if(tokens.size() == 3 && ((step.ms = tokens.at(2).toInt(&ok)) <= 0 || !ok)){
+                problem = QString("invalid timeout '%1'").arg(tokens.at(2));
+            }
+            else if(tokens.at(0) == "regex"){
+                step.isRegex = true;
+                step.regex = QRegularExpression(tokens.at(1));
+                if(!step.regex.isValid()){
+                    problem = QString("invalid regex '%1'").arg(tokens.at(1));
+                }
+                step.regex.optimize();
+            }
+            else{
+                step.payload = TriggerEngine::unescape(tokens.at(1));
+                if(step.payload.isEmpty()){
+                    problem = "empty pattern";
+                }
+            }
+        }
+        else{
+            problem = QString("unknown command '%1'").arg(command);
+        }
+
+        if(!problem.isEmpty()){
+            if(error){
+                *error = QString("Line %1: %2").arg(i + 1).arg(problem);
+            }
+            return false;
+        }
+
+        //Back to back sends go out as one write
+        if(step.type == Send && !compiled.isEmpty() && compiled.last().type == Send){
+            compiled.last().payload.append(step.payload);
+        }
+        else{
+            compiled.append(step);
+        }
+    }
+
+    if(running){
+        stop();
+    }
+
+    this->source = source;
+    this->steps = compiled;
+
+    return true;
+}
+
+QString MacroEngine::getSource()
+{
+    return this->source;
+}
+
+int MacroEngine::getStepCount()
+{
+    return this->steps.size();
+}
+
+bool MacroEngine::isRunning()
+{
+    return this->running;
+}
+
+void MacroEngine::start(int runs)
+{
+    if(running || steps.isEmpty()){
+        return;
+    }
+
+    this->runs = qMax(1, runs);
+    run = 0;
+    stepIndex = 0;
+    writes = 0;
+    bytesSent = 0;
+    jitterMs.clear();
+    responseMs.clear();
+    received.clear();
+    waiting = false;
+    scheduled = false;
+
+    connect(bluetooth, SIGNAL(dataReceived(QByteArray)), this, SLOT(handleData(QByteArray)));
+
+    running = true;
+    clock.start();
+    deadlineNs = 0;
+
+    qDebug() << "MacroEngine: started," << steps.size() << "steps," << this->runs << "runs";
+    runSteps();
+}
+
+void MacroEngine::stop()
+{
+    if(running){
+        finish(false, "Stopped");
+    }
+}
+
+//Executes steps until the macro has to wait for a delay or a response
+void MacroEngine::runSteps()
+{
+    while(running){
+        if(stepIndex >= steps.size()){
+            if(++run >= runs){
+                finish(true, "Completed");
+                return;
+            }
+            stepIndex = 0;
+        }
+
+        const Step &step = steps.at(stepIndex);
+        emit stepStarted(run, step.line);
+
+        switch(step.type){
+            case Send:
+                if(scheduled){
+                    jitterMs.append((clock.nsecsElapsed() - deadlineNs) / 1000000.0);
+                    scheduled = false;
+                }
+                received.clear();
+                lastSendNs = clock.nsecsElapsed();
+                bluetooth->write(step.payload);
+                writes++;
+                bytesSent += step.payload.size();
+                stepIndex++;
+                break;
+
+            case Delay:{
+                //Deadlines accumulate from the previous deadline rather than from now
+                deadlineNs = qMax(deadlineNs + static_cast<qint64>(step.ms) * 1000000, clock.nsecsElapsed());
+                scheduled = true;
+                stepIndex++;
+
+                qint64 remainingNs = deadlineNs - clock.nsecsElapsed();
+                if(remainingNs > 0){
+                    stepTimer->start(static_cast<int>((remainingNs + 999999) / 1000000));
+                    return;
+                }
+                break;
+            }
+
+            case Expect:
+                waiting = true;
+                if(checkExpect()){
+                    break;
+                }
+                expectTimer->start(step.ms);
+                return;
+        }
+    }
+}
+
+bool MacroEngine::checkExpect()
+{
+    const Step &step = steps.at(stepIndex);
+
+    bool matched;
+    if(step.isRegex){
+        matched = step.regex.match(QString::fromLatin1(received)).hasMatch();
+    }
+    else{
+        matched = received.contains(step.payload);
+    }
+
+    if(!matched){
+        return false;
+    }
+
+    expectTimer->stop();
+    waiting = false;
+    stepIndex++;
+
+    //Delays after a response are measured from when it arrived
+    qint64 now = clock.nsecsElapsed();
+    responseMs.append((now - lastSendNs) / 1000000.0);
+    deadlineNs = now;
+    received.clear();
+
+    return true;
+}
+
+void MacroEngine::handleData(QByteArray data)
+{
+    if(!running){
+        return;
+    }
+
+    received.append(data);
+    if(received.size() > MAX_EXPECT_BUFFER){
+        received.remove(0, received.size() - MAX_EXPECT_BUFFER);
+    }
+
+    if(waiting && checkExpect()){
+        runSteps();
+    }
+}
+
+void MacroEngine::handleStepTimeout()
+{
+    //Precise timers have millisecond resolution, finish the wait if it fired early
+    qint64 remainingNs = deadlineNs - clock.nsecsElapsed();
+    if(remainingNs > 1000000){
+        stepTimer->start(static_cast<int>(remainingNs / 1000000));
+        return;
+    }
+
+    runSteps();
+}
+
+void MacroEngine::handleExpectTimeout()
+{
+    if(!running || !waiting){
+        return;
+    }
+
+    const Step &step = steps.at(stepIndex);
+    finish(false, QString("Line %1: no response within %2 ms").arg(step.line).arg(step.ms));
+}
+
+void MacroEngine::finish(bool success, QString message)
+{
+    running = false;
+    waiting = false;
+    stepTimer->stop();
+    expectTimer->stop();
+    disconnect(bluetooth, SIGNAL(dataReceived(QByteArray)), this, SLOT(handleData(QByteArray)));
+
+    qDebug() << "MacroEngine:" << message;
+    emit finished(success, buildReport(message));
+}
+
+QString MacroEngine::buildReport(QString message)
+{
+    QString str = message + "\n";
+    str += QString("Runs completed: %1 of %2, duration: %3 ms\n").arg(run).arg(runs).arg(clock.elapsed());
+    str += QString("Writes: %1, bytes sent: %2\n").arg(writes).arg(bytesSent);
+
+    if(!responseMs.isEmpty()){
+        std::sort(responseMs.begin(), responseMs.end());
+        double total = 0;
+        for(double ms : responseMs){
+            total += ms;
+        }
+        str += QString("Responses: %1, min/mean/max: %2/%3/%4 ms\n")
+                .arg(responseMs.size())
+                .arg(responseMs.first(), 0, 'f', 2)
+                .arg(total / responseMs.size(), 0, 'f', 2)
+                .arg(responseMs.last(), 0, 'f', 2);
+    }
+
+    if(!jitterMs.isEmpty()){
+        std::sort(jitterMs.begin(), jitterMs.end());
+        double total = 0;
+        for(double ms : jitterMs){
+            total += ms;
+        }
+        int p99 = qBound(0, static_cast<int>(0.99 * (jitterMs.size() - 1) + 0.5), jitterMs.size() - 1);
+        str += QString("Send timing jitter min/mean/p99/max: %1/%2/%3/%4 ms")
+                .arg(jitterMs.first(), 0, 'f', 3)
+                .arg(total / jitterMs.size(), 0, 'f', 3)
+                .arg(jitterMs.at(p99), 0, 'f', 3)
+                .arg(jitterMs.last(), 0, 'f', 3);
+    }
+
+    return str.trimmed();
+}
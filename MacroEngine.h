@@ -0,0 +1,106 @@
+#ifndef MACROENGINE_H
+#define MACROENGINE_H
+
+/*
+ * Macro engine
+ *
+ * Runs scripted command sequences against the device. A macro is compiled once: every send
+ * step becomes a ready to write byte buffer, so running it only walks a list of steps.
+ *
+ * Macro syntax, one step per line:
+ *
+ *      send <text>                                 Text up to the end of the line. Escapes: \s \t \r \n \\ \xHH
+ *      hex <bytes>                                 Hex bytes, optionally separated by spaces (01 02 FF or 0102FF)
+ *      delay <ms>                                  Wait before the next step
+ *      expect <literal|regex> <pattern> [ms]       Wait until the pattern is received (default timeout 2000 ms)
+ *
+ * Lines starting with # are comments. Consecutive send and hex steps are merged into a single write.
+ *
+ * Delays are scheduled against absolute deadlines on a precise timer, so they do not drift over
+ * long macros. The lateness of every scheduled send is recorded and reported as timing jitter.
+ * Data received after a send counts towards the next expect step, even if it arrived during a delay.
+ */
+
+#include "Bluetooth.h"
+
+#include <QObject>
+#include <QVector>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QRegularExpression>
+
+class MacroEngine : public QObject
+{
+    Q_OBJECT
+public:
+    explicit MacroEngine(Bluetooth *bluetooth, QObject *parent = nullptr);
+
+    enum StepType{
+        Send,
+        Delay,
+        Expect,
+    };
+
+    struct Step{
+        StepType type       = Send;
+        QByteArray payload;             //Send: bytes to write. Expect: literal pattern
+        QRegularExpression regex;       //Expect: regex pattern, when isRegex
+        bool isRegex        = false;
+        int ms              = 0;        //Delay: duration. Expect: timeout
+        int line            = 0;        //Source line, for error reporting
+    };
+
+    bool compile(QString source, QString *error = nullptr);
+    QString getSource();
+    int getStepCount();
+
+    bool isRunning();
+
+signals:
+    void stepStarted(int run, int line);
+    void finished(bool success, QString report);
+
+public slots:
+    void start(int runs = 1);
+    void stop();
+
+private:
+    static const int DEFAULT_EXPECT_TIMEOUT_MS = 2000;
+    static const int MAX_EXPECT_BUFFER = 4096;
+
+    Bluetooth *bluetooth = nullptr;
+    QString source;
+    QVector<Step> steps;
+
+    bool running = false;
+    int runs = 1;
+    int run = 0;
+    int stepIndex = 0;
+
+    QElapsedTimer clock;
+    QTimer *stepTimer = nullptr;
+    QTimer *expectTimer = nullptr;
+    qint64 deadlineNs = 0;              //When the next step is due
+    bool scheduled = false;             //The next send follows a delay and is measured for jitter
+    bool waiting = false;               //Waiting for an expect step to match
+    qint64 lastSendNs = 0;              //Response times are measured from the last send
+    QByteArray received;                //Data received since the last send
+
+    //Statistics
+    qint64 writes = 0;
+    qint64 bytesSent = 0;
+    QVector<double> jitterMs;
+    QVector<double> responseMs;
+
+    void runSteps();
+    bool checkExpect();
+    void finish(bool success, QString message);
+    QString buildReport(QString message);
+
+private slots:
+    void handleData(QByteArray data);
+    void handleStepTimeout();
+    void handleExpectTimeout();
+};
+
+#endif // MACROENGINE_H
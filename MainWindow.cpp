@@ -1,8 +1,18 @@
 #include "MainWindow.h"
 #include "ui_MainWindow.h"
+#include "DurableLog.h"
+#include "StartupTimeline.h"
 
 #include <QDebug>
 #include <QFileDialog>
+#include <QInputDialog>
+#include <QMessageBox>
+#include <QPushButton>
+#include <QApplication>
+#include <QDateTime>
+#include <QSettings>
+#include <QStandardPaths>
+#include <QDir>
 
 MainWindow::MainWindow(QWidget *parent) :
     QMainWindow(parent),
@@ -25,8 +35,10 @@ MainWindow::MainWindow(QWidget *parent) :
     connect(bluetooth, SIGNAL(deviceDisconnected()), this, SLOT(handleBluetoothDisconnect()));
     connect(bluetooth, SIGNAL(deviceTransmitReady()), this, SLOT(handleTransmitReady()));
     connect(bluetooth, SIGNAL(dataAvailable()), this, SLOT(collectData()));
+    connect(bluetooth->getTriggerEngine(), SIGNAL(triggered(int, qint64)), this, SLOT(handleTrigger(int, qint64)));
 
-    this->bluetooth->refreshDeviceList();
+    //Device discovery waits until the window is up (see startDeferredInit)
+    QTimer::singleShot(0, this, SLOT(startDeferredInit()));
 
 
     /*
@@ -44,6 +56,7 @@ MainWindow::MainWindow(QWidget *parent) :
      * data enterred by the user.
      */
     connect(ui->terminal, SIGNAL(textEnterred(char)), this, SLOT(sendUserInput(char)));
+    connect(ui->terminal, SIGNAL(lineEnterred(QByteArray)), this, SLOT(sendUserLine(QByteArray)));
 
     /*
      *
@@ -52,18 +65,134 @@ MainWindow::MainWindow(QWidget *parent) :
      * This class allows logging data as text, hex, splitting log files (TX and RX files), and more.
      */
     logger = new Logger(this);
-    connect(ui->terminal, SIGNAL(textAdded(QString)), logger, SLOT(log(QString)));
+    connect(ui->terminal, SIGNAL(dataAdded(QByteArray, bool)), logger, SLOT(log(QByteArray, bool)));
+
+    /*
+     * Stress test
+     *
+     * Sends checksummed frames to an echoing peripheral (or the simulated loopback)
+     * and measures round trip latency and throughput.
+     */
+    stressTest = new StressTest(bluetooth, this);
+    connect(stressTest, SIGNAL(finished(QString)), this, SLOT(handleStressTestFinished(QString)));
+
+    /*
+     * File sender
+     *
+     * Streams files to the device with pipelined writes, line pacing or XMODEM.
+     */
+    fileSender = new FileSender(bluetooth, this);
+    connect(fileSender, SIGNAL(progress(qint64, qint64, double, qint64)), this, SLOT(handleFileSendProgress(qint64, qint64, double, qint64)));
+    connect(fileSender, SIGNAL(finished(bool, QString)), this, SLOT(handleFileSendFinished(bool, QString)));
+
+    /*
+     * Macro engine
+     *
+     * Runs precompiled send/delay/expect sequences for repeated test procedures.
+     */
+    macroEngine = new MacroEngine(bluetooth, this);
+    connect(macroEngine, SIGNAL(finished(bool, QString)), this, SLOT(handleMacroFinished(bool, QString)));
+
+    /*
+     * Fan-out server
+     *
+     * Lets other local tools attach to the connection. Only listens once sharing is turned on.
+     */
+    fanoutServer = new FanoutServer(bluetooth, this);
+    connect(fanoutServer, SIGNAL(clientCountChanged(int)), this, SLOT(handleSharingClientsChanged(int)));
+
+    /*
+     * PTY bridge
+     *
+     * Exposes the connection as a serial device for existing serial tools (unix only).
+     */
+    ptyBridge = new PtyBridge(bluetooth, this);
+    connect(ptyBridge, SIGNAL(stopped(QString)), this, SLOT(handlePtyBridgeStopped(QString)));
 
     //Apply default settings here
     ui->LogPathInput->setText(logger->getLogFilePath());
     ui->OvevrwritePromptCheck->setChecked(true);
+
+    //Then whatever was set in the last session
+    this->restoreSettings();
 }
 
 MainWindow::~MainWindow()
 {
+    //A QThread must not be destroyed while it runs
+    if(exportJob){
+        exportJob->cancel();
+        exportJob->wait();
+    }
+
+    this->saveSettings();
+
+    QString error;
+    if(!ui->terminal->saveSession(sessionPath(), &error)){
+        qDebug() << "MainWindow: could not save the session:" << error;
+    }
+
     delete ui;
 }
 
+QString MainWindow::sessionPath()
+{
+    QString dir = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
+    QDir().mkpath(dir);
+    return dir + "/session.btsess";
+}
+
+//Settings are small, they are kept with QSettings (connected devices are added on connecting, see
+//handleBluetoothConnect). The scrollback goes in the session file.
+void MainWindow::saveSettings()
+{
+    QSettings settings("BluetoothTerminal", "BluetoothTerminal");
+
+    settings.setValue("terminal/echo", ui->EchoTerminalCheck->isChecked());
+    settings.setValue("terminal/hex", ui->DisplayInHexCheck->isChecked());
+    settings.setValue("terminal/lineMode", ui->LineModeCheck->isChecked());
+    settings.setValue("terminal/lineEnding", ui->LineEndingBox->currentIndex());
+    settings.setValue("terminal/encoding", ui->TextEncodingBox->currentIndex());
+
+    settings.setValue("log/path", logger->getLogFilePath());
+    settings.setValue("log/overwritePrompt", ui->OvevrwritePromptCheck->isChecked());
+    settings.setValue("log/raw", ui->LogRawDataCheck->isChecked());
+    settings.setValue("log/format", ui->LogFormatBox->currentIndex());
+    settings.setValue("log/durability", ui->DurabilityBox->currentIndex());
+    settings.setValue("log/groupCommitMs", ui->GroupCommitMsBox->value());
+    settings.setValue("log/groupCommitKB", ui->GroupCommitKbBox->value());
+    settings.setValue("log/bluetoothDebug", ui->actionDebug_Log->isChecked());
+    settings.setValue("transmit/queues", bluetooth->getTxScheduler()->getSettings());
+}
+
+//Setting the widgets runs their handlers, which applies the settings
+void MainWindow::restoreSettings()
+{
+    QSettings settings("BluetoothTerminal", "BluetoothTerminal");
+
+    ui->EchoTerminalCheck->setChecked(settings.value("terminal/echo", ui->EchoTerminalCheck->isChecked()).toBool());
+    ui->DisplayInHexCheck->setChecked(settings.value("terminal/hex", ui->DisplayInHexCheck->isChecked()).toBool());
+    ui->LineModeCheck->setChecked(settings.value("terminal/lineMode", ui->LineModeCheck->isChecked()).toBool());
+    ui->LineEndingBox->setCurrentIndex(settings.value("terminal/lineEnding", ui->LineEndingBox->currentIndex()).toInt());
+    ui->TextEncodingBox->setCurrentIndex(settings.value("terminal/encoding", ui->TextEncodingBox->currentIndex()).toInt());
+
+    QString logPath = settings.value("log/path", logger->getLogFilePath()).toString();
+    logger->setLogFile(logPath);
+    ui->LogPathInput->setText(logPath);
+    ui->OvevrwritePromptCheck->setChecked(settings.value("log/overwritePrompt", ui->OvevrwritePromptCheck->isChecked()).toBool());
+    ui->LogRawDataCheck->setChecked(settings.value("log/raw", ui->LogRawDataCheck->isChecked()).toBool());
+    ui->LogFormatBox->setCurrentIndex(settings.value("log/format", ui->LogFormatBox->currentIndex()).toInt());
+    ui->DurabilityBox->setCurrentIndex(settings.value("log/durability", ui->DurabilityBox->currentIndex()).toInt());
+    ui->GroupCommitMsBox->setValue(settings.value("log/groupCommitMs", ui->GroupCommitMsBox->value()).toInt());
+    ui->GroupCommitKbBox->setValue(settings.value("log/groupCommitKB", ui->GroupCommitKbBox->value()).toInt());
+    ui->actionDebug_Log->setChecked(settings.value("log/bluetoothDebug", ui->actionDebug_Log->isChecked()).toBool());
+
+    QString error;
+    if(!bluetooth->getTxScheduler()->setSettings(settings.value("transmit/queues").toString(), &error)){
+        qDebug() << "MainWindow: ignoring the saved transmit queue settings:" << error;
+    }
+}
+
 void MainWindow::startConnectTimeoutTimer()
 {
     if(!timeoutTimer){
@@ -73,18 +202,88 @@ void MainWindow::startConnectTimeoutTimer()
     timeoutTimer->start(5000);
 }
 
+//show() only schedules the window, it is on screen once it first paints
+void MainWindow::paintEvent(QPaintEvent *event)
+{
+    StartupTimeline::mark("window painted");
+    QMainWindow::paintEvent(event);
+}
+
+//Runs from the event loop once the window has been shown
+void MainWindow::startDeferredInit()
+{
+    StartupTimeline::mark("event loop");
+
+    QString error;
+    if(QFile::exists(sessionPath()) && !ui->terminal->restoreSession(sessionPath(), &error)){
+        qDebug() << "MainWindow: could not restore the session:" << error;
+    }
+    StartupTimeline::mark("session restored");
+
+    //Reconnecting to a known device does not need to wait for a 5 s scan, list the devices
+    //straight away. The last connected device comes first.
+    QSettings settings("BluetoothTerminal", "BluetoothTerminal");
+    for(const QString &device : settings.value("devices/connected").toStringList()){
+        QString address = device.section(' ', 0, 0);
+        QString name = device.section(' ', 1);
+        if(!address.isEmpty()){
+            bluetooth->addKnownDevice(address, name);
+        }
+    }
+
+    //Still scan in the background, for devices that were never connected to or have moved
+    StartupTimeline::mark("discovery started");
+    bluetooth->refreshDeviceList();
+}
+
 void MainWindow::refreshDeviceList()
 {
     if(bluetooth){
+        //The list is refreshed while the user may already have picked a device, keep it selected
+        //Items carry the device address, names need not be unique
+        QString selected = ui->BluetoothDevicesBox->currentData().toString();
         QStringList devices = this->bluetooth->getDeviceList();
+        QStringList addresses = this->bluetooth->getDeviceAddresses();
         ui->BluetoothDevicesBox->clear();
-        ui->BluetoothDevicesBox->addItems(devices);
+        for(int i = 0; i < devices.size(); i++){
+            ui->BluetoothDevicesBox->addItem(devices.at(i), addresses.at(i));
+        }
+
+        int index = ui->BluetoothDevicesBox->findData(selected);
+        if(index >= 0){
+            ui->BluetoothDevicesBox->setCurrentIndex(index);
+        }
+
+        if(!devices.isEmpty()){
+            StartupTimeline::mark("first device listed");
+        }
     }
 }
 
 void MainWindow::handleBluetoothConnect()
 {
     if(bluetooth){
+        if(!StartupTimeline::isMarked("connected")){
+            StartupTimeline::mark("connected");
+            qDebug().noquote() << "Startup timeline:\n" + StartupTimeline::report();
+        }
+
+        //Only devices that were connected to are remembered, as "<address> <name>", the last one first.
+        //The address is the device UUID on macOS.
+        QSettings settings("BluetoothTerminal", "BluetoothTerminal");
+        QStringList devices = settings.value("devices/connected").toStringList();
+        QString address = bluetooth->getDeviceAddress();
+        for(int i = devices.size() - 1; i >= 0; i--){
+            if(devices.at(i).section(' ', 0, 0) == address){
+                devices.removeAt(i);        //Also when the device has been renamed since
+            }
+        }
+        devices.prepend(address + " " + bluetooth->getDeviceName());
+        while(devices.size() > MAX_KNOWN_DEVICES){
+            devices.removeLast();
+        }
+        settings.setValue("devices/connected", devices);
+
         this->timeoutTimer->stop();
         QString txt = "Connected to " + bluetooth->getDeviceName();
         ui->StatusLabel->setText(txt);
@@ -100,6 +299,7 @@ void MainWindow::handleBluetoothDisconnect()
         ui->StatusLabel->setText(txt);
         ui->ConnectButton->setText("Connect");
         this->state = DISCONNECTED;
+        this->linkRoundTripMs = -1;
     }
 }
 
@@ -115,17 +315,164 @@ void MainWindow::handleTransmitReady()
 void MainWindow::collectData()
 {
     if(bluetooth){
-        ui->terminal->addText(bluetooth->readAll(), true);
+        //Echoed stress test frames are consumed by the stress test, and framed data
+        //is displayed frame by frame as it is decoded
+        if((stressTest && stressTest->isRunning()) || bluetooth->getFrameDecoder()){
+            bluetooth->clearBuffer();
+            return;
+        }
+
+        bluetooth->readInto(receiveBuffer);
+        ui->terminal->addText(receiveBuffer, true);
     }
 }
 
 void MainWindow::sendUserInput(char c)
 {
     if(bluetooth){
-        bluetooth->write(c);
+        bluetooth->write(QByteArray(1, c), TxScheduler::INTERACTIVE);
+    }
+}
+
+void MainWindow::sendUserLine(QByteArray line)
+{
+    if(bluetooth){
+        bluetooth->write(line, TxScheduler::INTERACTIVE);
     }
 }
 
+void MainWindow::handleStressTestFinished(QString report)
+{
+    //The device echoes, so the serial bridge can measure its end to end latency against this
+    StressTest::Report result = stressTest->getReport();
+    if(bluetooth && !bluetooth->isLoopbackEnabled() && result.framesReceived > 0){
+        this->linkRoundTripMs = result.rttP50Ms;
+    }
+
+    if(bluetooth && bluetooth->isLoopbackEnabled() && this->state != READY){
+        bluetooth->setLoopbackEnabled(false);
+    }
+
+    ui->StatusLabel->setText("Stress test finished");
+    QMessageBox::information(this, "Stress Test Results", report);
+}
+
+void MainWindow::handleTrigger(int index, qint64 offset)
+{
+    TriggerEngine::Trigger trigger = bluetooth->getTriggerEngine()->getTrigger(index);
+    QString description = QString("Trigger '%1' matched at byte %2").arg(trigger.pattern).arg(offset);
+
+    switch(trigger.action){
+        case TriggerEngine::Highlight:
+            ui->statusBar->showMessage(description, 5000);
+            QApplication::alert(this);
+            break;
+        case TriggerEngine::AutoReply:
+            //With loopback (or an echoing device) the reply comes straight back, it must not trigger itself
+            bluetooth->getTriggerEngine()->expectEcho(trigger.reply);
+            bluetooth->write(trigger.reply, TxScheduler::CONTROL);
+            break;
+        case TriggerEngine::StartLogging:
+            //Starting may prompt before overwriting, which must not happen inside the receive path
+            if(!logger->isLogging() && !triggeredLoggingQueued){
+                triggeredLoggingQueued = true;
+                QTimer::singleShot(0, this, SLOT(startTriggeredLogging()));
+            }
+            break;
+        case TriggerEngine::StopLogging:
+            if(logger->isLogging()){
+                logger->stopLogging();
+                ui->StartStopLoggingButton->setText("Start Logging");
+            }
+            break;
+        case TriggerEngine::Mark:
+            if(logger->isLogging()){
+                logger->log(QString("\r\n--- %1 ---\r\n").arg(description));
+            }
+            break;
+    }
+}
+
+void MainWindow::handleFrame(QByteArray frame, qint64 timestamp)
+{
+    //The frame only refers to the decoder's buffer, so it is formatted straight away
+    const static std::string asciiLookup = "0123456789ABCDEF";
+
+    QString line = QDateTime::fromMSecsSinceEpoch(timestamp).toString("[hh:mm:ss.zzz] ");
+    line += QString("%1 bytes:").arg(frame.size());
+    for(char c : frame){
+        line += ' ';
+        line += asciiLookup[(c & 0xF0) >> 4];
+        line += asciiLookup[c & 0x0F];
+    }
+    line += "\n";
+
+    ui->terminal->addText(line, true);
+
+    FrameDecoder::Statistics stats = bluetooth->getFrameDecoder()->getStatistics();
+    ui->statusBar->showMessage(QString("%1: %2 frames, %3 CRC errors, %4 framing errors")
+                               .arg(bluetooth->getFrameDecoder()->getName())
+                               .arg(stats.frames)
+                               .arg(stats.crcErrors)
+                               .arg(stats.framingErrors));
+}
+
+void MainWindow::handleFileSendProgress(qint64 sent, qint64 total, double bytesPerSecond, qint64 etaMs)
+{
+    if(!sendProgress){
+        return;
+    }
+
+    //The progress dialog works in KB so files over 2GB still fit in an int
+    sendProgress->setMaximum(static_cast<int>(qMax<qint64>(1, total / 1024)));
+    sendProgress->setValue(static_cast<int>(sent / 1024));
+
+    QString eta = etaMs < 0 ? "--" : QString::number((etaMs + 999) / 1000) + " s";
+    sendProgress->setLabelText(QString("Sent %1 of %2 KB\n%3 KB/s, %4 left")
+                               .arg(sent / 1024)
+                               .arg(total / 1024)
+                               .arg(bytesPerSecond / 1024, 0, 'f', 1)
+                               .arg(eta));
+}
+
+void MainWindow::handleFileSendFinished(bool success, QString message)
+{
+    if(sendProgress){
+        sendProgress->deleteLater();
+        sendProgress = nullptr;
+    }
+
+    if(success){
+        ui->statusBar->showMessage(message, 5000);
+    }
+    else{
+        QMessageBox::warning(this, "Send File", message);
+    }
+}
+
+void MainWindow::handleMacroFinished(bool success, QString report)
+{
+    ui->statusBar->clearMessage();
+
+    if(success){
+        QMessageBox::information(this, "Macro Results", report);
+    }
+    else{
+        QMessageBox::warning(this, "Macro Results", report);
+    }
+}
+
+void MainWindow::handleSharingClientsChanged(int clients)
+{
+    ui->statusBar->showMessage(QString("%1 sharing client(s) connected").arg(clients), 5000);
+}
+
+void MainWindow::handlePtyBridgeStopped(QString report)
+{
+    ui->actionSerial_Bridge->setChecked(false);
+    QMessageBox::information(this, "Serial Bridge", report);
+}
+
 void MainWindow::connectionTimeout()
 {
     qDebug() << "Conn timeout";
@@ -144,11 +491,11 @@ void MainWindow::on_ConnectButton_released()
 {
     if(bluetooth){
         if(this->state == DISCONNECTED){
-            QString deviceName = ui->BluetoothDevicesBox->currentText();
-            if(!deviceName.isEmpty()){
+            QString address = ui->BluetoothDevicesBox->currentData().toString();
+            if(!address.isEmpty()){
                 ui->StatusLabel->setText("Connecting...");
                 this->startConnectTimeoutTimer();
-                bluetooth->connectToDevice(deviceName);
+                bluetooth->connectToDevice(address);
             }
         }
         else{
@@ -172,11 +519,49 @@ void MainWindow::on_DisplayInHexCheck_toggled(bool checked)
     }
 }
 
+void MainWindow::on_LineModeCheck_toggled(bool checked)
+{
+    ui->terminal->setInputMode(checked ? Terminal::LINE : Terminal::CHARACTER);
+}
+
+void MainWindow::on_LineEndingBox_currentIndexChanged(int index)
+{
+    switch(index){
+        case 1:
+            ui->terminal->setLineEnding("\n");
+            break;
+        case 2:
+            ui->terminal->setLineEnding("\r");
+            break;
+        case 3:
+            ui->terminal->setLineEnding(QByteArray());
+            break;
+        default:
+            ui->terminal->setLineEnding("\r\n");
+            break;
+    }
+}
+
+void MainWindow::on_TextEncodingBox_currentIndexChanged(int index)
+{
+    switch(index){
+        case 1:
+            ui->terminal->setTextEncoding(Terminal::ENCODING_LATIN1);
+            break;
+        case 2:
+            ui->terminal->setTextEncoding(Terminal::ENCODING_ASCII);
+            break;
+        default:
+            ui->terminal->setTextEncoding(Terminal::ENCODING_UTF8);
+            break;
+    }
+}
+
 void MainWindow::on_BrowseButton_released()
 {
     QString path = QFileDialog::getSaveFileName(this, "Log File",
                                                 logger->getLogFilePath(),
-                                                "Text Files (*.txt);;CSV Files (*.csv);;All Files (*.*)");
+                                                "Text Files (*.txt);;CSV Files (*.csv);;Columnar Telemetry (*.btc);;Durable Logs (*.btlog);;All Files (*.*)");
 
     logger->setLogFile(path);
 }
@@ -195,20 +580,84 @@ void MainWindow::on_StartStopLoggingButton_released()
     }
 }
 
+void MainWindow::startTriggeredLogging()
+{
+    triggeredLoggingQueued = false;
+
+    if(!logger->isLogging()){
+        logger->startLogging();
+        if(logger->isLogging()){
+            ui->StartStopLoggingButton->setText("Stop Logging");
+        }
+    }
+}
+
 void MainWindow::on_LogRawDataCheck_toggled(bool checked)
 {
     logger->logInHex(checked);
 }
 
+//The scrollback is exported on a background thread, the window stays responsive however large it is
 void MainWindow::on_actionCapture_Terminal_triggered()
 {
-    //Capture the terminal by writing all of the terminal's contents to the logger
-    if(!logger->isLogging()){
-        logger->startLogging();
-        if(logger->isLogging()){
-            logger->log(ui->terminal->getText());
-            logger->stopLogging();
-        }
+    if(exportJob){
+        return;
+    }
+
+    QStringList filters = ExportJob::formatFilters();
+    QString selectedFilter = filters.first();
+    QString path = QFileDialog::getSaveFileName(this, "Capture Terminal", QString(), filters.join(";;"), &selectedFilter);
+    if(path.isEmpty()){
+        return;
+    }
+
+    ExportJob::Format format = static_cast<ExportJob::Format>(qMax(0, filters.indexOf(selectedFilter)));
+
+    exportJob = new ExportJob(ui->terminal->getSnapshot(), path, format, this);
+    connect(exportJob, SIGNAL(progress(qint64, qint64)), this, SLOT(handleExportProgress(qint64, qint64)));
+    connect(exportJob, SIGNAL(completed(bool, QString)), this, SLOT(handleExportCompleted(bool, QString)));
+
+    exportProgress = new QProgressDialog("Exporting...", "Cancel", 0, 1, this);
+    exportProgress->setWindowTitle("Capture Terminal");
+    exportProgress->setMinimumDuration(500);
+    exportProgress->setAutoClose(false);
+    exportProgress->setAutoReset(false);
+    connect(exportProgress, SIGNAL(canceled()), exportJob, SLOT(cancel()));
+
+    exportJob->start(QThread::LowPriority);
+}
+
+void MainWindow::handleExportProgress(qint64 done, qint64 total)
+{
+    if(!exportProgress){
+        return;
+    }
+
+    //The scrollback is a QString, so character counts always fit in an int
+    exportProgress->setMaximum(static_cast<int>(qMax<qint64>(1, total)));
+    exportProgress->setValue(static_cast<int>(done));
+    exportProgress->setLabelText(QString("Exported %1 of %2 KB of text").arg(done / 1024).arg(total / 1024));
+}
+
+void MainWindow::handleExportCompleted(bool success, QString report)
+{
+    bool cancelled = false;
+    if(exportProgress){
+        cancelled = exportProgress->wasCanceled();
+        exportProgress->deleteLater();
+        exportProgress = nullptr;
+    }
+
+    //completed() is the job's last signal, the thread is finishing
+    exportJob->wait();
+    exportJob->deleteLater();
+    exportJob = nullptr;
+
+    if(success || cancelled){
+        ui->statusBar->showMessage(report, 5000);
+    }
+    else{
+        QMessageBox::warning(this, "Capture Terminal", report);
     }
 }
 
@@ -222,7 +671,440 @@ void MainWindow::on_actionStop_Logging_triggered()
     logger->stopLogging();
 }
 
+void MainWindow::on_actionSend_File_triggered()
+{
+    if(!bluetooth || fileSender->isRunning()){
+        return;
+    }
+
+    if(this->state != READY && !bluetooth->isLoopbackEnabled()){
+        QMessageBox::warning(this, "Send File", "Connect to a device before sending a file.");
+        return;
+    }
+
+    QString path = QFileDialog::getOpenFileName(this, "Send File");
+    if(path.isEmpty()){
+        return;
+    }
+
+    QStringList modes;
+    modes << "Raw (pipelined)" << "Line paced" << "XMODEM";
+
+    bool ok = false;
+    QString choice = QInputDialog::getItem(this, "Send File", "Transfer mode:", modes, 0, false, &ok);
+    if(!ok){
+        return;
+    }
+
+    FileSender::Mode mode = FileSender::RAW;
+    switch(modes.indexOf(choice)){
+        case 1:{
+            int delay = QInputDialog::getInt(this, "Send File", "Delay after each line (ms):", 20, 0, 10000, 1, &ok);
+            if(!ok){
+                return;
+            }
+            fileSender->setLineDelay(delay);
+            mode = FileSender::LINE_PACED;
+            break;
+        }
+        case 2:
+            mode = FileSender::XMODEM;
+            break;
+        default:
+            break;
+    }
+
+    sendProgress = new QProgressDialog("Starting transfer...", "Cancel", 0, 1, this);
+    sendProgress->setWindowTitle("Send File");
+    sendProgress->setMinimumDuration(0);
+    sendProgress->setAutoClose(false);
+    sendProgress->setAutoReset(false);
+    connect(sendProgress, SIGNAL(canceled()), fileSender, SLOT(cancel()));
+
+    if(!fileSender->start(path, mode)){
+        sendProgress->deleteLater();
+        sendProgress = nullptr;
+        QMessageBox::warning(this, "Send File", "Could not open " + path);
+    }
+}
+
 void MainWindow::on_OvevrwritePromptCheck_toggled(bool checked)
 {
     logger->promptWhenOverwriting(checked);
 }
+
+void MainWindow::on_LogFormatBox_currentIndexChanged(int index)
+{
+    switch(index){
+        case 1:
+            logger->setLogFormat(Logger::CSV);
+            break;
+        case 2:
+            logger->setLogFormat(Logger::COLUMNAR);
+            break;
+        case 3:
+            logger->setLogFormat(Logger::DURABLE);
+            break;
+        default:
+            logger->setLogFormat(Logger::TEXT);
+            break;
+    }
+
+    //Hex logging only applies to the text format
+    ui->LogRawDataCheck->setEnabled(index == 0);
+}
+
+void MainWindow::on_DurabilityBox_currentIndexChanged(int index)
+{
+    switch(index){
+        case 0:
+            logger->setDurability(Logger::FLUSH_ONLY);
+            break;
+        case 2:
+            logger->setDurability(Logger::SYNC_ALWAYS);
+            break;
+        default:
+            logger->setDurability(Logger::GROUP_COMMIT);
+            break;
+    }
+
+    //The interval and size only apply to group commit
+    ui->GroupCommitMsBox->setEnabled(index == 1);
+    ui->GroupCommitKbBox->setEnabled(index == 1);
+}
+
+void MainWindow::on_GroupCommitMsBox_valueChanged(int value)
+{
+    logger->setGroupCommit(value, ui->GroupCommitKbBox->value() * qint64(1024));
+}
+
+void MainWindow::on_GroupCommitKbBox_valueChanged(int value)
+{
+    logger->setGroupCommit(ui->GroupCommitMsBox->value(), value * qint64(1024));
+}
+
+void MainWindow::on_actionRecover_Durable_Log_triggered()
+{
+    QString path = QFileDialog::getOpenFileName(this, "Recover Durable Log", QString(), "Durable Logs (*.btlog);;All Files (*.*)");
+    if(path.isEmpty()){
+        return;
+    }
+
+    QString outPath = QFileDialog::getSaveFileName(this, "Save Recovered Log", path + ".txt", "Text Files (*.txt);;All Files (*.*)");
+    if(outPath.isEmpty()){
+        return;
+    }
+
+    QFile out(outPath);
+    if(!out.open(QIODevice::WriteOnly | QIODevice::Truncate)){
+        QMessageBox::warning(this, "Recover Durable Log", "Could not write " + outPath);
+        return;
+    }
+
+    DurableLog::ScanResult result;
+    qint64 records = DurableLog::exportText(path, &out, &result);
+    out.close();
+
+    if(!result.headerValid){
+        QMessageBox::warning(this, "Recover Durable Log", path + " is not a durable log.");
+        return;
+    }
+
+    QMessageBox::information(this, "Recover Durable Log",
+                             QString("Recovered %1 records (last sequence number %2).\n"
+                                     "%3 bytes of incomplete records at the end were skipped, %4 gaps in the sequence were found.")
+                             .arg(records)
+                             .arg(result.lastSequence)
+                             .arg(result.fileSize - result.validBytes)
+                             .arg(result.sequenceGaps));
+}
+
+void MainWindow::on_actionLoopback_Stress_Test_triggered()
+{
+    if(!bluetooth || stressTest->isRunning()){
+        return;
+    }
+
+    StressTest::Config config = stressTest->getConfig();
+    bool ok = false;
+
+    config.payloadSize = QInputDialog::getInt(this, "Stress Test", "Payload size (bytes):", config.payloadSize, 0, StressTest::MAX_PAYLOAD_SIZE, 1, &ok);
+    if(!ok){
+        return;
+    }
+
+    config.window = QInputDialog::getInt(this, "Stress Test", "Window (frames in flight):", config.window, 1, 256, 1, &ok);
+    if(!ok){
+        return;
+    }
+
+    int seconds = QInputDialog::getInt(this, "Stress Test", "Duration (seconds):", config.durationMs / 1000, 1, 3600, 1, &ok);
+    if(!ok){
+        return;
+    }
+    config.durationMs = seconds * 1000;
+
+    //Without a ready device the test runs against the simulated loopback transport
+    if(this->state != READY){
+        bluetooth->setLoopbackEnabled(true);
+        ui->StatusLabel->setText("Running stress test (simulated loopback)...");
+    }
+    else{
+        ui->StatusLabel->setText("Running stress test...");
+    }
+
+    stressTest->setConfig(config);
+    stressTest->start();
+}
+
+void MainWindow::on_actionTriggers_triggered()
+{
+    TriggerEngine *engine = bluetooth->getTriggerEngine();
+
+    QString help =
+            "# One trigger per line: <action> <literal|regex> <pattern> [reply]\n"
+            "# Actions: highlight, reply, startlog, stoplog, mark\n"
+            "# Use \\s for spaces and \\r, \\n, \\t, \\xHH for control characters\n"
+            "# Example: reply literal PING PONG\\r\\n\n";
+
+    QString rules = help + engine->getRules();
+
+    //Keep asking until the rules parse or the user cancels
+    forever{
+        bool ok = false;
+        rules = QInputDialog::getMultiLineText(this, "Triggers", "Trigger rules:", rules, &ok);
+        if(!ok){
+            return;
+        }
+
+        QString error;
+        if(engine->setRules(rules, &error)){
+            break;
+        }
+
+        QMessageBox::warning(this, "Triggers", error);
+    }
+
+    //Highlight triggers are also colored in the terminal
+    ui->terminal->clearHighlightRules();
+    for(int i = 0; i < engine->getTriggerCount(); i++){
+        TriggerEngine::Trigger trigger = engine->getTrigger(i);
+        if(trigger.action == TriggerEngine::Highlight){
+            QString pattern = trigger.isRegex ? trigger.pattern : QString::fromLatin1(TriggerEngine::unescape(trigger.pattern));
+            ui->terminal->addHighlightRule(pattern, QColor(0xFF, 0xD5, 0x4F), trigger.isRegex);
+        }
+    }
+
+    ui->statusBar->showMessage(QString("%1 trigger(s) active").arg(engine->getTriggerCount()), 5000);
+}
+
+void MainWindow::on_actionMacros_triggered()
+{
+    if(macroEngine->isRunning()){
+        if(QMessageBox::question(this, "Macros", "A macro is running. Stop it?") == QMessageBox::Yes){
+            macroEngine->stop();
+        }
+        return;
+    }
+
+    QString help =
+            "# One step per line:\n"
+            "#   send <text>    hex <bytes>    delay <ms>    expect <literal|regex> <pattern> [timeout ms]\n"
+            "# Text and literal patterns use \\s, \\r, \\n, \\t and \\xHH escapes\n"
+            "# Example:\n"
+            "#   send AT\\r\\n\n"
+            "#   expect literal OK 1000\n"
+            "#   delay 500\n";
+
+    QString source = macroEngine->getSource().isEmpty() ? help : macroEngine->getSource();
+
+    //Keep asking until the macro compiles or the user cancels
+    forever{
+        bool ok = false;
+        source = QInputDialog::getMultiLineText(this, "Macros", "Macro:", source, &ok);
+        if(!ok){
+            return;
+        }
+
+        QString error;
+        if(macroEngine->compile(source, &error)){
+            break;
+        }
+
+        QMessageBox::warning(this, "Macros", error);
+    }
+
+    if(macroEngine->getStepCount() == 0){
+        return;
+    }
+
+    bool ok = false;
+    int runs = QInputDialog::getInt(this, "Macros", "Number of runs:", 1, 1, 1000000, 1, &ok);
+    if(!ok){
+        return;
+    }
+
+    ui->statusBar->showMessage("Running macro...");
+    macroEngine->start(runs);
+}
+
+void MainWindow::on_actionSearch_triggered()
+{
+    if(!searchDialog){
+        searchDialog = new SearchDialog(ui->terminal, this);
+    }
+
+    searchDialog->show();
+    searchDialog->raise();
+    searchDialog->activateWindow();
+}
+
+void MainWindow::on_actionFrame_Decoder_triggered()
+{
+    QStringList decoders;
+    decoders << "None (text)" << "SLIP" << "COBS" << "Length + CRC16";
+
+    int current = 0;
+    if(bluetooth->getFrameDecoder()){
+        current = qMax(0, decoders.indexOf(bluetooth->getFrameDecoder()->getName()));
+    }
+
+    bool ok = false;
+    QString choice = QInputDialog::getItem(this, "Frame Decoder", "Decode received data as:", decoders, current, false, &ok);
+    if(!ok){
+        return;
+    }
+
+    FrameDecoder *decoder = nullptr;
+    switch(decoders.indexOf(choice)){
+        case 1:
+            decoder = new SlipDecoder();
+            break;
+        case 2:
+            decoder = new CobsDecoder();
+            break;
+        case 3:
+            decoder = new LengthPrefixDecoder();
+            break;
+        default:
+            break;
+    }
+
+    if(decoder){
+        connect(decoder, SIGNAL(frameDecoded(QByteArray, qint64)), this, SLOT(handleFrame(QByteArray, qint64)), Qt::DirectConnection);
+    }
+
+    bluetooth->setFrameDecoder(decoder);
+}
+
+void MainWindow::on_actionTelemetry_Plot_triggered()
+{
+    //Created on first use so the receive path only parses telemetry once a plot was asked for
+    if(!plotWidget){
+        plotWidget = new PlotWidget(this);
+        plotWidget->setWindowFlags(Qt::Window);
+        plotWidget->resize(700, 400);
+        connect(bluetooth, SIGNAL(dataReceived(QByteArray)), plotWidget, SLOT(feed(QByteArray)));
+    }
+
+    plotWidget->show();
+    plotWidget->raise();
+    plotWidget->activateWindow();
+}
+
+void MainWindow::on_actionTransmit_Queues_triggered()
+{
+    TxScheduler *scheduler = bluetooth->getTxScheduler();
+
+    QMessageBox box(QMessageBox::Information, "Transmit Queues", scheduler->getStatistics().toString(), QMessageBox::Close, this);
+    QPushButton *settingsButton = box.addButton("Settings...", QMessageBox::ActionRole);
+    box.exec();
+    if(box.clickedButton() != settingsButton){
+        return;
+    }
+
+    QString help =
+            "# One queue per line: <queue> weight <weight> rate <bytes per second, 0 = unlimited>\n"
+            "# Queues: interactive, control, bulk. Waiting queues share the link in proportion to their weights.\n"
+            "# inflight <chunks>: how many chunks are handed to the link at a time\n";
+
+    QString settings = help + scheduler->getSettings();
+
+    //Keep asking until the settings parse or the user cancels
+    forever{
+        bool ok = false;
+        settings = QInputDialog::getMultiLineText(this, "Transmit Queues", "Queue settings:", settings, &ok);
+        if(!ok){
+            return;
+        }
+
+        QString error;
+        if(scheduler->setSettings(settings, &error)){
+            break;
+        }
+
+        QMessageBox::warning(this, "Transmit Queues", error);
+    }
+}
+
+void MainWindow::on_actionStartup_Timeline_triggered()
+{
+    QMessageBox::information(this, "Startup Timeline", StartupTimeline::report());
+}
+
+void MainWindow::on_actionDebug_Log_toggled(bool checked)
+{
+    bluetooth->setDebugLoggingEnabled(checked);
+}
+
+void MainWindow::on_actionShare_Connection_toggled(bool checked)
+{
+    if(!checked){
+        fanoutServer->stop();
+        ui->statusBar->showMessage("Connection sharing stopped", 5000);
+        return;
+    }
+
+    if(fanoutServer->isRunning()){
+        return;
+    }
+
+    bool ok = false;
+    int port = QInputDialog::getInt(this, "Share Connection", "Localhost TCP port (0 for local socket only):", 7070, 0, 65535, 1, &ok);
+
+    if(!ok || !fanoutServer->start("BluetoothTerminal", static_cast<quint16>(port))){
+        if(ok){
+            QMessageBox::warning(this, "Share Connection", "Could not start the sharing server.");
+        }
+        ui->actionShare_Connection->setChecked(false);
+        return;
+    }
+
+    QString where = fanoutServer->getLocalName();
+    if(fanoutServer->getTcpPort() > 0){
+        where += QString(" and localhost:%1").arg(fanoutServer->getTcpPort());
+    }
+    ui->statusBar->showMessage("Sharing connection on " + where);
+}
+
+void MainWindow::on_actionSerial_Bridge_toggled(bool checked)
+{
+    if(!checked){
+        ptyBridge->stop();
+        return;
+    }
+
+    if(ptyBridge->isRunning()){
+        return;
+    }
+
+    QString error;
+    ptyBridge->measureRoundTrip(linkRoundTripMs);
+    if(!ptyBridge->start(&error)){
+        QMessageBox::warning(this, "Serial Bridge", error);
+        ui->actionSerial_Bridge->setChecked(false);
+        return;
+    }
+
+    ui->statusBar->showMessage("Serial bridge on " + ptyBridge->getDevicePath());
+}
@@ -15,6 +15,16 @@
 #include "Bluetooth.h"
 #include "Terminal.h"
 #include "Logger.h"
+#include "StressTest.h"
+#include "SearchDialog.h"
+#include "PlotWidget.h"
+#include "FileSender.h"
+#include "MacroEngine.h"
+#include "FanoutServer.h"
+#include "PtyBridge.h"
+#include "ExportJob.h"
+
+#include <QProgressDialog>
 
 namespace Ui {
 class MainWindow;
@@ -28,6 +38,9 @@ public:
     explicit MainWindow(QWidget *parent = nullptr);
     ~MainWindow();
 
+protected:
+    void paintEvent(QPaintEvent *event) override;
+
 private:
     Ui::MainWindow *ui;
 
@@ -41,11 +54,30 @@ private:
     QTimer *timeoutTimer    = nullptr;
     Bluetooth *bluetooth    = nullptr;
     Logger *logger          = nullptr;
+    StressTest *stressTest  = nullptr;
+    SearchDialog *searchDialog = nullptr;
+    PlotWidget *plotWidget  = nullptr;
+    FileSender *fileSender  = nullptr;
+    MacroEngine *macroEngine = nullptr;
+    FanoutServer *fanoutServer = nullptr;
+    PtyBridge *ptyBridge    = nullptr;
+    QProgressDialog *sendProgress = nullptr;
+    ExportJob *exportJob    = nullptr;
+    QProgressDialog *exportProgress = nullptr;
 
     QString terminalData;       //Keeps track of data written to the terminal window
+    QByteArray receiveBuffer;   //Received data is drained into this, reused for every notification
+    double linkRoundTripMs = -1;    //Median RTT of the last stress test against the connected device
+    bool triggeredLoggingQueued = false;
+
+    static const int MAX_KNOWN_DEVICES = 10;    //Connected devices remembered for the next launch
 
     void startConnectTimeoutTimer();
 
+    QString sessionPath();
+    void saveSettings();
+    void restoreSettings();
+
 public slots:
     void refreshDeviceList();
     void handleBluetoothConnect();
@@ -53,20 +85,53 @@ public slots:
     void handleTransmitReady();
     void collectData();
     void sendUserInput(char c);
+    void sendUserLine(QByteArray line);
+    void handleStressTestFinished(QString report);
+    void handleTrigger(int index, qint64 offset);
+    void handleFrame(QByteArray frame, qint64 timestamp);
+    void handleFileSendProgress(qint64 sent, qint64 total, double bytesPerSecond, qint64 etaMs);
+    void handleFileSendFinished(bool success, QString message);
+    void handleExportProgress(qint64 done, qint64 total);
+    void handleExportCompleted(bool success, QString report);
+    void handleMacroFinished(bool success, QString report);
+    void handleSharingClientsChanged(int clients);
+    void handlePtyBridgeStopped(QString report);
 
 private slots:
+    void startDeferredInit();
+    void startTriggeredLogging();
     void connectionTimeout();
     void on_RefreshDevicesButton_released();
     void on_ConnectButton_released();
     void on_EchoTerminalCheck_toggled(bool checked);
     void on_DisplayInHexCheck_toggled(bool checked);
+    void on_LineModeCheck_toggled(bool checked);
+    void on_LineEndingBox_currentIndexChanged(int index);
+    void on_TextEncodingBox_currentIndexChanged(int index);
     void on_BrowseButton_released();
     void on_StartStopLoggingButton_released();
     void on_LogRawDataCheck_toggled(bool checked);
     void on_actionCapture_Terminal_triggered();
     void on_actionStart_Logging_triggered();
     void on_actionStop_Logging_triggered();
+    void on_actionSend_File_triggered();
     void on_OvevrwritePromptCheck_toggled(bool checked);
+    void on_LogFormatBox_currentIndexChanged(int index);
+    void on_DurabilityBox_currentIndexChanged(int index);
+    void on_GroupCommitMsBox_valueChanged(int value);
+    void on_GroupCommitKbBox_valueChanged(int value);
+    void on_actionRecover_Durable_Log_triggered();
+    void on_actionLoopback_Stress_Test_triggered();
+    void on_actionTriggers_triggered();
+    void on_actionMacros_triggered();
+    void on_actionSearch_triggered();
+    void on_actionFrame_Decoder_triggered();
+    void on_actionTelemetry_Plot_triggered();
+    void on_actionTransmit_Queues_triggered();
+    void on_actionStartup_Timeline_triggered();
+    void on_actionDebug_Log_toggled(bool checked);
+    void on_actionShare_Connection_toggled(bool checked);
+    void on_actionSerial_Bridge_toggled(bool checked);
 };
 
 #endif // MAINWINDOW_H
@@ -0,0 +1,210 @@
+#include "PlotWidget.h"
+
+#include <QPainter>
+#include <QPaintEvent>
+#include <QWheelEvent>
+#include <QLineF>
+#include <QVector>
+
+PlotWidget::PlotWidget(QWidget *parent) : QWidget(parent)
+{
+    this->setWindowTitle("Telemetry Plot");
+    this->setMinimumSize(400, 250);
+    this->setAttribute(Qt::WA_OpaquePaintEvent);
+
+    parser = new TelemetryParser(this);
+    connect(parser, SIGNAL(rowParsed(qint64, bool, QVector<double>, QList<QByteArray>)),
+            this, SLOT(handleRow(qint64, bool, QVector<double>, QList<QByteArray>)));
+    connect(parser, SIGNAL(fieldNamesChanged(QStringList)), this, SLOT(handleFieldNames(QStringList)));
+
+    refreshTimer = new QTimer(this);
+    refreshTimer->setInterval(REFRESH_INTERVAL_MS);
+    connect(refreshTimer, SIGNAL(timeout()), this, SLOT(refresh()));
+    refreshTimer->start();
+}
+
+void PlotWidget::setVisibleSamples(qint64 samples)
+{
+    this->visibleSamples = qBound(Q_INT64_C(16), samples, static_cast<qint64>(buffer.getCapacity()));
+    this->dirty = true;
+}
+
+qint64 PlotWidget::getVisibleSamples()
+{
+    return this->visibleSamples;
+}
+
+void PlotWidget::feed(QByteArray data)
+{
+    parser->feed(data);
+}
+
+void PlotWidget::clearPlot()
+{
+    parser->reset();
+    buffer.clear();
+    fieldNames.clear();
+    this->dirty = true;
+}
+
+void PlotWidget::handleRow(qint64 timestamp, bool, QVector<double> values, QList<QByteArray>)
+{
+    buffer.append(timestamp, values);
+    this->dirty = true;
+}
+
+void PlotWidget::handleFieldNames(QStringList names)
+{
+    this->fieldNames = names;
+}
+
+void PlotWidget::refresh()
+{
+    if(dirty && isVisible()){
+        dirty = false;
+        update();
+    }
+}
+
+void PlotWidget::wheelEvent(QWheelEvent *event)
+{
+    if(event->angleDelta().y() > 0){
+        setVisibleSamples(visibleSamples / 2);
+    }
+    else{
+        setVisibleSamples(visibleSamples * 2);
+    }
+    event->accept();
+}
+
+void PlotWidget::paintEvent(QPaintEvent *)
+{
+    QPainter painter(this);
+    painter.fillRect(rect(), Qt::black);
+
+    QRect plotRect = rect().adjusted(MARGIN, 10, -10, -20);
+    painter.setPen(Qt::darkGray);
+    painter.drawRect(plotRect);
+
+    qint64 to = buffer.getCount();
+    qint64 from = qMax(buffer.getFirstIndex(), to - visibleSamples);
+    qint64 samples = to - from;
+    int width = plotRect.width();
+
+    if(samples <= 1 || width <= 1 || buffer.getColumnCount() == 0){
+        painter.drawText(plotRect, Qt::AlignCenter, "Waiting for numeric telemetry...");
+        return;
+    }
+
+    //Scale to the range of every column in the visible window, using the block summaries
+    double yMin = 0, yMax = 0;
+    bool haveRange = false;
+    for(int c = 0; c < buffer.getColumnCount(); c++){
+        double min, max;
+        if(buffer.minMax(c, from, to, &min, &max)){
+            yMin = haveRange ? qMin(yMin, min) : min;
+            yMax = haveRange ? qMax(yMax, max) : max;
+            haveRange = true;
+        }
+    }
+
+    if(!haveRange){
+        return;
+    }
+    if(yMax - yMin < 1e-12){
+        yMin -= 1;
+        yMax += 1;
+    }
+
+    const double yScale = plotRect.height() / (yMax - yMin);
+    auto toY = [&](double v){
+        return plotRect.bottom() - (v - yMin) * yScale;
+    };
+
+    QVector<QLineF> lines;
+    lines.reserve(width * 2);
+
+    for(int c = 0; c < buffer.getColumnCount(); c++){
+        lines.clear();
+
+        if(samples <= width){
+            //Fewer samples than pixels: connect the samples directly
+            const double xStep = static_cast<double>(width) / (samples - 1);
+            QPointF previous;
+            bool havePrevious = false;
+
+            for(qint64 i = from; i < to; i++){
+                double v = buffer.value(c, i);
+                if(v != v){     //NaN breaks the line
+                    havePrevious = false;
+                    continue;
+                }
+
+                QPointF point(plotRect.left() + (i - from) * xStep, toY(v));
+                if(havePrevious){
+                    lines.append(QLineF(previous, point));
+                }
+                previous = point;
+                havePrevious = true;
+            }
+        }
+        else{
+            //Per pixel min/max decimation
+            double previousMin = 0, previousMax = 0;
+            bool havePrevious = false;
+
+            for(int x = 0; x < width; x++){
+                qint64 a = from + samples * x / width;
+                qint64 b = from + samples * (x + 1) / width;
+
+                double min, max;
+                if(!buffer.minMax(c, a, b, &min, &max)){
+                    havePrevious = false;
+                    continue;
+                }
+
+                //Join to the previous column so steep edges stay connected
+                double low = min, high = max;
+                if(havePrevious){
+                    low = qMin(low, previousMax);
+                    high = qMax(high, previousMin);
+                }
+
+                double px = plotRect.left() + x;
+                lines.append(QLineF(px, toY(low), px, toY(high)));
+
+                previousMin = min;
+                previousMax = max;
+                havePrevious = true;
+            }
+        }
+
+        painter.setPen(columnColor(c));
+        painter.drawLines(lines);
+    }
+
+    //Axis labels and legend
+    painter.setPen(Qt::lightGray);
+    painter.drawText(QRect(0, plotRect.top(), MARGIN - 4, 20), Qt::AlignRight | Qt::AlignTop, QString::number(yMax, 'g', 4));
+    painter.drawText(QRect(0, plotRect.bottom() - 20, MARGIN - 4, 20), Qt::AlignRight | Qt::AlignBottom, QString::number(yMin, 'g', 4));
+    painter.drawText(QRect(plotRect.left(), plotRect.bottom() + 2, plotRect.width(), 18), Qt::AlignLeft,
+                     QString("%1 samples (%2 stored)").arg(samples).arg(to - buffer.getFirstIndex()));
+
+    int legendY = plotRect.top() + 4;
+    for(int c = 0; c < buffer.getColumnCount(); c++){
+        QString name = c < fieldNames.size() ? fieldNames.at(c) : QString("Field %1").arg(c + 1);
+        painter.setPen(columnColor(c));
+        painter.drawText(plotRect.left() + 6, legendY + 12, QString("%1: %2").arg(name).arg(buffer.value(c, to - 1), 0, 'g', 6));
+        legendY += 14;
+    }
+}
+
+QColor PlotWidget::columnColor(int column)
+{
+    const static QColor colors[] = {
+        QColor(0x4F, 0xC3, 0xF7), QColor(0xFF, 0xD5, 0x4F), QColor(0x81, 0xC7, 0x84), QColor(0xE5, 0x73, 0x73),
+        QColor(0xBA, 0x68, 0xC8), QColor(0xFF, 0xB7, 0x4D), QColor(0x4D, 0xB6, 0xAC), QColor(0xF0, 0x62, 0x92),
+    };
+
+    return colors[column % 8];
+}
@@ -0,0 +1,60 @@
+#ifndef PLOTWIDGET_H
+#define PLOTWIDGET_H
+
+/*
+ * Live telemetry plot
+ *
+ * Parses numeric fields out of the received lines (see TelemetryParser), stores them in a
+ * bounded columnar ring buffer (see TelemetryBuffer) and plots the most recent samples.
+ *
+ * When there are more samples than pixels, every pixel column is drawn as a vertical
+ * min/max span of the samples it covers, so spikes are never lost and the drawing cost
+ * depends on the widget width rather than on the number of samples.
+ *
+ * Repaints are limited to REFRESH_INTERVAL_MS no matter how fast data arrives.
+ * The mouse wheel zooms the visible window in and out.
+ */
+
+#include "TelemetryParser.h"
+#include "TelemetryBuffer.h"
+
+#include <QWidget>
+#include <QTimer>
+
+class PlotWidget : public QWidget
+{
+    Q_OBJECT
+public:
+    explicit PlotWidget(QWidget *parent = nullptr);
+
+    void setVisibleSamples(qint64 samples);
+    qint64 getVisibleSamples();
+
+public slots:
+    void feed(QByteArray data);
+    void clearPlot();
+
+protected:
+    void paintEvent(QPaintEvent *event) override;
+    void wheelEvent(QWheelEvent *event) override;
+
+private:
+    static const int REFRESH_INTERVAL_MS = 33;
+    static const int MARGIN = 40;
+
+    TelemetryParser *parser = nullptr;
+    TelemetryBuffer buffer;
+    QTimer *refreshTimer = nullptr;
+    QStringList fieldNames;
+    qint64 visibleSamples = 10000;
+    bool dirty = false;
+
+    static QColor columnColor(int column);
+
+private slots:
+    void handleRow(qint64 timestamp, bool incoming, QVector<double> values, QList<QByteArray> fields);
+    void handleFieldNames(QStringList names);
+    void refresh();
+};
+
+#endif // PLOTWIDGET_H
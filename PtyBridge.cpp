@@ -0,0 +1,304 @@
+#include "PtyBridge.h"
+
+#include <QDebug>
+#include <QTimer>
+
+#ifdef Q_OS_UNIX
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+#endif
+
+PtyBridge::PtyBridge(Bluetooth *bluetooth, QObject *parent) : QObject(parent)
+{
+    this->bluetooth = bluetooth;
+}
+
+PtyBridge::~PtyBridge()
+{
+    closePty();
+}
+
+bool PtyBridge::start(QString *error)
+{
+    if(isRunning()){
+        return true;
+    }
+
+#ifdef Q_OS_UNIX
+    masterFd = posix_openpt(O_RDWR | O_NOCTTY);
+    if(masterFd < 0 || grantpt(masterFd) != 0 || unlockpt(masterFd) != 0){
+        if(error){
+            *error = QString("Could not create a pseudo-terminal: %1").arg(strerror(errno));
+        }
+        closePty();
+        return false;
+    }
+
+    devicePath = QString::fromLocal8Bit(ptsname(masterFd));
+
+    //Raw mode on the slave side: no echo, no line editing, no newline translation
+    slaveFd = ::open(ptsname(masterFd), O_RDWR | O_NOCTTY);
+    struct termios settings;
+    if(slaveFd < 0 || tcgetattr(slaveFd, &settings) != 0){
+        if(error){
+            *error = QString("Could not open %1: %2").arg(devicePath).arg(strerror(errno));
+        }
+        closePty();
+        return false;
+    }
+    cfmakeraw(&settings);
+    tcsetattr(slaveFd, TCSANOW, &settings);
+
+    fcntl(masterFd, F_SETFL, fcntl(masterFd, F_GETFL) | O_NONBLOCK);
+
+    readNotifier = new QSocketNotifier(masterFd, QSocketNotifier::Read, this);
+    connect(readNotifier, SIGNAL(activated(int)), this, SLOT(handleReadable()));
+
+    writeNotifier = new QSocketNotifier(masterFd, QSocketNotifier::Write, this);
+    writeNotifier->setEnabled(false);
+    connect(writeNotifier, SIGNAL(activated(int)), this, SLOT(handleWritable()));
+
+    connect(bluetooth, SIGNAL(dataReceived(QByteArray)), this, SLOT(handleData(QByteArray)));
+
+    stats = Statistics();
+    stats.linkRoundTripMs = linkRoundTripMs;
+    sentReads.clear();
+    clock.start();
+
+    qDebug() << "PtyBridge: bridging" << devicePath;
+    return true;
+#else
+    if(error){
+        *error = "Pseudo-terminals are not supported on this platform";
+    }
+    return false;
+#endif
+}
+
+void PtyBridge::stop()
+{
+    if(!isRunning()){
+        return;
+    }
+
+    disconnect(bluetooth, SIGNAL(dataReceived(QByteArray)), this, SLOT(handleData(QByteArray)));
+    stats.elapsedMs = clock.elapsed();
+    closePty();
+
+    qDebug() << "PtyBridge: stopped";
+    emit stopped(stats.toString());
+}
+
+void PtyBridge::measureRoundTrip(double linkRoundTripMs)
+{
+    this->linkRoundTripMs = linkRoundTripMs;
+}
+
+bool PtyBridge::isRunning()
+{
+    return masterFd >= 0;
+}
+
+QString PtyBridge::getDevicePath()
+{
+    return this->devicePath;
+}
+
+PtyBridge::Statistics PtyBridge::getStatistics()
+{
+    Statistics current = stats;
+    if(isRunning()){
+        current.elapsedMs = clock.elapsed();
+    }
+    return current;
+}
+
+//Device -> PTY. Written straight from the notification, only the remainder is queued.
+void PtyBridge::handleData(QByteArray data)
+{
+#ifdef Q_OS_UNIX
+    const qint64 arrivedNs = clock.nsecsElapsed();
+    const char *bytes = data.constData();
+    qint64 size = data.size();
+
+    if(pending.isEmpty()){
+        ssize_t written = ::write(masterFd, bytes, static_cast<size_t>(size));
+        if(written < 0){
+            written = 0;
+        }
+
+        stats.bytesToPty += written;
+        recordRoundTrips();
+        if(written == size){
+            recordRxLatency(arrivedNs);
+            return;
+        }
+
+        bytes += written;
+        size -= written;
+    }
+
+    //Nobody is reading the PTY. Keep the backlog bounded rather than growing without limit.
+    if(pending.size() + size > MAX_PENDING_BYTES){
+        stats.droppedBytes += size;
+        return;
+    }
+
+    if(pending.isEmpty()){
+        pendingSinceNs = arrivedNs;
+    }
+    pending.append(bytes, size);
+    stats.queuedBytesMax = qMax(stats.queuedBytesMax, pending.size());
+    writeNotifier->setEnabled(true);
+#else
+    Q_UNUSED(data);
+#endif
+}
+
+//PTY -> device
+void PtyBridge::handleReadable()
+{
+#ifdef Q_OS_UNIX
+    const qint64 readableNs = clock.nsecsElapsed();
+
+    ssize_t count = ::read(masterFd, readBuffer, sizeof(readBuffer));
+    if(count <= 0){
+        if(count < 0 && errno != EAGAIN && errno != EINTR){
+            qDebug() << "PtyBridge: read failed:" << strerror(errno);
+
+            //Not from inside the notifier's own slot, stopping deletes it and reports to the user
+            readNotifier->setEnabled(false);
+            QTimer::singleShot(0, this, SLOT(stop()));
+        }
+        return;
+    }
+
+    const int maxWrite = bluetooth->getMaxWriteSize();
+    for(ssize_t i = 0; i < count; i += maxWrite){
+        bluetooth->write(QByteArray(readBuffer + i, static_cast<int>(qMin<ssize_t>(maxWrite, count - i))));
+    }
+
+    qint64 latency = clock.nsecsElapsed() - readableNs;
+    stats.bytesFromPty += count;
+
+    //Expect the read back once every byte sent before it has come back as well
+    if(linkRoundTripMs >= 0 && sentReads.size() < MAX_ROUND_TRIPS){
+        sentReads.enqueue(SentRead{stats.bytesFromPty, readableNs});
+    }
+
+    stats.txLatencyCount++;
+    stats.txLatencyTotalNs += latency;
+    stats.txLatencyMaxNs = qMax(stats.txLatencyMaxNs, latency);
+#endif
+}
+
+//Drain the backlog in place, straight out of the pooled chunks
+void PtyBridge::handleWritable()
+{
+#ifdef Q_OS_UNIX
+    while(!pending.isEmpty()){
+        qint64 size = 0;
+        const char *data = pending.front(&size);
+
+        ssize_t written = ::write(masterFd, data, static_cast<size_t>(size));
+        if(written <= 0){
+            break;
+        }
+
+        pending.consume(written);
+        stats.bytesToPty += written;
+        recordRoundTrips();
+    }
+
+    if(pending.isEmpty()){
+        writeNotifier->setEnabled(false);
+        recordRxLatency(pendingSinceNs);
+    }
+#endif
+}
+
+void PtyBridge::recordRxLatency(qint64 arrivedNs)
+{
+    qint64 latency = clock.nsecsElapsed() - arrivedNs;
+    stats.rxLatencyCount++;
+    stats.rxLatencyTotalNs += latency;
+    stats.rxLatencyMaxNs = qMax(stats.rxLatencyMaxNs, latency);
+}
+
+//Echoed bytes are back in the PTY, in the order they were sent
+void PtyBridge::recordRoundTrips()
+{
+    while(!sentReads.isEmpty() && stats.bytesToPty >= sentReads.head().echoedAt){
+        qint64 roundTrip = clock.nsecsElapsed() - sentReads.dequeue().readableNs;
+        stats.roundTripCount++;
+        stats.roundTripTotalNs += roundTrip;
+        stats.roundTripMaxNs = qMax(stats.roundTripMaxNs, roundTrip);
+    }
+}
+
+//May be called from the notifiers' own slots, so they are deleted later
+void PtyBridge::closePty()
+{
+    if(readNotifier){
+        readNotifier->setEnabled(false);
+        readNotifier->deleteLater();
+        readNotifier = nullptr;
+    }
+    if(writeNotifier){
+        writeNotifier->setEnabled(false);
+        writeNotifier->deleteLater();
+        writeNotifier = nullptr;
+    }
+    pending.clear();
+    sentReads.clear();
+
+#ifdef Q_OS_UNIX
+    if(slaveFd >= 0){
+        ::close(slaveFd);
+    }
+    if(masterFd >= 0){
+        ::close(masterFd);
+    }
+#endif
+
+    slaveFd = -1;
+    masterFd = -1;
+}
+
+QString PtyBridge::Statistics::toString() const
+{
+    double seconds = qMax<qint64>(1, elapsedMs) / 1000.0;
+
+    QString str;
+    str += QString("Duration: %1 ms\n").arg(elapsedMs);
+    str += QString("Device -> PTY: %1 bytes (%2 bytes/s), dropped: %3, max backlog: %4 bytes\n")
+            .arg(bytesToPty).arg(bytesToPty / seconds, 0, 'f', 1).arg(droppedBytes).arg(queuedBytesMax);
+    str += QString("PTY -> device: %1 bytes (%2 bytes/s)\n").arg(bytesFromPty).arg(bytesFromPty / seconds, 0, 'f', 1);
+    str += QString("Bridge processing, device -> PTY mean/max: %1/%2 us\n")
+            .arg(rxLatencyCount ? rxLatencyTotalNs / 1000.0 / rxLatencyCount : 0, 0, 'f', 1)
+            .arg(rxLatencyMaxNs / 1000.0, 0, 'f', 1);
+    str += QString("Bridge processing, PTY -> device mean/max: %1/%2 us\n")
+            .arg(txLatencyCount ? txLatencyTotalNs / 1000.0 / txLatencyCount : 0, 0, 'f', 1)
+            .arg(txLatencyMaxNs / 1000.0, 0, 'f', 1);
+
+    if(linkRoundTripMs < 0){
+        str += "End to end latency not measured (run the loopback stress test on this link first)";
+    }
+    else if(roundTripCount == 0){
+        str += "End to end latency not measured (nothing sent through the PTY was echoed back)";
+    }
+    else{
+        double meanMs = roundTripTotalNs / 1e6 / roundTripCount;
+        str += QString("Round trip PTY -> device -> PTY mean/max: %1/%2 ms\n")
+                .arg(meanMs, 0, 'f', 2)
+                .arg(roundTripMaxNs / 1e6, 0, 'f', 2);
+        str += QString("Link round trip: %1 ms, added by the bridge: %2 ms")
+                .arg(linkRoundTripMs, 0, 'f', 2)
+                .arg(meanMs - linkRoundTripMs, 0, 'f', 2);
+    }
+    return str;
+}
@@ -0,0 +1,119 @@
+#ifndef PTYBRIDGE_H
+#define PTYBRIDGE_H
+
+/*
+ * Pseudo-terminal bridge (Linux and other unix systems)
+ *
+ * Creates a PTY and shuttles bytes between it and the Bluetooth UART, so tools that expect a
+ * serial port (screen, minicom, pyserial, ...) can open the slave device (e.g. /dev/pts/3)
+ * as if the UART friend were a COM port.
+ *
+ * Both directions are event driven through QSocketNotifier, nothing is polled:
+ *  - Device -> PTY: received notifications are written straight from Qt's buffer into the
+ *    PTY. Only what the PTY cannot take right away is queued (in pooled chunks) until it is
+ *    writable again.
+ *  - PTY -> device: data is read when the PTY becomes readable and sent in MTU sized writes.
+ *
+ * The bridge counts the bytes moved each way and the time it spends on the data: from a
+ * notification arriving to its bytes being in the PTY, and from the PTY becoming readable to
+ * the data being handed to Bluetooth::write(). That leaves out the transmit queue and the link.
+ *
+ * The latency a serial tool actually sees is measured end to end when the link echoes what is
+ * sent (the loopback transport, or a device running echo firmware as for the stress test): from
+ * the PTY becoming readable to the echoed bytes being back in the PTY. Compared with the link's
+ * own round trip (e.g. the median of a stress test on the same link) this gives the latency the
+ * bridge adds.
+ *
+ * On platforms without PTYs start() fails.
+ */
+
+#include "Bluetooth.h"
+#include "BufferPool.h"
+
+#include <QObject>
+#include <QSocketNotifier>
+#include <QElapsedTimer>
+#include <QQueue>
+
+class PtyBridge : public QObject
+{
+    Q_OBJECT
+public:
+    explicit PtyBridge(Bluetooth *bluetooth, QObject *parent = nullptr);
+    ~PtyBridge();
+
+    struct Statistics{
+        qint64 bytesToPty       = 0;
+        qint64 bytesFromPty     = 0;
+        qint64 elapsedMs        = 0;
+        qint64 rxLatencyCount   = 0;    //Notifications fully written to the PTY
+        qint64 rxLatencyTotalNs = 0;
+        qint64 rxLatencyMaxNs   = 0;
+        qint64 txLatencyCount   = 0;    //Reads from the PTY
+        qint64 txLatencyTotalNs = 0;
+        qint64 txLatencyMaxNs   = 0;
+        qint64 queuedBytesMax   = 0;    //Largest backlog waiting for the PTY to drain
+        qint64 droppedBytes     = 0;    //Received while the backlog was full
+        qint64 roundTripCount   = 0;    //Reads from the PTY echoed back into it
+        qint64 roundTripTotalNs = 0;
+        qint64 roundTripMaxNs   = 0;
+        double linkRoundTripMs  = -1;   //The link alone, -1 if not known
+
+        QString toString() const;
+    };
+
+    bool start(QString *error = nullptr);
+    bool isRunning();
+
+    //The link echoes everything sent, taking linkRoundTripMs without the bridge. Set before start().
+    void measureRoundTrip(double linkRoundTripMs);
+
+    QString getDevicePath();
+    Statistics getStatistics();
+
+signals:
+    void stopped(QString report);
+
+public slots:
+    void stop();
+
+private:
+    static const int READ_BUFFER_SIZE = 4096;
+    static const int MAX_PENDING_BYTES = 1024 * 1024;
+    static const int MAX_ROUND_TRIPS = 256;
+
+    struct SentRead{
+        qint64 echoedAt;                    //bytesToPty once the read is back in the PTY
+        qint64 readableNs;
+    };
+
+    Bluetooth *bluetooth            = nullptr;
+    int masterFd                    = -1;
+    int slaveFd                     = -1;   //Kept open so the PTY survives clients closing it
+    QString devicePath;
+
+    QSocketNotifier *readNotifier   = nullptr;
+    QSocketNotifier *writeNotifier  = nullptr;
+
+    BufferPool pool;
+    ChunkQueue pending{&pool};              //Received data the PTY could not take yet
+    qint64 pendingSinceNs           = 0;    //When the oldest pending data arrived
+
+    QElapsedTimer clock;
+    Statistics stats;
+    char readBuffer[READ_BUFFER_SIZE];
+
+    double linkRoundTripMs          = -1;   //Measure round trips when set
+    QQueue<SentRead> sentReads;             //Reads from the PTY waiting for their echo
+
+    void recordRxLatency(qint64 arrivedNs);
+    void recordRoundTrips();
+    void closePty();
+
+private slots:
+    void handleData(QByteArray data);
+    void handleReadable();
+    void handleWritable();
+};
+
+#endif // PTYBRIDGE_H
@@ -0,0 +1,131 @@
+#include "ScrollbackText.h"
+
+#include <algorithm>
+
+ScrollbackText::ScrollbackText()
+{
+}
+
+int ScrollbackText::size() const
+{
+    return tailStart + tail.size();
+}
+
+bool ScrollbackText::isEmpty() const
+{
+    return size() == 0;
+}
+
+void ScrollbackText::append(const QString &text)
+{
+    tail.append(text);
+}
+
+//The text so far becomes a block of its own. Nothing is copied.
+void ScrollbackText::seal()
+{
+    if(tail.isEmpty()){
+        return;
+    }
+
+    blocks.append(tail);
+    blockStarts.append(tailStart);
+    tailStart += tail.size();
+    tail = QString();
+}
+
+void ScrollbackText::clear()
+{
+    blocks.clear();
+    blockStarts.clear();
+    tail.clear();
+    tailStart = 0;
+}
+
+QChar ScrollbackText::at(int position) const
+{
+    int index = blockIndex(position);
+    return block(index).at(position - blockStart(index));
+}
+
+QString ScrollbackText::mid(int position, int length) const
+{
+    position = qMax(0, position);
+    int end = (length < 0 || length > size() - position) ? size() : position + length;
+    if(position >= end){
+        return QString();
+    }
+
+    QString text;
+    text.reserve(end - position);
+
+    for(int index = blockIndex(position); index < blockCount() && blockStart(index) < end; index++){
+        int start = blockStart(index);
+        const QString &part = block(index);
+        int from = qMax(position, start);
+        int to = qMin(end, start + part.size());
+        text.append(part.constData() + (from - start), to - from);
+    }
+
+    return text;
+}
+
+QStringRef ScrollbackText::midRef(int position, int length, QString *scratch) const
+{
+    int index = blockIndex(position);
+    int start = blockStart(index);
+    const QString &part = block(index);
+
+    if(position + length <= start + part.size()){
+        return QStringRef(&part, position - start, length);
+    }
+
+    *scratch = mid(position, length);
+    return QStringRef(scratch);
+}
+
+//Same as QString::lastIndexOf(c, from), a negative from counts back from the end
+int ScrollbackText::lastIndexOf(QChar c, int from) const
+{
+    if(from < 0){
+        from += size();
+    }
+    from = qMin(from, size() - 1);
+
+    for(int index = blockIndex(from); from >= 0 && index >= 0; index--){
+        int start = blockStart(index);
+        int found = block(index).lastIndexOf(c, from - start);
+        if(found >= 0){
+            return start + found;
+        }
+        from = start - 1;
+    }
+
+    return -1;
+}
+
+int ScrollbackText::blockCount() const
+{
+    return blocks.size() + 1;
+}
+
+const QString &ScrollbackText::block(int index) const
+{
+    return index < blocks.size() ? blocks.at(index) : tail;
+}
+
+//The block containing position, the tail from its start on
+int ScrollbackText::blockIndex(int position) const
+{
+    if(position >= tailStart){
+        return blocks.size();
+    }
+
+    auto next = std::upper_bound(blockStarts.constBegin(), blockStarts.constEnd(), position);
+    return qMax(0, static_cast<int>(next - blockStarts.constBegin()) - 1);
+}
+
+int ScrollbackText::blockStart(int index) const
+{
+    return index < blocks.size() ? blockStarts.at(index) : tailStart;
+}
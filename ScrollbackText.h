@@ -0,0 +1,54 @@
+#ifndef SCROLLBACKTEXT_H
+#define SCROLLBACKTEXT_H
+
+/*
+ * Terminal scrollback text
+ *
+ * Append only text kept as a list of sealed blocks followed by the tail being appended to. A
+ * sealed block is never modified again, so copying the scrollback (see Terminal::getSnapshot)
+ * only shares the blocks: seal() first, and the terminal's next append starts a new tail
+ * instead of detaching, and deep copying, the text a snapshot is still reading.
+ *
+ * Offsets are UTF-16 code units from the start of the scrollback, as with a plain QString.
+ * Text read within one block is referred to, text spanning blocks is copied.
+ */
+
+#include <QString>
+#include <QStringRef>
+#include <QVector>
+
+class ScrollbackText
+{
+public:
+    ScrollbackText();
+
+    int size() const;
+    bool isEmpty() const;
+
+    void append(const QString &text);
+    void seal();
+    void clear();
+
+    QChar at(int position) const;
+    QString mid(int position, int length = -1) const;
+    int lastIndexOf(QChar c, int from = -1) const;
+
+    //[position, position + length) without copying it when it lies in one block. Otherwise
+    //the text is copied into scratch. Valid until the scrollback or scratch is next modified.
+    QStringRef midRef(int position, int length, QString *scratch) const;
+
+    //The sealed blocks in order, then the tail (which may be empty)
+    int blockCount() const;
+    const QString &block(int index) const;
+
+private:
+    QVector<QString> blocks;
+    QVector<int> blockStarts;
+    QString tail;
+    int tailStart       = 0;
+
+    int blockIndex(int position) const;
+    int blockStart(int index) const;
+};
+
+#endif // SCROLLBACKTEXT_H
@@ -0,0 +1,319 @@
+#include "SearchDialog.h"
+
+#include <QLineEdit>
+#include <QComboBox>
+#include <QPushButton>
+#include <QListWidget>
+#include <QLabel>
+#include <QTextEdit>
+#include <QCheckBox>
+#include <QVBoxLayout>
+#include <QHBoxLayout>
+#include <QFileDialog>
+#include <QElapsedTimer>
+#include <QTextCursor>
+#include <QDebug>
+
+SearchDialog::SearchDialog(Terminal *terminal, QWidget *parent) : QDialog(parent)
+{
+    this->terminal = terminal;
+    this->setWindowTitle("Search");
+    this->resize(600, 500);
+
+    scopeBox = new QComboBox(this);
+    scopeBox->addItem("Terminal scrollback");
+    scopeBox->addItem("Capture file");
+    browseButton = new QPushButton("Open Capture...", this);
+
+    queryInput = new QLineEdit(this);
+    queryInput->setPlaceholderText("Search text (case insensitive)");
+    searchButton = new QPushButton("Search", this);
+    searchButton->setDefault(true);
+
+    resultList = new QListWidget(this);
+    statusLabel = new QLabel(this);
+
+    hexPreviewCheck = new QCheckBox("Preview In Hex", this);
+    preview = new QTextEdit(this);
+    preview->setReadOnly(true);
+    preview->setUndoRedoEnabled(false);
+    preview->setStyleSheet("background-color: black; color: white;");
+
+    QHBoxLayout *scopeLayout = new QHBoxLayout();
+    scopeLayout->addWidget(scopeBox, 1);
+    scopeLayout->addWidget(browseButton);
+
+    QHBoxLayout *queryLayout = new QHBoxLayout();
+    queryLayout->addWidget(queryInput, 1);
+    queryLayout->addWidget(searchButton);
+
+    QVBoxLayout *layout = new QVBoxLayout(this);
+    layout->addLayout(scopeLayout);
+    layout->addLayout(queryLayout);
+    layout->addWidget(resultList, 1);
+    layout->addWidget(statusLabel);
+    layout->addWidget(hexPreviewCheck);
+    layout->addWidget(preview, 1);
+
+    connect(searchButton, SIGNAL(released()), this, SLOT(search()));
+    connect(queryInput, SIGNAL(returnPressed()), this, SLOT(search()));
+    connect(browseButton, SIGNAL(released()), this, SLOT(browseCaptureFile()));
+    connect(resultList, SIGNAL(itemActivated(QListWidgetItem*)), this, SLOT(openResult(QListWidgetItem*)));
+    connect(scopeBox, SIGNAL(currentIndexChanged(int)), this, SLOT(handleScopeChange(int)));
+    connect(hexPreviewCheck, SIGNAL(toggled(bool)), this, SLOT(handleHexPreviewToggled(bool)));
+
+    handleScopeChange(SCROLLBACK);
+}
+
+SearchDialog::~SearchDialog()
+{
+    closeCaptureFile();
+}
+
+void SearchDialog::search()
+{
+    QString query = queryInput->text();
+    resultList->clear();
+
+    if(query.isEmpty()){
+        statusLabel->clear();
+        return;
+    }
+
+    if(scopeBox->currentIndex() == SCROLLBACK){
+        searchScrollback(query);
+    }
+    else{
+        searchCaptureFile(query);
+    }
+}
+
+void SearchDialog::searchScrollback(QString query)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    QVector<SearchIndex::Range> matches = terminal->search(query, MAX_RESULTS);
+    qint64 elapsed = timer.nsecsElapsed();
+
+    for(const SearchIndex::Range &match : matches){
+        qint64 line = terminal->lineOfOffset(match.first);
+
+        QListWidgetItem *item = new QListWidgetItem(QString("Line %1: %2").arg(line + 1).arg(terminal->lineText(match.first, LINE_TEXT_CHARS)));
+        item->setData(Qt::UserRole, match.first);
+        item->setData(Qt::UserRole + 1, match.second);
+        resultList->addItem(item);
+    }
+
+    statusLabel->setText(QString("%1 result(s) in %2 ms").arg(matches.size()).arg(elapsed / 1e6, 0, 'f', 2));
+}
+
+void SearchDialog::searchCaptureFile(QString query)
+{
+    if(!captureFile || !updateCaptureIndex()){
+        statusLabel->setText("No capture file open");
+        return;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    //Logs and exports are written as UTF-8
+    QByteArray folded = SearchIndex::foldCase(query.toUtf8());
+    const char *data = reinterpret_cast<const char *>(captureData);
+    int count = 0;
+
+    for(const SearchIndex::Range &range : captureIndex.candidateRanges(folded)){
+        qint64 index = SearchIndex::find(data + range.first, range.second, folded);
+
+        while(index >= 0 && count < MAX_RESULTS){
+            qint64 offset = range.first + index;
+            qint64 line = captureIndex.lineOfOffset(offset);
+
+            QListWidgetItem *item = new QListWidgetItem(QString("Line %1: %2").arg(line + 1).arg(captureLineText(offset)));
+            item->setData(Qt::UserRole, offset);
+            item->setData(Qt::UserRole + 1, folded.size());
+            resultList->addItem(item);
+            count++;
+
+            index = SearchIndex::find(data + range.first, range.second, folded, index + 1);
+        }
+    }
+
+    qint64 elapsed = timer.nsecsElapsed();
+    statusLabel->setText(QString("%1 result(s) in %2 ms (%3 MB indexed)")
+                         .arg(count)
+                         .arg(elapsed / 1e6, 0, 'f', 2)
+                         .arg(captureSize / (1024.0 * 1024.0), 0, 'f', 1));
+}
+
+//The part of the match's line around it, as Terminal::lineText() does for the scrollback
+QString SearchDialog::captureLineText(qint64 offset)
+{
+    qint64 line = captureIndex.lineOfOffset(offset);
+    qint64 start = qMax(captureIndex.lineStart(line), offset - LINE_TEXT_CHARS / 4);
+    qint64 end = qMin(captureIndex.lineStart(line + 1), start + LINE_TEXT_CHARS);
+
+    QString text = QString::fromUtf8(reinterpret_cast<const char *>(captureData) + start, static_cast<int>(end - start));
+    text.remove('\r');
+    text.remove('\n');
+    return text;
+}
+
+void SearchDialog::browseCaptureFile()
+{
+    QString path = QFileDialog::getOpenFileName(this, "Open Capture File", QString(),
+                                                "Text Files (*.txt);;CSV Files (*.csv);;All Files (*.*)");
+    if(path.isEmpty()){
+        return;
+    }
+
+    if(openCaptureFile(path)){
+        scopeBox->setCurrentIndex(CAPTURE_FILE);
+        statusLabel->setText(QString("Indexed %1 (%2 MB)").arg(path).arg(captureSize / (1024.0 * 1024.0), 0, 'f', 1));
+    }
+    else{
+        statusLabel->setText(QString("Could not open %1").arg(path));
+    }
+}
+
+bool SearchDialog::openCaptureFile(QString path)
+{
+    closeCaptureFile();
+
+    captureFile = new QFile(path);
+    if(!captureFile->open(QIODevice::ReadOnly)){
+        closeCaptureFile();
+        return false;
+    }
+
+    return updateCaptureIndex();
+}
+
+void SearchDialog::closeCaptureFile()
+{
+    if(captureFile){
+        if(captureData){
+            captureFile->unmap(captureData);
+        }
+        captureFile->close();
+        delete captureFile;
+    }
+
+    captureFile = nullptr;
+    captureData = nullptr;
+    captureSize = 0;
+    captureIndex.clear();
+    previewOffset = -1;
+}
+
+//Map the capture file and index whatever was appended since the last search
+bool SearchDialog::updateCaptureIndex()
+{
+    qint64 size = captureFile->size();
+    if(captureData && size == captureSize){
+        return true;
+    }
+
+    if(captureData){
+        captureFile->unmap(captureData);
+        captureData = nullptr;
+    }
+
+    //A file that shrank was rewritten, start over
+    if(size < captureIndex.size()){
+        captureIndex.clear();
+    }
+
+    captureSize = 0;
+    if(size == 0){
+        return true;
+    }
+
+    captureData = captureFile->map(0, size);
+    if(!captureData){
+        qDebug() << "SearchDialog: could not map" << captureFile->fileName();
+        return false;
+    }
+    captureSize = size;
+
+    qint64 indexed = captureIndex.size();
+    captureIndex.append(reinterpret_cast<const char *>(captureData) + indexed, size - indexed);
+
+    return true;
+}
+
+void SearchDialog::openResult(QListWidgetItem *item)
+{
+    qint64 offset = item->data(Qt::UserRole).toLongLong();
+    qint64 length = item->data(Qt::UserRole + 1).toLongLong();
+
+    if(scopeBox->currentIndex() == SCROLLBACK){
+        terminal->showMatch(offset, length);
+    }
+    else{
+        previewOffset = offset;
+        previewLength = length;
+        showPreview();
+    }
+}
+
+//Show the bytes around the selected capture file match with the match selected
+void SearchDialog::showPreview()
+{
+    if(!captureData || previewOffset < 0 || previewOffset + previewLength > captureSize){
+        preview->clear();
+        return;
+    }
+
+    const static std::string asciiLookup = "0123456789ABCDEF";
+    bool hex = hexPreviewCheck->isChecked();
+
+    qint64 start = qMax(Q_INT64_C(0), previewOffset - PREVIEW_CONTEXT);
+    qint64 end = qMin(captureSize, previewOffset + previewLength + PREVIEW_CONTEXT);
+    const char *data = reinterpret_cast<const char *>(captureData);
+
+    QString text;
+    int selectionStart = static_cast<int>((previewOffset - start) * 3);
+    int selectionEnd = static_cast<int>((previewOffset - start + previewLength) * 3 - 1);
+    if(hex){
+        text.reserve(static_cast<int>((end - start) * 3));
+        for(qint64 i = start; i < end; i++){
+            uchar c = static_cast<uchar>(data[i]);
+            text += asciiLookup[(c & 0xF0) >> 4];
+            text += asciiLookup[c & 0x0F];
+            text += ' ';
+        }
+    }
+    else{
+        //Decoded as UTF-8 like the result list. The match is decoded on its own, so the selection
+        //is found in characters rather than bytes.
+        QString before = QString::fromUtf8(data + start, static_cast<int>(previewOffset - start));
+        QString match = QString::fromUtf8(data + previewOffset, static_cast<int>(previewLength));
+        text = before + match + QString::fromUtf8(data + previewOffset + previewLength, static_cast<int>(end - previewOffset - previewLength));
+        selectionStart = before.size();
+        selectionEnd = before.size() + match.size();
+    }
+
+    preview->setPlainText(text);
+
+    QTextCursor cursor(preview->document());
+    cursor.setPosition(selectionStart);
+    cursor.setPosition(selectionEnd, QTextCursor::KeepAnchor);
+    preview->setTextCursor(cursor);
+    preview->ensureCursorVisible();
+}
+
+void SearchDialog::handleScopeChange(int index)
+{
+    bool captureScope = index == CAPTURE_FILE;
+    hexPreviewCheck->setVisible(captureScope);
+    preview->setVisible(captureScope);
+    resultList->clear();
+    statusLabel->clear();
+}
+
+void SearchDialog::handleHexPreviewToggled(bool)
+{
+    showPreview();
+}
@@ -0,0 +1,82 @@
+#ifndef SEARCHDIALOG_H
+#define SEARCHDIALOG_H
+
+/*
+ * Search dialog
+ *
+ * Searches the terminal scrollback or a saved capture file using a SearchIndex.
+ *
+ * Scrollback results select the match in the terminal (in whichever display mode it is in).
+ * Capture files are memory mapped and indexed once; when the file grows only the new part
+ * is indexed. Their results are shown in a preview pane around the match, as text or hex.
+ */
+
+#include "Terminal.h"
+#include "SearchIndex.h"
+
+#include <QDialog>
+#include <QFile>
+
+class QLineEdit;
+class QComboBox;
+class QPushButton;
+class QListWidget;
+class QListWidgetItem;
+class QLabel;
+class QTextEdit;
+class QCheckBox;
+
+class SearchDialog : public QDialog
+{
+    Q_OBJECT
+public:
+    explicit SearchDialog(Terminal *terminal, QWidget *parent = nullptr);
+    ~SearchDialog();
+
+private:
+    enum Scope{
+        SCROLLBACK,
+        CAPTURE_FILE,
+    };
+
+    Terminal *terminal          = nullptr;
+    QLineEdit *queryInput       = nullptr;
+    QComboBox *scopeBox         = nullptr;
+    QPushButton *searchButton   = nullptr;
+    QPushButton *browseButton   = nullptr;
+    QListWidget *resultList     = nullptr;
+    QLabel *statusLabel         = nullptr;
+    QTextEdit *preview          = nullptr;
+    QCheckBox *hexPreviewCheck  = nullptr;
+
+    //Currently opened capture file
+    QFile *captureFile          = nullptr;
+    uchar *captureData          = nullptr;
+    qint64 captureSize          = 0;
+    SearchIndex captureIndex;
+
+    //Last result shown in the preview
+    qint64 previewOffset        = -1;
+    qint64 previewLength        = 0;
+
+    static const int MAX_RESULTS = 10000;
+    static const int PREVIEW_CONTEXT = 1024;    //Bytes shown either side of a capture file match
+    static const int LINE_TEXT_CHARS = 160;     //Of a match's line shown in the result list
+
+    bool openCaptureFile(QString path);
+    void closeCaptureFile();
+    bool updateCaptureIndex();
+    void searchScrollback(QString query);
+    void searchCaptureFile(QString query);
+    QString captureLineText(qint64 offset);
+    void showPreview();
+
+private slots:
+    void search();
+    void browseCaptureFile();
+    void openResult(QListWidgetItem *item);
+    void handleScopeChange(int index);
+    void handleHexPreviewToggled(bool checked);
+};
+
+#endif // SEARCHDIALOG_H
@@ -0,0 +1,264 @@
+#include "SearchIndex.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+
+SearchIndex::SearchIndex()
+{
+    clear();
+}
+
+void SearchIndex::clear()
+{
+    chunks.clear();
+    lineStarts.clear();
+    lineStarts.append(0);
+    totalSize = 0;
+    history = 0;
+}
+
+void SearchIndex::append(const char *data, qint64 size)
+{
+    appendUnits(reinterpret_cast<const uchar *>(data), size);
+}
+
+//The scrollback is indexed as the UTF-16 it is stored in, so any character can be searched for
+void SearchIndex::append(const QString &text)
+{
+    appendUnits(reinterpret_cast<const ushort *>(text.constData()), text.size());
+}
+
+template<typename Unit>
+void SearchIndex::appendUnits(const Unit *data, qint64 size)
+{
+    Chunk *chunkData = chunks.data();
+
+    for(qint64 i = 0; i < size; i++){
+        qint64 offset = totalSize + i;
+
+        if(offset % CHUNK_SIZE == 0){
+            Chunk chunk;
+            std::memset(chunk.bloom, 0, sizeof(chunk.bloom));
+            chunks.append(chunk);
+            chunkData = chunks.data();
+        }
+
+        Unit c = fold(data[i]);
+        if(c == '\n'){
+            lineStarts.append(offset + 1);
+        }
+
+        //Each trigram belongs to the chunk it starts in
+        history = ((history << 16) | c) & Q_UINT64_C(0xFFFFFFFFFFFF);
+        if(offset >= 2){
+            addTrigram(chunkData[(offset - 2) / CHUNK_SIZE], history);
+        }
+    }
+
+    totalSize += size;
+}
+
+qint64 SearchIndex::size() const
+{
+    return totalSize;
+}
+
+qint64 SearchIndex::lineCount() const
+{
+    return lineStarts.size();
+}
+
+qint64 SearchIndex::lineOfOffset(qint64 offset) const
+{
+    auto it = std::upper_bound(lineStarts.constBegin(), lineStarts.constEnd(), offset);
+    return (it - lineStarts.constBegin()) - 1;
+}
+
+qint64 SearchIndex::lineStart(qint64 line) const
+{
+    return lineStarts.value(static_cast<int>(line), totalSize);
+}
+
+//Layout: version, total size, trigram history, chunk count, line count, then the chunks' filters and the line offsets
+bool SearchIndex::write(QIODevice *out) const
+{
+    qint64 header[5] = {VERSION, totalSize, static_cast<qint64>(history), chunks.size(), lineStarts.size()};
+
+    return out->write(reinterpret_cast<const char *>(header), sizeof(header)) == sizeof(header)
+            && out->write(reinterpret_cast<const char *>(chunks.constData()), chunks.size() * qint64(sizeof(Chunk))) == chunks.size() * qint64(sizeof(Chunk))
+            && out->write(reinterpret_cast<const char *>(lineStarts.constData()), lineStarts.size() * qint64(sizeof(qint64))) == lineStarts.size() * qint64(sizeof(qint64));
+}
+
+bool SearchIndex::read(const char *data, qint64 size)
+{
+    qint64 header[5];
+    if(size < qint64(sizeof(header))){
+        return false;
+    }
+    std::memcpy(header, data, sizeof(header));
+
+    //An index from an older version hashes differently, the caller rebuilds it
+    qint64 chunkCount = header[3];
+    qint64 lineCount = header[4];
+    if(header[0] != VERSION || chunkCount < 0 || lineCount < 1 || chunkCount > INT_MAX / qint64(sizeof(Chunk)) || lineCount > INT_MAX
+            || size != qint64(sizeof(header)) + chunkCount * qint64(sizeof(Chunk)) + lineCount * qint64(sizeof(qint64))){
+        return false;
+    }
+
+    totalSize = header[1];
+    history = static_cast<quint64>(header[2]);
+
+    data += sizeof(header);
+    chunks.resize(static_cast<int>(chunkCount));
+    std::memcpy(chunks.data(), data, static_cast<size_t>(chunkCount) * sizeof(Chunk));
+
+    data += chunkCount * qint64(sizeof(Chunk));
+    lineStarts.resize(static_cast<int>(lineCount));
+    std::memcpy(lineStarts.data(), data, static_cast<size_t>(lineCount) * sizeof(qint64));
+
+    return true;
+}
+
+//Ranges of the stream that may contain the query. Each range is long enough to hold a match starting anywhere in it.
+QVector<SearchIndex::Range> SearchIndex::candidateRanges(const QByteArray &query) const
+{
+    QByteArray folded = foldCase(query);
+    return candidateRanges(reinterpret_cast<const uchar *>(folded.constData()), folded.size());
+}
+
+QVector<SearchIndex::Range> SearchIndex::candidateRanges(const QString &query) const
+{
+    QVector<ushort> folded(query.size());
+    for(int i = 0; i < query.size(); i++){
+        folded[i] = fold(query.at(i).unicode());
+    }
+    return candidateRanges(folded.constData(), folded.size());
+}
+
+template<typename Unit>
+QVector<SearchIndex::Range> SearchIndex::candidateRanges(const Unit *folded, qint64 length) const
+{
+    QVector<Range> ranges;
+
+    if(length == 0 || totalSize < length){
+        return ranges;
+    }
+
+    //Too short to filter, or long enough to span more than two chunks: scan everything
+    if(length < 3 || length > CHUNK_SIZE){
+        ranges.append(Range(0, totalSize));
+        return ranges;
+    }
+
+    QVector<quint64> trigrams;
+    for(qint64 i = 0; i + 2 < length; i++){
+        quint64 trigram = (quint64(folded[i]) << 32) | (quint64(folded[i + 1]) << 16) | folded[i + 2];
+        trigrams.append(trigram);
+    }
+
+    for(int c = 0; c < chunks.size(); c++){
+        //A match starting in this chunk can have its later trigrams in the next one
+        bool candidate = true;
+        for(quint64 trigram : trigrams){
+            bool inChunk = hasTrigram(chunks.at(c), trigram);
+            bool inNext = c + 1 < chunks.size() && hasTrigram(chunks.at(c + 1), trigram);
+            if(!inChunk && !inNext){
+                candidate = false;
+                break;
+            }
+        }
+
+        if(!candidate){
+            continue;
+        }
+
+        qint64 start = c * CHUNK_SIZE;
+        qint64 end = qMin(totalSize, (c + 1) * CHUNK_SIZE + length - 1);
+
+        //Merge with the previous range when they touch
+        if(!ranges.isEmpty() && ranges.last().first + ranges.last().second >= start){
+            ranges.last().second = end - ranges.last().first;
+        }
+        else{
+            ranges.append(Range(start, end - start));
+        }
+    }
+
+    return ranges;
+}
+
+QByteArray SearchIndex::foldCase(const QByteArray &text)
+{
+    QByteArray folded = text;
+    for(int i = 0; i < folded.size(); i++){
+        folded[i] = static_cast<char>(fold(static_cast<uchar>(folded.at(i))));
+    }
+    return folded;
+}
+
+//Find the (already folded) query in data, ignoring ASCII case. Returns -1 if not found.
+qint64 SearchIndex::find(const char *data, qint64 size, const QByteArray &foldedQuery, qint64 from)
+{
+    const qint64 length = foldedQuery.size();
+    if(length == 0){
+        return -1;
+    }
+
+    const uchar *hay = reinterpret_cast<const uchar *>(data);
+    const uchar *needle = reinterpret_cast<const uchar *>(foldedQuery.constData());
+
+    for(qint64 i = from; i + length <= size; i++){
+        if(fold(hay[i]) != needle[0]){
+            continue;
+        }
+
+        qint64 j = 1;
+        while(j < length && fold(hay[i + j]) == needle[j]){
+            j++;
+        }
+
+        if(j == length){
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+inline uchar SearchIndex::fold(uchar c)
+{
+    return (c >= 'A' && c <= 'Z') ? static_cast<uchar>(c + ('a' - 'A')) : c;
+}
+
+//Same folding QString::indexOf() uses case insensitively. Surrogates are left alone.
+inline ushort SearchIndex::fold(ushort c)
+{
+    return c < 0x80 ? fold(static_cast<uchar>(c)) : static_cast<ushort>(QChar::toCaseFolded(static_cast<uint>(c)));
+}
+
+inline quint64 SearchIndex::trigramHash(quint64 trigram, int seed)
+{
+    //Multiplicative hashing, the top 15 bits select one of the 32K filter bits
+    const quint64 multipliers[] = {Q_UINT64_C(0x9E3779B97F4A7C15), Q_UINT64_C(0xC2B2AE3D27D4EB4F)};
+    return (trigram * multipliers[seed]) >> (64 - 15);
+}
+
+void SearchIndex::addTrigram(SearchIndex::Chunk &chunk, quint64 trigram)
+{
+    for(int seed = 0; seed < 2; seed++){
+        quint64 bit = trigramHash(trigram, seed);
+        chunk.bloom[bit / 64] |= Q_UINT64_C(1) << (bit % 64);
+    }
+}
+
+bool SearchIndex::hasTrigram(const SearchIndex::Chunk &chunk, quint64 trigram)
+{
+    for(int seed = 0; seed < 2; seed++){
+        quint64 bit = trigramHash(trigram, seed);
+        if(!(chunk.bloom[bit / 64] & (Q_UINT64_C(1) << (bit % 64)))){
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,79 @@
+#ifndef SEARCHINDEX_H
+#define SEARCHINDEX_H
+
+/*
+ * Incremental full-text search index
+ *
+ * Indexes a stream that is only ever appended to (the terminal scrollback or a capture file)
+ * without keeping a copy of it. The stream is either bytes (capture files) or the UTF-16 code units
+ * of a QString (the scrollback); offsets count whichever unit was appended. The stream is split into fixed size chunks and every chunk gets a
+ * bloom filter of the (case folded) trigrams starting in it. A line-offset table maps any offset
+ * back to its line number.
+ *
+ * A query only has to be verified against the chunks whose filters contain all of its trigrams,
+ * so searching hundreds of MB typically touches a handful of chunks. Queries shorter than three
+ * units cannot be filtered and fall back to scanning every chunk.
+ *
+ * Byte streams are folded ASCII case insensitively, text streams with QChar::toCaseFolded() so the
+ * ranges agree with QString::indexOf(..., Qt::CaseInsensitive). Query with the overload that
+ * matches what was appended.
+ */
+
+#include <QByteArray>
+#include <QString>
+#include <QIODevice>
+#include <QVector>
+#include <QPair>
+
+class SearchIndex
+{
+public:
+    SearchIndex();
+
+    typedef QPair<qint64, qint64> Range;    //Start offset, length
+
+    void clear();
+    void append(const char *data, qint64 size);
+    void append(const QString &text);
+
+    qint64 size() const;
+    qint64 lineCount() const;
+    qint64 lineOfOffset(qint64 offset) const;
+    qint64 lineStart(qint64 line) const;
+
+    QVector<Range> candidateRanges(const QByteArray &query) const;
+    QVector<Range> candidateRanges(const QString &query) const;
+
+    //Saved with a session so a restored scrollback does not have to be indexed again
+    bool write(QIODevice *out) const;
+    bool read(const char *data, qint64 size);
+
+    static QByteArray foldCase(const QByteArray &text);
+    static qint64 find(const char *data, qint64 size, const QByteArray &foldedQuery, qint64 from = 0);
+
+private:
+    static const qint64 VERSION = 2;            //Bumped whenever the trigram hashing changes
+    static const qint64 CHUNK_SIZE = 64 * 1024;
+    static const int BLOOM_BITS = 32 * 1024;    //4 KB per 64 KB chunk
+    static const int BLOOM_WORDS = BLOOM_BITS / 64;
+
+    struct Chunk{
+        quint64 bloom[BLOOM_WORDS];
+    };
+
+    QVector<Chunk> chunks;
+    QVector<qint64> lineStarts;
+    qint64 totalSize = 0;
+    quint64 history = 0;            //Last two folded units (16 bits each), carried between appends
+
+    template<typename Unit> void appendUnits(const Unit *data, qint64 size);
+    template<typename Unit> QVector<Range> candidateRanges(const Unit *folded, qint64 length) const;
+
+    static inline uchar fold(uchar c);
+    static inline ushort fold(ushort c);
+    static inline quint64 trigramHash(quint64 trigram, int seed);
+    static void addTrigram(Chunk &chunk, quint64 trigram);
+    static bool hasTrigram(const Chunk &chunk, quint64 trigram);
+};
+
+#endif // SEARCHINDEX_H
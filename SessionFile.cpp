@@ -0,0 +1,169 @@
+#include "SessionFile.h"
+
+#include <QSaveFile>
+#include <climits>
+#include <cstring>
+
+static const char SESSION_MAGIC[8] = {'B', 'T', 'S', 'E', 'S', 'S', 0, 0};
+static const quint32 BYTE_ORDER_MARK = 0x01020304;
+static const quint32 SESSION_VERSION = 1;
+
+SessionFile::SessionFile()
+{
+    std::memset(&header, 0, sizeof(header));
+}
+
+SessionFile::~SessionFile()
+{
+    if(map){
+        file.unmap(map);
+    }
+}
+
+bool SessionFile::write(QString path, const ScrollbackText &text, const QVector<Terminal::TextRun> &runs,
+                        const SearchIndex &index, QString *error)
+{
+    QSaveFile out(path);
+    if(!out.open(QIODevice::WriteOnly)){
+        if(error){
+            *error = out.errorString();
+        }
+        return false;
+    }
+
+    Header header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, SESSION_MAGIC, sizeof(header.magic));
+    header.byteOrder = BYTE_ORDER_MARK;
+    header.version = SESSION_VERSION;
+    header.textLength = text.size();
+    header.runCount = runs.size();
+    header.runsOffset = sizeof(Header);
+
+    //The header is rewritten once the section sizes are known
+    bool ok = out.write(reinterpret_cast<const char *>(&header), sizeof(header)) == sizeof(header);
+
+    QVector<qint32> runTable;
+    runTable.reserve(runs.size() * 3);
+    for(const Terminal::TextRun &run : runs){
+        runTable << run.start << run.length << (run.incoming ? 1 : 0);
+    }
+    qint64 runBytes = runTable.size() * qint64(sizeof(qint32));
+    ok = ok && out.write(reinterpret_cast<const char *>(runTable.constData()), runBytes) == runBytes;
+
+    header.indexOffset = out.pos();
+    ok = ok && index.write(&out);
+    header.indexSize = out.pos() - header.indexOffset;
+
+    //Aligned so the mapped text can be used as QChar data directly
+    qint64 padding = (8 - out.pos() % 8) % 8;
+    ok = ok && out.write(QByteArray(static_cast<int>(padding), '\0')) == padding;
+    header.textOffset = out.pos();
+
+    for(int i = 0; ok && i < text.blockCount(); i++){
+        const QString &block = text.block(i);
+        qint64 blockBytes = block.size() * qint64(sizeof(QChar));
+        ok = out.write(reinterpret_cast<const char *>(block.constData()), blockBytes) == blockBytes;
+    }
+
+    ok = ok && out.seek(0) && out.write(reinterpret_cast<const char *>(&header), sizeof(header)) == sizeof(header);
+
+    if(!ok || !out.commit()){
+        if(error){
+            *error = out.errorString();
+        }
+        out.cancelWriting();
+        return false;
+    }
+
+    return true;
+}
+
+bool SessionFile::open(QString path, QString *error)
+{
+    file.setFileName(path);
+    if(!file.open(QIODevice::ReadOnly)){
+        if(error){
+            *error = file.errorString();
+        }
+        return false;
+    }
+
+    qint64 size = file.size();
+    if(size >= qint64(sizeof(Header))){
+        map = file.map(0, size);
+    }
+
+    if(map){
+        std::memcpy(&header, map, sizeof(header));
+    }
+
+    //Every section has to lie within the file before anything is read from it
+    bool valid = map
+            && std::memcmp(header.magic, SESSION_MAGIC, sizeof(header.magic)) == 0
+            && header.byteOrder == BYTE_ORDER_MARK
+            && header.version == SESSION_VERSION
+            && header.textLength >= 0 && header.textLength <= INT_MAX
+            && header.runCount >= 0 && header.runCount <= INT_MAX / 3
+            && header.runsOffset == qint64(sizeof(Header))
+            && header.runsOffset + header.runCount * 12 <= header.indexOffset
+            && header.indexSize >= 0 && header.indexOffset + header.indexSize <= header.textOffset
+            && header.textOffset % 8 == 0
+            && header.textOffset + header.textLength * 2 <= size;
+
+    if(!valid){
+        if(error){
+            *error = QString("%1 is not a valid session file").arg(path);
+        }
+        if(map){
+            file.unmap(map);
+            map = nullptr;
+        }
+        file.close();
+        return false;
+    }
+
+    return true;
+}
+
+const QChar *SessionFile::textData() const
+{
+    return map ? reinterpret_cast<const QChar *>(map + header.textOffset) : nullptr;
+}
+
+int SessionFile::textLength() const
+{
+    return static_cast<int>(header.textLength);
+}
+
+QVector<Terminal::TextRun> SessionFile::runs() const
+{
+    QVector<Terminal::TextRun> runs;
+    if(!map){
+        return runs;
+    }
+
+    const qint32 *table = reinterpret_cast<const qint32 *>(map + header.runsOffset);
+    runs.reserve(static_cast<int>(header.runCount));
+
+    for(qint64 i = 0; i < header.runCount; i++){
+        Terminal::TextRun run{table[i * 3], table[i * 3 + 1], table[i * 3 + 2] != 0};
+
+        //A run outside the text would be read out of bounds when displayed
+        if(run.start < 0 || run.length < 0 || qint64(run.start) + run.length > header.textLength){
+            return QVector<Terminal::TextRun>();
+        }
+        runs.append(run);
+    }
+
+    return runs;
+}
+
+bool SessionFile::readIndex(SearchIndex *index) const
+{
+    if(!map){
+        return false;
+    }
+
+    return index->read(reinterpret_cast<const char *>(map + header.indexOffset), header.indexSize);
+}
@@ -0,0 +1,70 @@
+#ifndef SESSIONFILE_H
+#define SESSIONFILE_H
+
+/*
+ * Terminal session file
+ *
+ * Snapshot of the terminal scrollback that can be restored without parsing or copying it. The
+ * text is stored exactly as the terminal holds it (UTF-16) at an aligned offset, so a restored
+ * terminal uses the memory mapped file directly as its scrollback. Pages are only read when
+ * they are displayed or searched. The search index is stored as well, so it does not have to
+ * be rebuilt either.
+ *
+ * Layout (native byte order, checked on load):
+ *
+ *      Header      magic, byte order mark, version, then the size and offset of each section
+ *      Runs        <int32 start> <int32 length> <int32 incoming> per run
+ *      Index       SearchIndex::write()
+ *      Text        UTF-16 code units, 8 byte aligned
+ *
+ * The file is written to a temporary file and renamed over the old one (QSaveFile), so a crash
+ * while saving leaves the previous session intact.
+ */
+
+#include "Terminal.h"
+#include "SearchIndex.h"
+#include "ScrollbackText.h"
+
+#include <QFile>
+#include <QString>
+#include <QVector>
+
+class SessionFile
+{
+public:
+    SessionFile();
+    ~SessionFile();
+
+    static bool write(QString path, const ScrollbackText &text, const QVector<Terminal::TextRun> &runs,
+                      const SearchIndex &index, QString *error = nullptr);
+
+    //Maps a session file. The file stays mapped until this object is destroyed.
+    bool open(QString path, QString *error = nullptr);
+
+    const QChar *textData() const;
+    int textLength() const;
+    QVector<Terminal::TextRun> runs() const;
+    bool readIndex(SearchIndex *index) const;
+
+private:
+    SessionFile(const SessionFile &) = delete;
+    SessionFile &operator=(const SessionFile &) = delete;
+
+    struct Header{
+        char magic[8];
+        quint32 byteOrder;
+        quint32 version;
+        qint64 textLength;      //UTF-16 code units
+        qint64 runCount;
+        qint64 runsOffset;
+        qint64 indexOffset;
+        qint64 indexSize;
+        qint64 textOffset;
+    };
+
+    QFile file;
+    uchar *map      = nullptr;
+    Header header;
+};
+
+#endif // SESSIONFILE_H
@@ -0,0 +1,59 @@
+#include "StartupTimeline.h"
+
+#include <QElapsedTimer>
+#include <QVector>
+#include <cstring>
+
+namespace
+{
+    struct Milestone{
+        const char *name;
+        qint64 elapsedNs;
+    };
+
+    //Started during static initialization, the closest portable point to process start
+    struct ProcessClock{
+        QElapsedTimer timer;
+        ProcessClock() { timer.start(); }
+    };
+
+    ProcessClock processClock;
+
+    QVector<Milestone> milestones;
+}
+
+void StartupTimeline::mark(const char *milestone)
+{
+    if(isMarked(milestone)){
+        return;
+    }
+
+    milestones.append(Milestone{milestone, processClock.timer.nsecsElapsed()});
+}
+
+bool StartupTimeline::isMarked(const char *milestone)
+{
+    for(const Milestone &m : milestones){
+        if(strcmp(m.name, milestone) == 0){
+            return true;
+        }
+    }
+
+    return false;
+}
+
+QString StartupTimeline::report()
+{
+    QString text;
+    qint64 previousNs = 0;
+
+    for(const Milestone &m : milestones){
+        text += QString("%1 ms\t(+%2 ms)\t%3\n")
+                .arg(m.elapsedNs / 1e6, 0, 'f', 1)
+                .arg((m.elapsedNs - previousNs) / 1e6, 0, 'f', 1)
+                .arg(m.name);
+        previousNs = m.elapsedNs;
+    }
+
+    return text.isEmpty() ? QString("No startup milestones recorded") : text;
+}
@@ -0,0 +1,29 @@
+#ifndef STARTUPTIMELINE_H
+#define STARTUPTIMELINE_H
+
+/*
+ * Startup timeline
+ *
+ * Records when the milestones of a launch are first reached, measured from process start
+ * (static initialization, before main() runs):
+ *
+ *      main, show() called, event loop, window painted, session restored, discovery started,
+ *      first device listed, connected
+ *
+ * The window paints from the event loop, so "window painted" can come before or after the
+ * deferred startup work. The report lists the milestones in the order they were reached.
+ *
+ * Only the first occurrence of each milestone is kept, so later reconnects do not move it.
+ * Shown under Tools > Startup Timeline and written to the debug output once connected.
+ */
+
+#include <QString>
+
+namespace StartupTimeline
+{
+    void mark(const char *milestone);
+    bool isMarked(const char *milestone);
+    QString report();
+}
+
+#endif // STARTUPTIMELINE_H
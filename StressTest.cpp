@@ -0,0 +1,290 @@
+#include "StressTest.h"
+
+#include <QDebug>
+#include <algorithm>
+
+StressTest::StressTest(Bluetooth *bluetooth, QObject *parent) : QObject(parent)
+{
+    this->bluetooth = bluetooth;
+
+    tickTimer = new QTimer(this);
+    tickTimer->setInterval(50);
+    connect(tickTimer, SIGNAL(timeout()), this, SLOT(tick()));
+}
+
+void StressTest::setConfig(StressTest::Config config)
+{
+    this->config = config;
+
+    if(this->config.window < 1){
+        this->config.window = 1;
+    }
+    if(this->config.payloadSize < 0){
+        this->config.payloadSize = 0;
+    }
+    if(this->config.payloadSize > MAX_PAYLOAD_SIZE){
+        this->config.payloadSize = MAX_PAYLOAD_SIZE;
+    }
+}
+
+StressTest::Config StressTest::getConfig()
+{
+    return this->config;
+}
+
+bool StressTest::isRunning()
+{
+    return this->running;
+}
+
+StressTest::Report StressTest::getReport()
+{
+    return this->report;
+}
+
+void StressTest::start()
+{
+    if(running || !bluetooth){
+        return;
+    }
+
+    report = Report();
+    pending.clear();
+    rtts.clear();
+    rxBuffer.clear();
+    nextSequence = 0;
+    highestReceived = -1;
+
+    connect(bluetooth, SIGNAL(dataReceived(QByteArray)), this, SLOT(handleData(QByteArray)));
+
+    running = true;
+    sending = true;
+    clock.start();
+    tickTimer->start();
+
+    fillWindow();
+}
+
+void StressTest::stop()
+{
+    if(running){
+        sending = false;
+        expireFrames(true);
+        finish();
+    }
+}
+
+QByteArray StressTest::buildFrame(quint32 sequence)
+{
+    QByteArray seq = QByteArray::number(sequence, 16).rightJustified(8, '0');
+
+    QByteArray payload;
+    payload.reserve(config.payloadSize);
+    for(int i = 0; i < config.payloadSize; i++){
+        //Printable, excluding the frame delimiters
+        char c = static_cast<char>('A' + (sequence + static_cast<quint32>(i)) % 26);
+        payload.append(c);
+    }
+
+    quint8 sum = 0;
+    for(char c : seq){
+        sum += static_cast<quint8>(c);
+    }
+    for(char c : payload){
+        sum += static_cast<quint8>(c);
+    }
+
+    QByteArray frame;
+    frame.reserve(config.payloadSize + FRAME_OVERHEAD);
+    frame.append('#');
+    frame.append(seq);
+    frame.append(':');
+    frame.append(payload);
+    frame.append(':');
+    frame.append(QByteArray::number(sum, 16).rightJustified(2, '0'));
+    frame.append('\n');
+
+    return frame;
+}
+
+void StressTest::fillWindow()
+{
+    while(sending && pending.size() < config.window){
+        QByteArray frame = buildFrame(nextSequence);
+
+        pending.insert(nextSequence, clock.nsecsElapsed());
+        nextSequence++;
+
+        report.framesSent++;
+        report.bytesSent += frame.size();
+
+        bluetooth->write(frame);
+    }
+}
+
+void StressTest::handleData(QByteArray data)
+{
+    if(!running){
+        return;
+    }
+
+    report.bytesReceived += data.size();
+    rxBuffer.append(data);
+
+    int start = 0;
+    int end = rxBuffer.indexOf('\n');
+    while(end >= 0){
+        parseLine(rxBuffer.mid(start, end - start));
+        start = end + 1;
+        end = rxBuffer.indexOf('\n', start);
+    }
+    rxBuffer.remove(0, start);
+
+    //Garbage without a newline should not grow the buffer forever. A partial frame may be
+    //as long as the longest valid line.
+    if(rxBuffer.size() > config.payloadSize + FRAME_OVERHEAD + MAX_LINE_PREFIX){
+        report.framesCorrupted++;
+        rxBuffer.clear();
+    }
+
+    fillWindow();
+    emit progress(report.framesSent, report.framesReceived);
+}
+
+void StressTest::parseLine(const QByteArray &line)
+{
+    qint64 now = clock.nsecsElapsed();
+
+    //Skip anything in front of the frame start (e.g. a peripheral prompt)
+    int begin = line.indexOf('#');
+    int firstColon = line.indexOf(':', begin);
+    int lastColon = line.lastIndexOf(':');
+
+    if(begin < 0 || firstColon != begin + 9 || lastColon <= firstColon || line.size() - lastColon - 1 != 2){
+        report.framesCorrupted++;
+        return;
+    }
+
+    QByteArray seqText = line.mid(begin + 1, 8);
+    QByteArray payload = line.mid(firstColon + 1, lastColon - firstColon - 1);
+
+    bool seqOk = false, sumOk = false;
+    quint32 sequence = seqText.toUInt(&seqOk, 16);
+    quint8 expectedSum = static_cast<quint8>(line.mid(lastColon + 1, 2).toUInt(&sumOk, 16));
+
+    quint8 sum = 0;
+    for(char c : seqText){
+        sum += static_cast<quint8>(c);
+    }
+    for(char c : payload){
+        sum += static_cast<quint8>(c);
+    }
+
+    if(!seqOk || !sumOk || sum != expectedSum || payload.size() != config.payloadSize){
+        report.framesCorrupted++;
+        return;
+    }
+
+    auto it = pending.find(sequence);
+    if(it == pending.end()){
+        //Either a second copy of a frame or a frame that already timed out
+        report.framesDuplicated++;
+        return;
+    }
+
+    rtts.append((now - it.value()) / 1e6);
+    pending.erase(it);
+    report.framesReceived++;
+
+    if(static_cast<qint64>(sequence) < highestReceived){
+        report.framesReordered++;
+    }
+    else{
+        highestReceived = sequence;
+    }
+}
+
+void StressTest::expireFrames(bool all)
+{
+    qint64 now = clock.nsecsElapsed();
+    qint64 timeoutNs = static_cast<qint64>(config.timeoutMs) * 1000000;
+
+    auto it = pending.begin();
+    while(it != pending.end()){
+        if(all || now - it.value() > timeoutNs){
+            report.framesLost++;
+            it = pending.erase(it);
+        }
+        else{
+            ++it;
+        }
+    }
+}
+
+void StressTest::tick()
+{
+    if(sending && clock.elapsed() >= config.durationMs){
+        sending = false;
+    }
+
+    expireFrames(false);
+
+    if(sending){
+        fillWindow();
+    }
+    else if(pending.isEmpty()){
+        finish();
+    }
+}
+
+void StressTest::finish()
+{
+    if(!running){
+        return;
+    }
+
+    running = false;
+    tickTimer->stop();
+    disconnect(bluetooth, SIGNAL(dataReceived(QByteArray)), this, SLOT(handleData(QByteArray)));
+
+    report.elapsedMs = clock.elapsed();
+    if(report.elapsedMs > 0){
+        report.bytesPerSecond = report.bytesReceived * 1000.0 / report.elapsedMs;
+    }
+
+    std::sort(rtts.begin(), rtts.end());
+    if(!rtts.isEmpty()){
+        report.rttMinMs = rtts.first();
+        report.rttP50Ms = percentile(rtts, 0.50);
+        report.rttP90Ms = percentile(rtts, 0.90);
+        report.rttP99Ms = percentile(rtts, 0.99);
+        report.rttMaxMs = rtts.last();
+    }
+
+    qDebug() << "StressTest: finished";
+    emit finished(report.toString());
+}
+
+//Nearest rank percentile of an already sorted list
+double StressTest::percentile(const QVector<double> &sorted, double p)
+{
+    int rank = static_cast<int>(p * (sorted.size() - 1) + 0.5);
+    return sorted.at(qBound(0, rank, sorted.size() - 1));
+}
+
+QString StressTest::Report::toString() const
+{
+    QString str;
+    str += QString("Duration: %1 ms\n").arg(elapsedMs);
+    str += QString("Frames sent: %1, received: %2, lost: %3\n").arg(framesSent).arg(framesReceived).arg(framesLost);
+    str += QString("Reordered: %1, corrupted: %2, duplicated/late: %3\n").arg(framesReordered).arg(framesCorrupted).arg(framesDuplicated);
+    str += QString("Bytes sent: %1, received: %2\n").arg(bytesSent).arg(bytesReceived);
+    str += QString("Sustained throughput: %1 bytes/s\n").arg(bytesPerSecond, 0, 'f', 1);
+    str += QString("RTT min/p50/p90/p99/max: %1/%2/%3/%4/%5 ms")
+            .arg(rttMinMs, 0, 'f', 2)
+            .arg(rttP50Ms, 0, 'f', 2)
+            .arg(rttP90Ms, 0, 'f', 2)
+            .arg(rttP99Ms, 0, 'f', 2)
+            .arg(rttMaxMs, 0, 'f', 2);
+    return str;
+}
@@ -0,0 +1,110 @@
+#ifndef STRESSTEST_H
+#define STRESSTEST_H
+
+/*
+ * Loopback stress test
+ *
+ * Sends sequence numbered, checksummed frames through Bluetooth::write() to a peripheral
+ * that echoes everything it receives (or to the simulated loopback transport) and matches
+ * the replies coming back on the receive path.
+ *
+ * Frame format (printable so it survives any UART echo firmware):
+ *
+ *      #SSSSSSSS:<payload>:CC\n
+ *
+ * SSSSSSSS is the sequence number and CC the 8 bit sum of the sequence and payload, both in hex.
+ *
+ * At most 'window' frames are outstanding at once. Frames that are not echoed within the
+ * timeout are counted as lost. When the test finishes a report with the sustained throughput,
+ * round trip time percentiles, loss and reordering is emitted.
+ */
+
+#include "Bluetooth.h"
+
+#include <QObject>
+#include <QHash>
+#include <QVector>
+#include <QTimer>
+#include <QElapsedTimer>
+
+class StressTest : public QObject
+{
+    Q_OBJECT
+public:
+    static const int MAX_PAYLOAD_SIZE = 4096;
+    static const int FRAME_OVERHEAD = 14;   //'#', sequence, two ':', checksum and '\n'
+
+    struct Config{
+        int payloadSize     = 64;       //Payload bytes per frame (excluding the frame header)
+        int window          = 4;        //Maximum number of frames awaiting an echo
+        int durationMs      = 10000;    //How long to keep sending new frames
+        int timeoutMs       = 2000;     //Frames not echoed within this time are counted as lost
+    };
+
+    struct Report{
+        qint64 elapsedMs        = 0;
+        qint64 framesSent       = 0;
+        qint64 framesReceived   = 0;
+        qint64 framesLost       = 0;
+        qint64 framesReordered  = 0;
+        qint64 framesCorrupted  = 0;
+        qint64 framesDuplicated = 0;
+        qint64 bytesSent        = 0;
+        qint64 bytesReceived    = 0;
+        double bytesPerSecond   = 0;
+        double rttMinMs         = 0;
+        double rttP50Ms         = 0;
+        double rttP90Ms         = 0;
+        double rttP99Ms         = 0;
+        double rttMaxMs         = 0;
+
+        QString toString() const;
+    };
+
+    explicit StressTest(Bluetooth *bluetooth, QObject *parent = nullptr);
+
+    void setConfig(Config config);
+    Config getConfig();
+
+    bool isRunning();
+    Report getReport();
+
+signals:
+    void progress(qint64 framesSent, qint64 framesReceived);
+    void finished(QString report);
+
+public slots:
+    void start();
+    void stop();
+
+private:
+    Bluetooth *bluetooth = nullptr;
+    Config config;
+    Report report;
+    bool running = false;
+    bool sending = false;
+
+    QElapsedTimer clock;
+    QTimer *tickTimer = nullptr;
+    quint32 nextSequence = 0;
+    qint64 highestReceived = -1;
+    QHash<quint32, qint64> pending;     //Sequence number -> send time (ns since start)
+    QVector<double> rtts;               //Round trip times in ms
+    QByteArray rxBuffer;
+
+    //Text the peripheral may put in front of an echoed frame (e.g. a prompt)
+    static const int MAX_LINE_PREFIX = 256;
+
+    QByteArray buildFrame(quint32 sequence);
+    void fillWindow();
+    void parseLine(const QByteArray &line);
+    void expireFrames(bool all);
+    void finish();
+    double percentile(const QVector<double> &sorted, double p);
+
+private slots:
+    void handleData(QByteArray data);
+    void tick();
+};
+
+#endif // STRESSTEST_H
@@ -0,0 +1,163 @@
+#include "TelemetryBuffer.h"
+
+#include <limits>
+
+TelemetryBuffer::TelemetryBuffer(int capacity, int maxColumns)
+{
+    //Round the capacity up to a power of two (and at least one block) so indexes wrap with a mask
+    int size = BLOCK_SIZE;
+    while(size < capacity){
+        size <<= 1;
+    }
+
+    this->capacity = size;
+    this->mask = size - 1;
+    this->maxColumns = maxColumns;
+
+    timestamps.resize(size);
+}
+
+void TelemetryBuffer::clear()
+{
+    columns.clear();
+    count = 0;
+}
+
+void TelemetryBuffer::append(qint64 timestamp, const QVector<double> &values)
+{
+    while(columns.size() < values.size() && columns.size() < maxColumns){
+        addColumn();
+    }
+
+    const qint64 slot = count & mask;
+    const int block = static_cast<int>((count >> BLOCK_SHIFT) & (mask >> BLOCK_SHIFT));
+    const bool blockStart = (count & (BLOCK_SIZE - 1)) == 0;
+
+    timestamps[static_cast<int>(slot)] = timestamp;
+
+    for(int c = 0; c < columns.size(); c++){
+        Column &column = columns[c];
+        double v = c < values.size() ? values.at(c) : std::numeric_limits<double>::quiet_NaN();
+
+        column.samples[static_cast<int>(slot)] = v;
+
+        if(blockStart){
+            column.blockMin[block] = std::numeric_limits<double>::infinity();
+            column.blockMax[block] = -std::numeric_limits<double>::infinity();
+        }
+
+        //NaN compares false and so never becomes the min or max
+        if(v < column.blockMin.at(block)){
+            column.blockMin[block] = v;
+        }
+        if(v > column.blockMax.at(block)){
+            column.blockMax[block] = v;
+        }
+    }
+
+    count++;
+}
+
+int TelemetryBuffer::getColumnCount() const
+{
+    return columns.size();
+}
+
+int TelemetryBuffer::getCapacity() const
+{
+    return capacity;
+}
+
+qint64 TelemetryBuffer::getCount() const
+{
+    return count;
+}
+
+qint64 TelemetryBuffer::getFirstIndex() const
+{
+    return qMax(Q_INT64_C(0), count - capacity);
+}
+
+double TelemetryBuffer::value(int column, qint64 index) const
+{
+    if(column < 0 || column >= columns.size() || index < getFirstIndex() || index >= count){
+        return std::numeric_limits<double>::quiet_NaN();
+    }
+
+    return columns.at(column).samples.at(static_cast<int>(index & mask));
+}
+
+qint64 TelemetryBuffer::timestamp(qint64 index) const
+{
+    if(index < getFirstIndex() || index >= count){
+        return 0;
+    }
+
+    return timestamps.at(static_cast<int>(index & mask));
+}
+
+//Min and max of a column over the samples [from, to). Returns false if the range holds no values.
+bool TelemetryBuffer::minMax(int column, qint64 from, qint64 to, double *min, double *max) const
+{
+    *min = std::numeric_limits<double>::infinity();
+    *max = -std::numeric_limits<double>::infinity();
+
+    if(column < 0 || column >= columns.size()){
+        return false;
+    }
+
+    from = qMax(from, getFirstIndex());
+    to = qMin(to, count);
+    if(from >= to){
+        return false;
+    }
+
+    const Column &c = columns.at(column);
+
+    //Raw samples up to the first block boundary
+    qint64 firstBlockStart = ((from + BLOCK_SIZE - 1) >> BLOCK_SHIFT) << BLOCK_SHIFT;
+    qint64 head = qMin(firstBlockStart, to);
+    rawMinMax(c, from, head, min, max);
+
+    //Whole blocks from their summaries
+    qint64 index = head;
+    while(index + BLOCK_SIZE <= to){
+        int block = static_cast<int>((index >> BLOCK_SHIFT) & (mask >> BLOCK_SHIFT));
+        if(c.blockMin.at(block) < *min){
+            *min = c.blockMin.at(block);
+        }
+        if(c.blockMax.at(block) > *max){
+            *max = c.blockMax.at(block);
+        }
+        index += BLOCK_SIZE;
+    }
+
+    //Raw samples after the last whole block
+    rawMinMax(c, index, to, min, max);
+
+    return *min <= *max;
+}
+
+void TelemetryBuffer::addColumn()
+{
+    Column column;
+    column.samples.fill(std::numeric_limits<double>::quiet_NaN(), capacity);
+    column.blockMin.fill(std::numeric_limits<double>::infinity(), capacity >> BLOCK_SHIFT);
+    column.blockMax.fill(-std::numeric_limits<double>::infinity(), capacity >> BLOCK_SHIFT);
+    columns.append(column);
+}
+
+void TelemetryBuffer::rawMinMax(const TelemetryBuffer::Column &column, qint64 from, qint64 to, double *min, double *max) const
+{
+    const double *samples = column.samples.constData();
+
+    for(qint64 i = from; i < to; i++){
+        double v = samples[i & mask];
+        if(v < *min){
+            *min = v;
+        }
+        if(v > *max){
+            *max = v;
+        }
+    }
+}
@@ -0,0 +1,59 @@
+#ifndef TELEMETRYBUFFER_H
+#define TELEMETRYBUFFER_H
+
+/*
+ * Columnar telemetry ring buffer
+ *
+ * Stores the most recent samples of every telemetry field in fixed size ring buffers,
+ * one per column, so memory use is bounded no matter how long the stream runs.
+ *
+ * Every column also keeps the min/max of each block of BLOCK_SIZE samples. A min/max query
+ * over a range therefore only touches the raw samples at its two ends and one summary per
+ * block in between, which keeps per-pixel decimation of millions of samples cheap.
+ *
+ * Samples are addressed by their absolute index (0 for the first sample ever added).
+ * Only indexes in [getFirstIndex(), getCount()) are still stored. Missing values are NaN.
+ */
+
+#include <QVector>
+
+class TelemetryBuffer
+{
+public:
+    explicit TelemetryBuffer(int capacity = 1 << 19, int maxColumns = 8);
+
+    void clear();
+    void append(qint64 timestamp, const QVector<double> &values);
+
+    int getColumnCount() const;
+    int getCapacity() const;
+    qint64 getCount() const;
+    qint64 getFirstIndex() const;
+
+    double value(int column, qint64 index) const;
+    qint64 timestamp(qint64 index) const;
+    bool minMax(int column, qint64 from, qint64 to, double *min, double *max) const;
+
+private:
+    static const int BLOCK_SHIFT = 6;
+    static const int BLOCK_SIZE = 1 << BLOCK_SHIFT;
+
+    struct Column{
+        QVector<double> samples;
+        QVector<double> blockMin;
+        QVector<double> blockMax;
+    };
+
+    int capacity;               //Power of two
+    qint64 mask;
+    int maxColumns;
+    qint64 count = 0;
+
+    QVector<qint64> timestamps;
+    QVector<Column> columns;
+
+    void addColumn();
+    void rawMinMax(const Column &column, qint64 from, qint64 to, double *min, double *max) const;
+};
+
+#endif // TELEMETRYBUFFER_H
@@ -0,0 +1,283 @@
+#include "TelemetryExporter.h"
+
+#include <QDateTime>
+#include <QDebug>
+#include <QFileDevice>
+#include <QtEndian>
+#include <limits>
+#include <cstring>
+
+TelemetryExporter::TelemetryExporter(QObject *parent) : QObject(parent)
+{
+
+}
+
+void TelemetryExporter::start(QIODevice *device, TelemetryExporter::Format format)
+{
+    this->device = device;
+    this->format = format;
+    this->rowsWritten = 0;
+    this->headerWritten = false;
+    this->csvHeader.clear();
+    this->csvColumns = 0;
+    this->rowsSinceNewField = 0;
+
+    timestamps.clear();
+    directions.clear();
+    values.clear();
+    textFields.clear();
+    fieldCount = 0;
+
+    if(format == COLUMNAR){
+        QByteArray header("BTCOL", 5);
+        header.append('\0');
+        quint16 version = qToLittleEndian<quint16>(1);
+        header.append(reinterpret_cast<const char *>(&version), sizeof(version));
+        emit dataReady(header);
+        headerWritten = true;
+    }
+}
+
+void TelemetryExporter::finish()
+{
+    if(device){
+        flushBatch();
+
+        //A field appeared after the header was written
+        if(format == CSV && headerWritten && makeCsvHeader() != csvHeader && !rewriteCsvHeader()){
+            qDebug() << "TelemetryExporter: the CSV header could not be updated with the fields that appeared later";
+        }
+
+        device = nullptr;
+    }
+}
+
+bool TelemetryExporter::isActive()
+{
+    return this->device != nullptr;
+}
+
+void TelemetryExporter::setBatchSize(int rows)
+{
+    this->batchSize = qMax(1, rows);
+}
+
+qint64 TelemetryExporter::getRowsWritten()
+{
+    return this->rowsWritten;
+}
+
+void TelemetryExporter::setFieldNames(QStringList names)
+{
+    this->fieldNames = names;
+}
+
+void TelemetryExporter::addRow(qint64 timestamp, bool incoming, QVector<double> rowValues, QList<QByteArray> fields)
+{
+    if(!device){
+        return;
+    }
+
+    const int row = timestamps.size();
+    const double nan = std::numeric_limits<double>::quiet_NaN();
+
+    timestamps.append(timestamp);
+    directions.append(incoming ? 1 : 0);
+
+    if(rowValues.size() > fieldCount){
+        rowsSinceNewField = 0;
+    }
+    else{
+        rowsSinceNewField++;
+    }
+
+    //A field that first appears mid batch gets NaN for the rows before it
+    while(values.size() < rowValues.size()){
+        values.append(QVector<double>(row, nan));
+    }
+    fieldCount = qMax(fieldCount, values.size());
+
+    for(int c = 0; c < values.size(); c++){
+        values[c].append(c < rowValues.size() ? rowValues.at(c) : nan);
+    }
+
+    if(format == CSV){
+        textFields.append(fields);
+    }
+
+    bool flush = timestamps.size() >= batchSize;
+
+    //The CSV header is written with the first batch, wait until the fields stop changing
+    if(format == CSV && !headerWritten){
+        flush = (flush && rowsSinceNewField >= batchSize) || timestamps.size() >= MAX_HELD_BATCHES * batchSize;
+    }
+
+    if(flush){
+        flushBatch();
+    }
+}
+
+void TelemetryExporter::flushBatch()
+{
+    if(!device || timestamps.isEmpty()){
+        return;
+    }
+
+    if(format == CSV){
+        writeCsvBatch();
+    }
+    else{
+        writeColumnarBatch();
+    }
+
+    rowsWritten += timestamps.size();
+
+    timestamps.clear();
+    directions.clear();
+    values.clear();
+    textFields.clear();
+}
+
+void TelemetryExporter::writeCsvBatch()
+{
+    QByteArray batch;
+    batch.reserve(timestamps.size() * (32 + fieldCount * 12));
+
+    if(!headerWritten){
+        csvHeader = makeCsvHeader();
+        csvColumns = fieldCount;
+        batch.append(csvHeader);
+        headerWritten = true;
+    }
+
+    for(int row = 0; row < timestamps.size(); row++){
+        batch.append(QDateTime::fromMSecsSinceEpoch(timestamps.at(row)).toString(Qt::ISODateWithMs).toLatin1());
+        batch.append(directions.at(row) ? ",RX" : ",TX");
+
+        const QList<QByteArray> &fields = textFields.at(row);
+        for(int c = 0; c < fields.size(); c++){
+            batch.append(',');
+            //Numbers are written as received, everything else is quoted if needed
+            if(values.at(c).at(row) == values.at(c).at(row)){
+                batch.append(fields.at(c));
+            }
+            else{
+                batch.append(csvQuote(fields.at(c)));
+            }
+        }
+        for(int c = fields.size(); c < csvColumns; c++){
+            batch.append(',');
+        }
+        batch.append("\r\n");
+    }
+
+    emit dataReady(batch);
+}
+
+QByteArray TelemetryExporter::makeCsvHeader()
+{
+    QByteArray header("timestamp,direction");
+    for(int c = 0; c < fieldCount; c++){
+        QString name = c < fieldNames.size() ? fieldNames.at(c) : QString("Field %1").arg(c + 1);
+        header.append(',');
+        header.append(csvQuote(name.toUtf8()));
+    }
+    header.append("\r\n");
+    return header;
+}
+
+//Replace the header at the start of the file, moving the rows after it if its length changed
+bool TelemetryExporter::rewriteCsvHeader()
+{
+    QFileDevice *file = qobject_cast<QFileDevice *>(device);
+    if(!file || !file->isReadable()){
+        return false;
+    }
+
+    const QByteArray header = makeCsvHeader();
+    const qint64 oldLength = csvHeader.size();
+    const qint64 shift = header.size() - oldLength;
+    const qint64 end = file->size();
+    const qint64 blockSize = 1024 * 1024;
+    const qint64 blocks = (end - oldLength + blockSize - 1) / blockSize;
+
+    //Moving up goes last block first and moving down first block first, so nothing is
+    //overwritten before it was moved
+    for(qint64 i = 0; shift != 0 && i < blocks; i++){
+        qint64 position = shift > 0 ? qMax(oldLength, end - (i + 1) * blockSize) : oldLength + i * blockSize;
+        qint64 length = shift > 0 ? end - i * blockSize - position : qMin(blockSize, end - position);
+
+        if(!file->seek(position)){
+            return false;
+        }
+        QByteArray block = file->read(length);
+        if(block.size() != length || !file->seek(position + shift) || file->write(block) != length){
+            return false;
+        }
+    }
+
+    if(!file->seek(0) || file->write(header) != header.size() || (shift < 0 && !file->resize(end + shift))){
+        return false;
+    }
+
+    csvHeader = header;
+    csvColumns = fieldCount;
+    return file->seek(end + shift);
+}
+
+void TelemetryExporter::writeColumnarBatch()
+{
+    const int rows = timestamps.size();
+
+    QByteArray batch;
+    batch.reserve(16 + rows * (9 + fieldCount * 8) + fieldCount * 32);
+
+    quint32 rowCount = qToLittleEndian<quint32>(static_cast<quint32>(rows));
+    quint16 columnCount = qToLittleEndian<quint16>(static_cast<quint16>(values.size()));
+    batch.append("BTCB", 4);
+    batch.append(reinterpret_cast<const char *>(&rowCount), sizeof(rowCount));
+    batch.append(reinterpret_cast<const char *>(&columnCount), sizeof(columnCount));
+
+    for(int c = 0; c < values.size(); c++){
+        QByteArray name = (c < fieldNames.size() ? fieldNames.at(c) : QString("Field %1").arg(c + 1)).toUtf8();
+        quint16 length = qToLittleEndian<quint16>(static_cast<quint16>(name.size()));
+        batch.append(reinterpret_cast<const char *>(&length), sizeof(length));
+        batch.append(name);
+    }
+
+    //Columns are appended as contiguous arrays
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+    batch.append(reinterpret_cast<const char *>(timestamps.constData()), rows * static_cast<int>(sizeof(qint64)));
+    batch.append(reinterpret_cast<const char *>(directions.constData()), rows);
+    for(const QVector<double> &column : values){
+        batch.append(reinterpret_cast<const char *>(column.constData()), rows * static_cast<int>(sizeof(double)));
+    }
+#else
+    for(qint64 t : timestamps){
+        qint64 le = qToLittleEndian(t);
+        batch.append(reinterpret_cast<const char *>(&le), sizeof(le));
+    }
+    batch.append(reinterpret_cast<const char *>(directions.constData()), rows);
+    for(const QVector<double> &column : values){
+        for(double v : column){
+            quint64 bits;
+            std::memcpy(&bits, &v, sizeof(bits));
+            bits = qToLittleEndian(bits);
+            batch.append(reinterpret_cast<const char *>(&bits), sizeof(bits));
+        }
+    }
+#endif
+
+    emit dataReady(batch);
+}
+
+QByteArray TelemetryExporter::csvQuote(const QByteArray &field)
+{
+    if(!field.contains(',') && !field.contains('"') && !field.contains('\r') && !field.contains('\n')){
+        return field;
+    }
+
+    QByteArray quoted = field;
+    quoted.replace("\"", "\"\"");
+    return "\"" + quoted + "\"";
+}
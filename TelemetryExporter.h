@@ -0,0 +1,92 @@
+#ifndef TELEMETRYEXPORTER_H
+#define TELEMETRYEXPORTER_H
+
+/*
+ * Structured telemetry export
+ *
+ * Collects parsed telemetry rows (see TelemetryParser) into column batches and writes each
+ * batch in one go, either as CSV or as a compact columnar binary file. The output is handed
+ * out through dataReady() for the owner to write (the Logger commits it like any other log
+ * data); the device itself is only written to when the CSV header has to be rewritten.
+ *
+ * CSV: a header row (timestamp, direction, field names) followed by one row per line.
+ * Timestamps are ISO 8601 with milliseconds, numeric fields are written as numbers and
+ * text fields are quoted when needed (RFC 4180). Rows are held back until no new field has
+ * appeared for a whole batch, and every row is padded to the header's width. Should a field
+ * still appear later, finish() rewrites the header with the final fields when the device can
+ * be read back (a file opened ReadWrite). Rows written before that are then shorter than the
+ * header, which CSV readers take as empty trailing fields.
+ *
+ * Columnar binary (.btc), all integers little endian:
+ *
+ *      File header:    "BTCOL" 0x00 <uint16 version = 1>
+ *      Batch:          "BTCB" <uint32 rows> <uint16 fields>
+ *                      <fields x (uint16 length, UTF-8 name)>
+ *                      <rows x int64 timestamp, ms since epoch>
+ *                      <rows x uint8 direction, 1 = received, 0 = sent>
+ *                      <fields x rows x float64 value, NaN when missing or not numeric>
+ *
+ * Every column of a batch is contiguous, so a reader can load millions of rows with a few
+ * large reads and no text parsing.
+ */
+
+#include <QObject>
+#include <QIODevice>
+#include <QVector>
+#include <QStringList>
+
+class TelemetryExporter : public QObject
+{
+    Q_OBJECT
+public:
+    explicit TelemetryExporter(QObject *parent = nullptr);
+
+    enum Format{
+        CSV,
+        COLUMNAR,
+    };
+
+    void start(QIODevice *device, Format format);
+    void finish();
+    bool isActive();
+
+    void setBatchSize(int rows);
+    qint64 getRowsWritten();
+
+signals:
+    void dataReady(QByteArray data);
+
+public slots:
+    void addRow(qint64 timestamp, bool incoming, QVector<double> values, QList<QByteArray> fields);
+    void setFieldNames(QStringList names);
+
+private:
+    static const int MAX_HELD_BATCHES = 16;     //Rows held back for the CSV header at most
+
+    QIODevice *device = nullptr;
+    Format format = CSV;
+    int batchSize = 4096;
+    qint64 rowsWritten = 0;
+    bool headerWritten = false;
+    QByteArray csvHeader;                       //As written, to tell whether it has to be rewritten
+    int csvColumns = 0;                         //Fields in csvHeader
+    int rowsSinceNewField = 0;
+
+    QStringList fieldNames;
+
+    //Current batch, one vector per column
+    QVector<qint64> timestamps;
+    QVector<quint8> directions;
+    QVector<QVector<double>> values;
+    QVector<QList<QByteArray>> textFields;     //Only kept for CSV
+    int fieldCount = 0;
+
+    void flushBatch();
+    void writeCsvBatch();
+    QByteArray makeCsvHeader();
+    bool rewriteCsvHeader();
+    void writeColumnarBatch();
+    static QByteArray csvQuote(const QByteArray &field);
+};
+
+#endif // TELEMETRYEXPORTER_H
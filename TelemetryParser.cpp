@@ -0,0 +1,129 @@
+#include "TelemetryParser.h"
+
+#include <QDateTime>
+#include <limits>
+
+TelemetryParser::TelemetryParser(QObject *parent) : QObject(parent)
+{
+
+}
+
+void TelemetryParser::feed(const QByteArray &data, bool incoming)
+{
+    //Sent and received lines interleave, each direction keeps its own partial line
+    QByteArray &lineBuffer = lineBuffers[incoming ? 1 : 0];
+    const char *bytes = data.constData();
+    int start = 0;
+    int newline = data.indexOf('\n');
+
+    while(newline >= 0){
+        if(lineBuffer.isEmpty()){
+            //Whole line inside this chunk, parse it in place
+            parseBufferedLine(bytes + start, newline - start, incoming);
+        }
+        else{
+            lineBuffer.append(bytes + start, newline - start);
+            parseBufferedLine(lineBuffer.constData(), lineBuffer.size(), incoming);
+            lineBuffer.clear();
+        }
+
+        start = newline + 1;
+        newline = data.indexOf('\n', start);
+    }
+
+    lineBuffer.append(bytes + start, data.size() - start);
+
+    //Binary data or a missing line ending should not grow the buffer forever
+    if(lineBuffer.size() > MAX_LINE_LENGTH){
+        lineBuffer.clear();
+    }
+}
+
+void TelemetryParser::reset()
+{
+    lineBuffers[0].clear();
+    lineBuffers[1].clear();
+    fieldNames.clear();
+}
+
+QStringList TelemetryParser::getFieldNames()
+{
+    return this->fieldNames;
+}
+
+void TelemetryParser::parseBufferedLine(const char *line, int size, bool incoming)
+{
+    if(parseLine(line, size, values, fields, &names) == 0){
+        return;
+    }
+
+    //Named fields update the column names, positional lines keep the previous names
+    bool namesChanged = false;
+    for(int i = 0; i < names.size(); i++){
+        if(names.at(i).isEmpty()){
+            continue;
+        }
+
+        QString name = QString::fromLatin1(names.at(i));
+        while(fieldNames.size() <= i){
+            fieldNames.append(QString("Field %1").arg(fieldNames.size() + 1));
+            namesChanged = true;
+        }
+        if(fieldNames.at(i) != name){
+            fieldNames[i] = name;
+            namesChanged = true;
+        }
+    }
+    while(fieldNames.size() < values.size()){
+        fieldNames.append(QString("Field %1").arg(fieldNames.size() + 1));
+        namesChanged = true;
+    }
+
+    if(namesChanged){
+        emit fieldNamesChanged(fieldNames);
+    }
+
+    emit rowParsed(QDateTime::currentMSecsSinceEpoch(), incoming, values, fields);
+}
+
+//Split a line into fields. Returns the number of fields found.
+int TelemetryParser::parseLine(const char *line, int size, QVector<double> &values, QList<QByteArray> &fields, QList<QByteArray> *names)
+{
+    values.clear();
+    fields.clear();
+    if(names){
+        names->clear();
+    }
+
+    int i = 0;
+    while(i < size){
+        //Skip separators
+        while(i < size && (line[i] == ',' || line[i] == ';' || line[i] == ' ' || line[i] == '\t' || line[i] == '\r')){
+            i++;
+        }
+        if(i >= size){
+            break;
+        }
+
+        int start = i;
+        int valueStart = i;
+        while(i < size && line[i] != ',' && line[i] != ';' && line[i] != ' ' && line[i] != '\t' && line[i] != '\r'){
+            if((line[i] == '=' || line[i] == ':') && valueStart == start){
+                valueStart = i + 1;
+            }
+            i++;
+        }
+
+        QByteArray value(line + valueStart, i - valueStart);
+        bool ok = false;
+        double number = value.toDouble(&ok);
+
+        values.append(ok ? number : std::numeric_limits<double>::quiet_NaN());
+        fields.append(value);
+        if(names){
+            names->append(valueStart > start ? QByteArray(line + start, valueStart - start - 1) : QByteArray());
+        }
+    }
+
+    return values.size();
+}
@@ -0,0 +1,53 @@
+#ifndef TELEMETRYPARSER_H
+#define TELEMETRYPARSER_H
+
+/*
+ * Telemetry line parser
+ *
+ * Splits the received and sent byte streams into lines and each line into fields. Fields are separated
+ * by commas, semicolons, tabs or spaces and may be written as 'name=value' or 'name:value'.
+ *
+ *      1024,22.5,-61           ->  3 unnamed fields
+ *      t=1024 temp=22.5 rssi=-61   ->  3 fields named t, temp and rssi
+ *
+ * A row is emitted for every line that contains at least one field. Numeric fields are
+ * parsed to doubles; fields that are not numbers are NaN in the value list but kept as text.
+ */
+
+#include <QObject>
+#include <QByteArray>
+#include <QVector>
+#include <QStringList>
+
+class TelemetryParser : public QObject
+{
+    Q_OBJECT
+public:
+    explicit TelemetryParser(QObject *parent = nullptr);
+
+    void feed(const QByteArray &data, bool incoming = true);
+    void reset();
+
+    QStringList getFieldNames();
+
+    static int parseLine(const char *line, int size, QVector<double> &values, QList<QByteArray> &fields, QList<QByteArray> *names);
+
+signals:
+    void rowParsed(qint64 timestamp, bool incoming, QVector<double> values, QList<QByteArray> fields);
+    void fieldNamesChanged(QStringList names);
+
+private:
+    static const int MAX_LINE_LENGTH = 4096;
+
+    QByteArray lineBuffers[2];              //Partial line per direction, indexed by incoming
+    QStringList fieldNames;
+
+    //Reused for every line
+    QVector<double> values;
+    QList<QByteArray> fields;
+    QList<QByteArray> names;
+
+    void parseBufferedLine(const char *line, int size, bool incoming);
+};
+
+#endif // TELEMETRYPARSER_H
@@ -1,31 +1,146 @@
 #include "Terminal.h"
+#include "SessionFile.h"
 
 #include <QDebug>
+#include <QScrollBar>
+#include <QTextCursor>
+#include <QApplication>
+#include <QClipboard>
+#include <QMimeData>
+#include <QTextCodec>
+
+#include <algorithm>
 
 Terminal::Terminal(QWidget *parent) : QTextEdit(parent)
 {
     this->setStyleSheet("background-color: black; color: white;");
+
+    //Text is only ever appended, an undo history would just hold a second copy of the scrollback
+    this->setUndoRedoEnabled(false);
+
+    this->utf8Decoder = QTextCodec::codecForName("UTF-8")->makeDecoder();
+
+    connect(this->verticalScrollBar(), SIGNAL(valueChanged(int)), this, SLOT(handleScroll(int)));
+}
+
+Terminal::~Terminal()
+{
+    //asciiText may still refer to the mapped session
+    asciiText.clear();
+    delete this->sessionFile;
+
+    delete this->utf8Decoder;
 }
 
-//TODO: Implement text coloring
 void Terminal::addText(QString text, bool incoming)
 {
-    asciiText.append(text);
-    this->updateTerminal(asciiText);
-    emit textAdded(text);
+    if(text.isEmpty()){
+        return;
+    }
+
+    this->appendText(text, incoming);
+
+    emit textAdded(text, incoming);
+    emit dataAdded(text.toUtf8(), incoming);
 }
 
-//TODO: Implement text coloring
+//Received bytes are decoded here and nowhere else. The bytes themselves are passed on untouched.
 void Terminal::addText(QByteArray text, bool incoming)
 {
+    if(text.isEmpty()){
+        return;
+    }
+
+    QString decoded = this->decode(text);
+    if(!decoded.isEmpty()){
+        this->appendText(decoded, incoming);
+        emit textAdded(decoded, incoming);
+    }
+
+    emit dataAdded(text, incoming);
+}
+
+void Terminal::appendText(const QString &text, bool incoming)
+{
+    int start = asciiText.size();
     asciiText.append(text);
-    this->updateTerminal(asciiText);
-    emit textAdded(text);
+    sessionChanged = true;
+    searchIndex.append(text);
+
+    //Extend the last run if the direction did not change
+    if(!runs.isEmpty() && runs.last().incoming == incoming){
+        runs.last().length += text.size();
+    }
+    else{
+        runs.append(TextRun{start, text.size(), incoming});
+    }
+
+    //Only the line still being received can contain a match that includes the new text
+    int scanFrom = qMax(currentLineStart, start - MAX_HIGHLIGHT_SPAN);
+    int newline = text.lastIndexOf('\n');
+    if(newline >= 0){
+        currentLineStart = start + newline + 1;
+    }
+
+    this->appendToDocument(start, text.size(), incoming);
+    this->applyHighlights(scanFrom, start);
+}
+
+QString Terminal::decode(const QByteArray &data)
+{
+    switch(this->textEncoding){
+        case ENCODING_ASCII:{
+            QString text(data.size(), Qt::Uninitialized);
+            QChar *out = text.data();
+            for(int i = 0; i < data.size(); i++){
+                uchar c = static_cast<uchar>(data.at(i));
+                out[i] = c < 0x80 ? QChar(c) : QChar(QChar::ReplacementCharacter);
+            }
+            return text;
+        }
+        case ENCODING_LATIN1:
+            return QString::fromLatin1(data);
+        default:
+            return this->utf8Decoder->toUnicode(data);
+    }
+}
+
+//Typed text is sent in the encoding received text is decoded with. ASCII sends '?' for anything above 0x7F.
+QByteArray Terminal::encode(const QString &text)
+{
+    if(this->textEncoding == ENCODING_UTF8){
+        return QTextCodec::codecForName("UTF-8")->fromUnicode(text);
+    }
+
+    QByteArray data = QTextCodec::codecForName("ISO-8859-1")->fromUnicode(text);
+    if(this->textEncoding == ENCODING_ASCII){
+        for(int i = 0; i < data.size(); i++){
+            if(static_cast<uchar>(data.at(i)) >= 0x80){
+                data[i] = '?';
+            }
+        }
+    }
+    return data;
+}
+
+void Terminal::clearText()
+{
+    asciiText.clear();
+    sessionChanged = true;
+    runs.clear();
+    searchIndex.clear();
+    currentLineStart = 0;
+    documentStart = 0;
+    pendingLength = 0;
+    QTextEdit::clear();
+    this->drawInputLine();
 }
 
 QString Terminal::getText()
 {
-    return this->toPlainText();
+    QString text = this->toPlainText();
+    text.chop(pendingLength);
+    return text;
 }
 
 QString Terminal::getFormattedText()
@@ -33,6 +148,83 @@ QString Terminal::getFormattedText()
     return this->toHtml();
 }
 
+Terminal::Snapshot Terminal::getSnapshot()
+{
+    //Appending after this starts a new block, the snapshot's text is never detached and copied
+    asciiText.seal();
+
+    Snapshot snapshot;
+    snapshot.text = asciiText;
+    snapshot.runs = runs;
+    snapshot.incomingColor = incomingColor;
+    snapshot.outgoingColor = outgoingColor;
+    return snapshot;
+}
+
+bool Terminal::saveSession(QString path, QString *error)
+{
+    if(sessionFile){
+        //Nothing was added since the session was restored, the file already holds it
+        if(!sessionChanged){
+            return true;
+        }
+
+        //The restored text is copied out of the mapping before the file is replaced and unmapped
+        QString text = asciiText.mid(0);
+        asciiText.clear();
+        asciiText.append(text);
+
+        delete sessionFile;
+        sessionFile = nullptr;
+    }
+
+    return SessionFile::write(path, asciiText, runs, searchIndex, error);
+}
+
+//The scrollback is used straight from the mapped file, nothing is copied or parsed. Only the
+//last DISPLAY_BLOCK characters are put in the document, so restoring takes about as long
+//however large the session is.
+bool Terminal::restoreSession(QString path, QString *error)
+{
+    SessionFile *file = new SessionFile();
+    if(!file->open(path, error)){
+        delete file;
+        return false;
+    }
+
+    QVector<TextRun> restoredRuns = file->runs();
+    if(restoredRuns.isEmpty() && file->textLength() > 0){
+        if(error){
+            *error = QString("%1 is not a valid session file").arg(path);
+        }
+        delete file;
+        return false;
+    }
+
+    this->clearText();
+
+    //A sealed block, new text goes after it and never detaches (copies) the mapping
+    QString text = QString::fromRawData(file->textData(), file->textLength());
+    asciiText.append(text);
+    asciiText.seal();
+    runs = restoredRuns;
+    sessionChanged = false;
+
+    delete sessionFile;
+    sessionFile = file;
+
+    if(!file->readIndex(&searchIndex) || searchIndex.size() != asciiText.size()){
+        searchIndex.clear();
+        searchIndex.append(text);
+    }
+
+    currentLineStart = asciiText.lastIndexOf('\n') + 1;
+
+    this->showFrom(qMax(0, asciiText.size() - DISPLAY_BLOCK));
+    this->verticalScrollBar()->setValue(this->verticalScrollBar()->maximum());
+    return true;
+}
+
 void Terminal::enableEcho(bool enable)
 {
     this->echoEnabled = enable;
@@ -41,11 +233,71 @@ void Terminal::enableEcho(bool enable)
 void Terminal::setDisplayMode(Terminal::DisplayMode mode)
 {
     this->displayMode = mode;
-    this->updateTerminal(this->asciiText);
+    this->renderAll();
+}
+
+void Terminal::setTextEncoding(Terminal::TextEncoding encoding)
+{
+    this->textEncoding = encoding;
+
+    //Drop any partial UTF-8 sequence carried over from the previous encoding
+    delete this->utf8Decoder;
+    this->utf8Decoder = QTextCodec::codecForName("UTF-8")->makeDecoder();
+}
+
+void Terminal::setInputMode(Terminal::InputMode mode)
+{
+    this->removeInputLine();
+    this->inputMode = mode;
+    this->inputLine.clear();
+    this->drawInputLine();
+}
+
+void Terminal::setLineEnding(QByteArray ending)
+{
+    this->lineEnding = ending;
+}
+
+void Terminal::setDirectionColors(QColor incoming, QColor outgoing)
+{
+    this->incomingColor = incoming;
+    this->outgoingColor = outgoing;
+    this->renderAll();
+}
+
+void Terminal::addHighlightRule(QString pattern, QColor background, bool isRegex)
+{
+    HighlightRule rule;
+    rule.regex = QRegularExpression(isRegex ? pattern : QRegularExpression::escape(pattern));
+    rule.background = background;
+
+    if(pattern.isEmpty() || !rule.regex.isValid()){
+        qDebug() << "Terminal: invalid highlight pattern" << pattern;
+        return;
+    }
+
+    rule.regex.optimize();
+    highlightRules.append(rule);
+
+    //Existing scrollback gets the new rule once, new text is handled as it arrives
+    this->applyHighlights(0, 0);
+}
+
+void Terminal::clearHighlightRules()
+{
+    if(!highlightRules.isEmpty()){
+        highlightRules.clear();
+        this->renderAll();
+    }
 }
 
 void Terminal::keyPressEvent(QKeyEvent *e)
 {
+    if(this->inputMode == LINE){
+        this->lineModeKeyPress(e);
+        return;
+    }
+
     QString key = e->text();
 
     char c = 0;
@@ -71,30 +323,368 @@ void Terminal::keyPressEvent(QKeyEvent *e)
     }
 }
 
-void Terminal::updateTerminal(QString text)
+//Edit the input line locally. The whole line (or paste) is sent as a single write on Enter.
+void Terminal::lineModeKeyPress(QKeyEvent *e)
 {
-    if(this->displayMode == ASCII){
-        this->setText(text);
+    if(e->key() == Qt::Key_Return || e->key() == Qt::Key_Enter){
+        QString line = inputLine;
+
+        if(!line.isEmpty() && (inputHistory.isEmpty() || inputHistory.last() != line)){
+            inputHistory.append(line);
+            if(inputHistory.size() > MAX_INPUT_HISTORY){
+                inputHistory.removeFirst();
+            }
+        }
+        historyIndex = inputHistory.size();
+
+        this->removeInputLine();
+        inputLine.clear();
+
+        //Pasted line breaks are sent with the configured line ending as well
+        QByteArray data = this->encode(line);
+        data.replace("\n", lineEnding);
+        data.append(lineEnding);
+        emit lineEnterred(data);
+
+        if(echoEnabled){
+            QString ending = QString::fromLatin1(lineEnding);
+            addText(QString(line).replace("\n", ending) + ending, false);
+        }
+        else{
+            this->drawInputLine();
+        }
+        return;
+    }
+
+    if(e->matches(QKeySequence::Paste)){
+        this->pasteIntoLine(QApplication::clipboard()->text());
+        return;
+    }
+
+    if(e->key() == Qt::Key_Backspace){
+        inputLine.chop(1);
+    }
+    else if(e->key() == Qt::Key_Escape){
+        inputLine.clear();
+    }
+    else if(e->key() == Qt::Key_Up){
+        if(historyIndex > 0){
+            inputLine = inputHistory.at(--historyIndex);
+        }
+    }
+    else if(e->key() == Qt::Key_Down){
+        if(historyIndex < inputHistory.size()){
+            historyIndex++;
+            inputLine = historyIndex < inputHistory.size() ? inputHistory.at(historyIndex) : QString();
+        }
+    }
+    else if(!e->text().isEmpty() && e->text().at(0).isPrint()){
+        inputLine.append(e->text());
     }
     else{
-        this->setText(asciiTextToHex(text));
+        return;
+    }
+
+    this->removeInputLine();
+    this->drawInputLine();
+    this->verticalScrollBar()->setValue(this->verticalScrollBar()->maximum());
+}
+
+//Pasted line breaks stay in the line, they are sent with the line ending on Enter
+void Terminal::pasteIntoLine(QString text)
+{
+    text.replace("\r\n", "\n");
+    text.replace('\r', '\n');
+    inputLine.append(text);
+
+    this->removeInputLine();
+    this->drawInputLine();
+    this->verticalScrollBar()->setValue(this->verticalScrollBar()->maximum());
+}
+
+//Paste from the context menu, middle click or a drop. The document only ever shows the scrollback
+//and the input line, so nothing is inserted into it directly.
+void Terminal::insertFromMimeData(const QMimeData *source)
+{
+    if(this->inputMode == LINE && source->hasText()){
+        this->pasteIntoLine(source->text());
+    }
+}
+
+//Remove the input line drawn at the end of the document
+void Terminal::removeInputLine()
+{
+    if(pendingLength == 0){
+        return;
+    }
+
+    QTextCursor cursor(this->document());
+    cursor.movePosition(QTextCursor::End);
+    cursor.movePosition(QTextCursor::Left, QTextCursor::KeepAnchor, pendingLength);
+    cursor.removeSelectedText();
+    pendingLength = 0;
+}
+
+//Draw the input line, with a block cursor, after the scrollback
+void Terminal::drawInputLine()
+{
+    if(this->inputMode != LINE){
+        return;
+    }
+
+    QString text = inputLine + QChar(0x2588);
+
+    QTextCursor cursor(this->document());
+    cursor.movePosition(QTextCursor::End);
+    cursor.insertText(text, directionFormat(false));
+    pendingLength = text.size();
+}
+
+//Find up to maxResults matches of query (case insensitive) in the scrollback
+QVector<SearchIndex::Range> Terminal::search(QString query, int maxResults)
+{
+    QVector<SearchIndex::Range> matches;
+
+    if(query.isEmpty()){
+        return matches;
+    }
+
+    //The index only narrows the search down, candidate ranges are verified against the text
+    QString scratch;
+    for(const SearchIndex::Range &range : searchIndex.candidateRanges(query)){
+        QStringRef candidate = asciiText.midRef(static_cast<int>(range.first), static_cast<int>(range.second), &scratch);
+
+        int index = candidate.indexOf(query, 0, Qt::CaseInsensitive);
+        while(index >= 0){
+            matches.append(SearchIndex::Range(range.first + index, query.size()));
+            if(matches.size() >= maxResults){
+                return matches;
+            }
+            index = candidate.indexOf(query, index + 1, Qt::CaseInsensitive);
+        }
+    }
+
+    return matches;
+}
+
+//Select a match in the terminal and scroll it into view
+void Terminal::showMatch(qint64 offset, qint64 length)
+{
+    if(offset < 0 || offset + length > asciiText.size()){
+        return;
+    }
+
+    //The match is in scrollback that has not been displayed yet
+    if(offset < documentStart){
+        this->showFrom(static_cast<int>(offset));
+    }
+
+    int endPosition = documentPosition(static_cast<int>(offset + length));
+    if(this->displayMode == HEX){
+        endPosition--;
+    }
+
+    QTextCursor cursor(this->document());
+    cursor.setPosition(documentPosition(static_cast<int>(offset)));
+    cursor.setPosition(endPosition, QTextCursor::KeepAnchor);
+    this->setTextCursor(cursor);
+    this->ensureCursorVisible();
+}
+
+qint64 Terminal::lineOfOffset(qint64 offset)
+{
+    return searchIndex.lineOfOffset(offset);
+}
+
+QString Terminal::lineText(qint64 offset, int maxChars)
+{
+    qint64 line = searchIndex.lineOfOffset(offset);
+    qint64 lineStart = searchIndex.lineStart(line);
+    qint64 lineEnd = searchIndex.lineStart(line + 1);
+
+    //A line can be megabytes long on a stream without newlines, only the window is read
+    qint64 start = qMax(lineStart, offset - maxChars / 4);
+    qint64 end = qMin(lineEnd, start + maxChars);
+
+    QString scratch;
+    QString text = asciiText.midRef(static_cast<int>(start), static_cast<int>(end - start), &scratch).toString();
+    text.remove('\r');
+    text.remove('\n');
+    return text;
+}
+
+//Rebuild the whole document from the runs. Only needed when the display mode or colors change.
+void Terminal::renderAll()
+{
+    QTextEdit::clear();
+    pendingLength = 0;
+
+    QTextCursor cursor(this->document());
+    cursor.beginEditBlock();
+    this->insertRange(cursor, documentStart, asciiText.size());
+    cursor.endEditBlock();
+
+    this->applyHighlights(documentStart, documentStart);
+    this->drawInputLine();
+}
+
+//Insert asciiText[from, to) at the cursor, each run in the color of its direction
+void Terminal::insertRange(QTextCursor &cursor, int from, int to)
+{
+    auto first = std::upper_bound(runs.constBegin(), runs.constEnd(), from,
+                                  [](int offset, const TextRun &run){ return offset < run.start; });
+    if(first != runs.constBegin()){
+        --first;
+    }
+
+    for(auto run = first; run != runs.constEnd() && run->start < to; ++run){
+        int start = qMax(run->start, from);
+        int end = qMin(run->start + run->length, to);
+        if(start >= end){
+            continue;
+        }
+
+        QString segment = asciiText.mid(start, end - start);
+        if(this->displayMode == HEX){
+            segment = asciiTextToHex(segment);
+        }
+        cursor.insertText(segment, directionFormat(run->incoming));
+    }
+}
+
+//Start the document at the line containing offset
+void Terminal::showFrom(int offset)
+{
+    documentStart = offset > 0 ? asciiText.lastIndexOf('\n', offset - 1) + 1 : 0;
+    this->renderAll();
+}
+
+//Put the block of scrollback before the document at its start, keeping the view where it was
+void Terminal::loadEarlierText()
+{
+    if(documentStart == 0 || loadingEarlierText){
+        return;
+    }
+    loadingEarlierText = true;
+
+    int newStart = qMax(0, documentStart - DISPLAY_BLOCK);
+    if(newStart > 0){
+        newStart = asciiText.lastIndexOf('\n', newStart - 1) + 1;
+    }
+
+    QScrollBar *scrollBar = this->verticalScrollBar();
+    int oldMaximum = scrollBar->maximum();
+    int oldValue = scrollBar->value();
+
+    QTextCursor cursor(this->document());
+    cursor.setPosition(0);
+    cursor.beginEditBlock();
+    this->insertRange(cursor, newStart, documentStart);
+    cursor.endEditBlock();
+
+    documentStart = newStart;
+    this->applyHighlights(newStart, newStart);
+
+    scrollBar->setValue(oldValue + scrollBar->maximum() - oldMaximum);
+    loadingEarlierText = false;
+}
+
+void Terminal::handleScroll(int value)
+{
+    QScrollBar *scrollBar = this->verticalScrollBar();
+    if(documentStart > 0 && value == scrollBar->minimum() && scrollBar->maximum() > scrollBar->minimum()){
+        this->loadEarlierText();
     }
 }
 
+//Append a slice of asciiText to the end of the document in the color of its direction
+void Terminal::appendToDocument(int start, int length, bool incoming)
+{
+    QScrollBar *scrollBar = this->verticalScrollBar();
+    bool followOutput = scrollBar->value() >= scrollBar->maximum();
+
+    QString segment = asciiText.mid(start, length);
+    if(this->displayMode == HEX){
+        segment = asciiTextToHex(segment);
+    }
+
+    this->removeInputLine();
+
+    QTextCursor cursor(this->document());
+    cursor.movePosition(QTextCursor::End);
+    cursor.insertText(segment, directionFormat(incoming));
+
+    this->drawInputLine();
+
+    if(followOutput){
+        scrollBar->setValue(scrollBar->maximum());
+    }
+}
+
+//Apply the highlight rules to matches found from scanFrom onwards that end in text added at newTextStart or later
+void Terminal::applyHighlights(int scanFrom, int newTextStart)
+{
+    if(highlightRules.isEmpty()){
+        return;
+    }
+
+    //Text before the document is not displayed, there is nothing to color
+    scanFrom = qMax(scanFrom, documentStart);
+
+    QTextCursor cursor(this->document());
+    QString scannedText = asciiText.mid(scanFrom);
+
+    for(const HighlightRule &rule : highlightRules){
+        QTextCharFormat format;
+        format.setBackground(rule.background);
+        format.setForeground(Qt::black);
+
+        QRegularExpressionMatchIterator it = rule.regex.globalMatch(scannedText);
+        while(it.hasNext()){
+            QRegularExpressionMatch match = it.next();
+            if(match.capturedLength() == 0 || scanFrom + match.capturedEnd() <= newTextStart){
+                continue;
+            }
+
+            int endPosition = documentPosition(scanFrom + match.capturedEnd());
+            if(this->displayMode == HEX){
+                endPosition--;  //Leave the trailing separator space uncolored
+            }
+
+            cursor.setPosition(documentPosition(scanFrom + match.capturedStart()));
+            cursor.setPosition(endPosition, QTextCursor::KeepAnchor);
+            cursor.mergeCharFormat(format);
+        }
+    }
+}
+
+//Every character of asciiText from documentStart on is one document position in ASCII mode and three ("HH ") in hex mode
+int Terminal::documentPosition(int textOffset)
+{
+    int position = qMax(0, textOffset - documentStart);
+    return this->displayMode == HEX ? position * 3 : position;
+}
+
+QTextCharFormat Terminal::directionFormat(bool incoming)
+{
+    QTextCharFormat format;
+    format.setForeground(incoming ? incomingColor : outgoingColor);
+    return format;
+}
+
 QString Terminal::asciiTextToHex(QString text)
 {
-    const static std::string asciiLookup = "0123456789ABCDEF";
+    const static char hexLookup[] = "0123456789ABCDEF";
+
     //Replace each character with its hex equivalent and a space
-    QString hex;
+    QString hex(text.size() * 3, Qt::Uninitialized);
+    QChar *out = hex.data();
 
     for(QChar qc : text){
-        char c = qc.toLatin1();
-        char lower, higher;
-        lower = asciiLookup[c & 0x0F];
-        higher = asciiLookup[(c & 0xF0) >> 4];
-        hex += higher;
-        hex += lower;
-        hex += " ";
+        ushort c = qc.unicode();
+        *out++ = QLatin1Char(c > 0xFF ? '?' : hexLookup[c >> 4]);
+        *out++ = QLatin1Char(c > 0xFF ? '?' : hexLookup[c & 0x0F]);
+        *out++ = QLatin1Char(' ');
     }
 
     return hex;
@@ -5,40 +5,166 @@
 #include <QWidget>
 #include <QTextEdit>
 #include <QKeyEvent>
+#include <QVector>
+#include <QColor>
+#include <QRegularExpression>
+#include <QTextCharFormat>
+#include <QStringList>
+#include <QTextDecoder>
+
+#include "SearchIndex.h"
+#include "ScrollbackText.h"
+
+class SessionFile;
 
 class Terminal : public QTextEdit
 {
     Q_OBJECT
 public:
     Terminal(QWidget *parent);
+    ~Terminal();
 
     enum DisplayMode{
         ASCII,
         HEX,
     };
 
+    //CHARACTER sends every key as it is typed, LINE edits the line locally and sends it on Enter
+    enum InputMode{
+        CHARACTER,
+        LINE,
+    };
+
+    //How received bytes are turned into text. Decoding happens once, when the bytes are displayed.
+    enum TextEncoding{
+        ENCODING_ASCII,         //Bytes above 0x7F are shown as U+FFFD
+        ENCODING_LATIN1,
+        ENCODING_UTF8,          //Sequences split across notifications are carried over
+    };
+
     void addText(QString text, bool incoming);
     void addText(QByteArray text, bool incoming);
+    void clearText();
 
     QString getText();
     QString getFormattedText();
 
+    //A run of consecutive characters received (or sent) in one direction
+    struct TextRun{
+        int start;
+        int length;
+        bool incoming;
+    };
+
+    //The scrollback at one point in time, for reading off the GUI thread (see ExportJob).
+    //The text is sealed and shared, never copied: the terminal appends to a new block after it.
+    struct Snapshot{
+        ScrollbackText text;
+        QVector<TextRun> runs;
+        QColor incomingColor;
+        QColor outgoingColor;
+    };
+
+    Snapshot getSnapshot();
+
+    //Session persistence (see SessionFile). A restored scrollback stays memory mapped and only
+    //its end is put in the document; earlier text is added when it is scrolled or searched to.
+    bool saveSession(QString path, QString *error = nullptr);
+    bool restoreSession(QString path, QString *error = nullptr);
+
     void enableEcho(bool enable);
     void setDisplayMode(DisplayMode mode);
+    void setTextEncoding(TextEncoding encoding);
+
+    //Line input
+    void setInputMode(InputMode mode);
+    void setLineEnding(QByteArray ending);
+
+    //Coloring
+    void setDirectionColors(QColor incoming, QColor outgoing);
+    void addHighlightRule(QString pattern, QColor background, bool isRegex = true);
+    void clearHighlightRules();
+
+    //Searching
+    QVector<SearchIndex::Range> search(QString query, int maxResults);
+    void showMatch(qint64 offset, qint64 length);
+    qint64 lineOfOffset(qint64 offset);
+    //At most maxChars of the line containing offset, the part around offset on long lines
+    QString lineText(qint64 offset, int maxChars);
+
+    //Each character as two hex digits and a space, as shown in hex mode. Hex is rendered from the
+    //decoded text, so it only shows the received bytes for Latin-1 (and 7 bit ASCII). A character
+    //that is not a single byte, e.g. U+FFFD for a byte ASCII mode could not decode, shows as "??".
+    static QString asciiTextToHex(QString text);
 
 signals:
     void textEnterred(char c);
-    void textAdded(QString text);
+    void lineEnterred(QByteArray line);
+    void textAdded(QString text, bool incoming);
+    void dataAdded(QByteArray data, bool incoming);     //The raw bytes behind textAdded
 
 private:
     void keyPressEvent(QKeyEvent *e) override;
+    void insertFromMimeData(const QMimeData *source) override;
 
-    QString asciiText;
+    struct HighlightRule{
+        QRegularExpression regex;
+        QColor background;
+    };
+
+    ScrollbackText asciiText;
+    QVector<TextRun> runs;
+    QVector<HighlightRule> highlightRules;
+    SearchIndex searchIndex;
     DisplayMode displayMode = ASCII;
+    TextEncoding textEncoding = ENCODING_UTF8;
+    QTextDecoder *utf8Decoder = nullptr;
     bool echoEnabled = false;
 
-    void updateTerminal(QString text);
-    QString asciiTextToHex(QString text);
+    QColor incomingColor = Qt::white;
+    QColor outgoingColor = QColor(0x4F, 0xC3, 0xF7);
+    int currentLineStart = 0;           //Offset in asciiText of the line still being received
+    int documentStart = 0;              //Offset in asciiText of the first character in the document
+    bool loadingEarlierText = false;
+
+    //Restored scrollback, the first block of asciiText refers to its mapping until the session is saved
+    SessionFile *sessionFile = nullptr;
+    bool sessionChanged = false;        //Text was added or cleared since the session was restored
+
+    //Line input. The line being edited is drawn after the scrollback and is not part of asciiText.
+    InputMode inputMode = CHARACTER;
+    QByteArray lineEnding = "\r\n";
+    QString inputLine;
+    QStringList inputHistory;
+    int historyIndex = 0;               //inputHistory.size() when not browsing the history
+    int pendingLength = 0;              //Document positions taken by the drawn input line
+
+    static const int MAX_INPUT_HISTORY = 100;
+
+    //Matches are only searched for this far back from newly added text
+    static const int MAX_HIGHLIGHT_SPAN = 1024;
+
+    //Characters added to the document at a time when earlier scrollback is shown
+    static const int DISPLAY_BLOCK = 256 * 1024;
+
+    void appendText(const QString &text, bool incoming);
+    QString decode(const QByteArray &data);
+    QByteArray encode(const QString &text);
+    void renderAll();
+    void insertRange(QTextCursor &cursor, int from, int to);
+    void loadEarlierText();
+    void showFrom(int offset);
+    void lineModeKeyPress(QKeyEvent *e);
+    void pasteIntoLine(QString text);
+    void removeInputLine();
+    void drawInputLine();
+    void appendToDocument(int start, int length, bool incoming);
+    void applyHighlights(int scanFrom, int newTextStart);
+    int documentPosition(int textOffset);
+    QTextCharFormat directionFormat(bool incoming);
+
+private slots:
+    void handleScroll(int value);
 };
 
 #endif // TERMINAL_H
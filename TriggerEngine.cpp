@@ -0,0 +1,489 @@
+#include "TriggerEngine.h"
+
+#include <QStringList>
+
+TriggerEngine::TriggerEngine(QObject *parent) : QObject(parent)
+{
+    buildAutomaton();
+}
+
+int TriggerEngine::addLiteral(QString pattern, TriggerEngine::Action action, QByteArray reply)
+{
+    if(unescape(pattern).isEmpty()){
+        return -1;
+    }
+
+    Trigger trigger;
+    trigger.pattern = pattern;
+    trigger.isRegex = false;
+    trigger.action = action;
+    trigger.reply = reply;
+    triggers.append(trigger);
+
+    automatonDirty = true;
+
+    return triggers.size() - 1;
+}
+
+int TriggerEngine::addRegex(QString pattern, TriggerEngine::Action action, QByteArray reply)
+{
+    QRegularExpression regex(pattern);
+    if(pattern.isEmpty() || !regex.isValid()){
+        return -1;
+    }
+    regex.optimize();
+
+    Trigger trigger;
+    trigger.pattern = pattern;
+    trigger.isRegex = true;
+    trigger.action = action;
+    trigger.reply = reply;
+    triggers.append(trigger);
+
+    regexes.append(regex);
+    regexTriggers.append(triggers.size() - 1);
+
+    return triggers.size() - 1;
+}
+
+void TriggerEngine::clear()
+{
+    triggers.clear();
+    regexes.clear();
+    regexTriggers.clear();
+    automatonDirty = true;
+    reset();
+}
+
+bool TriggerEngine::setRules(QString rules, QString *error)
+{
+    struct Rule{
+        Action action;
+        bool isRegex;
+        QString pattern;
+        QByteArray reply;
+    };
+    QList<Rule> parsed;
+
+    //Parse everything first so a bad rule leaves the current triggers untouched
+    QStringList lines = rules.split('\n');
+    for(int i = 0; i < lines.size(); i++){
+        QString line = lines.at(i).trimmed();
+        if(line.isEmpty() || line.startsWith('#')){
+            continue;
+        }
+
+        QStringList tokens = line.split(QRegularExpression("\\s+"), QString::SkipEmptyParts);
+        QString problem;
+        Rule rule;
+
+        if(tokens.size() < 3 || tokens.size() > 4){
+            problem = "expected '<action> <literal|regex> <pattern> [reply]'";
+        }
+        else if(!parseAction(tokens.at(0), &rule.action)){
+            problem = QString("unknown action '%1'").arg(tokens.at(0));
+        }
+        else if(tokens.at(1) != "literal" && tokens.at(1) != "regex"){
+            problem = QString("unknown pattern type '%1'").arg(tokens.at(1));
+        }
+        else{
+            rule.isRegex = tokens.at(1) == "regex";
+            rule.pattern = tokens.at(2);
+            rule.reply = tokens.size() == 4 ? unescape(tokens.at(3)) : QByteArray();
+
+            if(rule.action == AutoReply && rule.reply.isEmpty()){
+                problem = "reply action needs a reply";
+            }
+            else if(rule.isRegex && !QRegularExpression(rule.pattern).isValid()){
+                problem = QString("invalid regex '%1'").arg(rule.pattern);
+            }
+        }
+
+        if(!problem.isEmpty()){
+            if(error){
+                *error = QString("Line %1: %2").arg(i + 1).arg(problem);
+            }
+            return false;
+        }
+
+        parsed.append(rule);
+    }
+
+    clear();
+    for(const Rule &rule : parsed){
+        if(rule.isRegex){
+            addRegex(rule.pattern, rule.action, rule.reply);
+        }
+        else{
+            addLiteral(rule.pattern, rule.action, rule.reply);
+        }
+    }
+
+    return true;
+}
+
+QString TriggerEngine::getRules()
+{
+    QString rules;
+
+    for(const Trigger &trigger : triggers){
+        rules += actionName(trigger.action);
+        rules += trigger.isRegex ? " regex " : " literal ";
+        rules += trigger.pattern;
+        if(!trigger.reply.isEmpty()){
+            rules += " " + escape(trigger.reply);
+        }
+        rules += "\n";
+    }
+
+    return rules;
+}
+
+TriggerEngine::Trigger TriggerEngine::getTrigger(int index)
+{
+    return triggers.value(index);
+}
+
+int TriggerEngine::getTriggerCount()
+{
+    return triggers.size();
+}
+
+void TriggerEngine::feed(const QByteArray &data)
+{
+    if(automatonDirty){
+        buildAutomaton();
+    }
+
+    const char *bytes = data.constData();
+    const int size = data.size();
+
+    //Find our own data first, so matches inside it can be skipped
+    if(!pendingEchoes.isEmpty()){
+        trackEchoes(bytes, size);
+    }
+    const bool checkEchoes = echoMatched > 0 || !echoedRanges.isEmpty();
+
+    //Literal patterns: one table lookup per byte, state carried over from the previous call
+    if(transitions.size() > 1){
+        const std::array<int, ALPHABET_SIZE> *table = transitions.constData();
+        const QVector<int> *out = outputs.constData();
+        int s = this->state;
+
+        for(int i = 0; i < size; i++){
+            s = table[s][static_cast<uchar>(bytes[i])];
+
+            if(!out[s].isEmpty()){
+                for(int index : out[s]){
+                    qint64 end = streamOffset + i + 1;
+                    if(checkEchoes && isEchoed(end - literalLengths.at(index), end)){
+                        continue;
+                    }
+
+                    triggers[index].hits++;
+                    emit triggered(index, end);
+                }
+            }
+        }
+
+        this->state = s;
+    }
+
+    //Regex patterns: matched once per completed line
+    if(!regexes.isEmpty()){
+        int lineStart = 0;
+        int newline = data.indexOf('\n');
+
+        while(newline >= 0){
+            regexLine.append(bytes + lineStart, newline - lineStart);
+            matchRegexes(streamOffset + newline);
+            regexLine.clear();
+
+            lineStart = newline + 1;
+            newline = data.indexOf('\n', lineStart);
+        }
+
+        regexLine.append(bytes + lineStart, size - lineStart);
+
+        if(regexLine.size() > MAX_REGEX_LINE){
+            matchRegexes(streamOffset + size);
+            regexLine.clear();
+        }
+    }
+
+    streamOffset += size;
+}
+
+void TriggerEngine::reset()
+{
+    this->state = 0;
+    this->streamOffset = 0;
+    this->regexLine.clear();
+    this->pendingEchoes.clear();
+    this->echoMatched = 0;
+    this->echoedRanges.clear();
+}
+
+//Called with data about to be sent, e.g. an automatic reply
+void TriggerEngine::expectEcho(const QByteArray &data)
+{
+    if(data.isEmpty()){
+        return;
+    }
+
+    if(pendingEchoes.size() >= MAX_ECHOES){
+        pendingEchoes.dequeue();
+        echoMatched = 0;
+    }
+
+    pendingEchoes.enqueue(Echo{data, streamOffset});
+}
+
+//Look for the pending echoes, in the order they were sent, in newly received bytes
+void TriggerEngine::trackEchoes(const char *data, int size)
+{
+    for(int i = 0; i < size && !pendingEchoes.isEmpty(); i++){
+        qint64 offset = streamOffset + i;
+
+        //Sent data that did not come back soon after is not coming back
+        if(echoMatched == 0 && offset - pendingEchoes.head().expectedAt > ECHO_WINDOW){
+            pendingEchoes.dequeue();
+            i--;
+            continue;
+        }
+
+        const QByteArray &echo = pendingEchoes.head().data;
+        if(echo.at(echoMatched) != data[i]){
+            //Something else came in the middle, look for the echo again from this byte
+            echoMatched = 0;
+            if(echo.at(0) != data[i]){
+                continue;
+            }
+        }
+
+        if(echoMatched == 0){
+            echoStart = offset;
+        }
+        echoMatched++;
+
+        if(echoMatched == echo.size()){
+            echoedRanges.append(qMakePair(echoStart, offset + 1));
+            if(echoedRanges.size() > MAX_ECHOES){
+                echoedRanges.removeFirst();
+            }
+
+            pendingEchoes.dequeue();
+            echoMatched = 0;
+        }
+    }
+}
+
+//Whether the stream range [start, end) lies within data we sent ourselves
+bool TriggerEngine::isEchoed(qint64 start, qint64 end)
+{
+    //An echo still arriving covers everything received since it started
+    if(echoMatched > 0 && start >= echoStart){
+        return true;
+    }
+
+    for(const QPair<qint64, qint64> &range : echoedRanges){
+        if(start >= range.first && end <= range.second){
+            return true;
+        }
+    }
+
+    return false;
+}
+
+//Match every regex against the accumulated line, which ends at lineEndOffset in the stream
+void TriggerEngine::matchRegexes(qint64 lineEndOffset)
+{
+    //Latin-1 keeps character offsets equal to byte offsets
+    QString line = QString::fromLatin1(regexLine);
+    qint64 lineStartOffset = lineEndOffset - regexLine.size();
+
+    const bool checkEchoes = echoMatched > 0 || !echoedRanges.isEmpty();
+
+    for(int i = 0; i < regexes.size(); i++){
+        QRegularExpressionMatchIterator it = regexes.at(i).globalMatch(line);
+        while(it.hasNext()){
+            QRegularExpressionMatch match = it.next();
+            qint64 end = lineStartOffset + match.capturedEnd();
+            if(checkEchoes && isEchoed(lineStartOffset + match.capturedStart(), end)){
+                continue;
+            }
+
+            int index = regexTriggers.at(i);
+            triggers[index].hits++;
+            emit triggered(index, end);
+        }
+    }
+}
+
+void TriggerEngine::buildAutomaton()
+{
+    std::array<int, ALPHABET_SIZE> empty;
+    empty.fill(-1);
+
+    transitions.clear();
+    outputs.clear();
+    transitions.append(empty);
+    outputs.append(QVector<int>());
+    literalLengths.fill(0, triggers.size());
+
+    //Build the trie of all literal patterns
+    for(int i = 0; i < triggers.size(); i++){
+        if(triggers.at(i).isRegex){
+            continue;
+        }
+
+        QByteArray pattern = unescape(triggers.at(i).pattern);
+        literalLengths[i] = pattern.size();
+        int node = 0;
+
+        for(char c : pattern){
+            uchar b = static_cast<uchar>(c);
+            if(transitions[node][b] < 0){
+                transitions[node][b] = transitions.size();
+                transitions.append(empty);
+                outputs.append(QVector<int>());
+            }
+            node = transitions[node][b];
+        }
+
+        outputs[node].append(i);
+    }
+
+    //Breadth first pass computes the failure links and turns missing edges into
+    //the transition the failure link would take, giving a complete DFA
+    QVector<int> fail(transitions.size(), 0);
+    QQueue<int> queue;
+
+    for(int c = 0; c < ALPHABET_SIZE; c++){
+        int next = transitions[0][c];
+        if(next < 0){
+            transitions[0][c] = 0;
+        }
+        else{
+            fail[next] = 0;
+            queue.enqueue(next);
+        }
+    }
+
+    while(!queue.isEmpty()){
+        int node = queue.dequeue();
+
+        //Patterns ending at the failure state also end here
+        outputs[node] += outputs.at(fail.at(node));
+
+        for(int c = 0; c < ALPHABET_SIZE; c++){
+            int next = transitions[node][c];
+            if(next < 0){
+                transitions[node][c] = transitions[fail.at(node)][c];
+            }
+            else{
+                fail[next] = transitions[fail.at(node)][c];
+                queue.enqueue(next);
+            }
+        }
+    }
+
+    automatonDirty = false;
+    this->state = 0;
+}
+
+QByteArray TriggerEngine::unescape(QString text)
+{
+    QByteArray data;
+    data.reserve(text.size());
+
+    for(int i = 0; i < text.size(); i++){
+        QChar c = text.at(i);
+
+        if(c == '\\' && i + 1 < text.size()){
+            QChar e = text.at(++i);
+
+            if(e == 's')        data.append(' ');
+            else if(e == 't')   data.append('\t');
+            else if(e == 'r')   data.append('\r');
+            else if(e == 'n')   data.append('\n');
+            else if(e == '\\')  data.append('\\');
+            else if(e == 'x' && i + 2 < text.size()){
+                bool ok = false;
+                int value = text.mid(i + 1, 2).toInt(&ok, 16);
+                if(ok){
+                    data.append(static_cast<char>(value));
+                    i += 2;
+                }
+                else{
+                    data.append("\\x");
+                }
+            }
+            else{
+                data.append('\\');
+                data.append(QString(e).toUtf8());
+            }
+        }
+        else if(c.unicode() < 256){
+            data.append(static_cast<char>(c.unicode()));
+        }
+        else{
+            data.append(QString(c).toUtf8());
+        }
+    }
+
+    return data;
+}
+
+QString TriggerEngine::escape(QByteArray data)
+{
+    const static std::string asciiLookup = "0123456789ABCDEF";
+    QString text;
+
+    for(char c : data){
+        uchar b = static_cast<uchar>(c);
+
+        if(c == ' ')        text += "\\s";
+        else if(c == '\t')  text += "\\t";
+        else if(c == '\r')  text += "\\r";
+        else if(c == '\n')  text += "\\n";
+        else if(c == '\\')  text += "\\\\";
+        else if(b < 0x20 || b >= 0x7F){
+            text += "\\x";
+            text += asciiLookup[(b & 0xF0) >> 4];
+            text += asciiLookup[b & 0x0F];
+        }
+        else{
+            text += c;
+        }
+    }
+
+    return text;
+}
+
+QString TriggerEngine::actionName(TriggerEngine::Action action)
+{
+    switch(action){
+        case Highlight:     return "highlight";
+        case AutoReply:     return "reply";
+        case StartLogging:  return "startlog";
+        case StopLogging:   return "stoplog";
+        case Mark:          return "mark";
+    }
+
+    return QString();
+}
+
+bool TriggerEngine::parseAction(QString name, TriggerEngine::Action *action)
+{
+    const Action actions[] = {Highlight, AutoReply, StartLogging, StopLogging, Mark};
+
+    for(Action a : actions){
+        if(actionName(a) == name.toLower()){
+            *action = a;
+            return true;
+        }
+    }
+
+    return false;
+}
@@ -0,0 +1,121 @@
+#ifndef TRIGGERENGINE_H
+#define TRIGGERENGINE_H
+
+/*
+ * Streaming trigger engine
+ *
+ * Watches the receive stream for patterns and reports a match as soon as the bytes completing it arrive.
+ *
+ * Literal patterns are compiled into a single Aho-Corasick automaton (a full DFA, one table lookup
+ * per byte). The automaton state is carried between calls to feed(), so a pattern split across
+ * two notifications still matches and no byte is ever scanned twice.
+ *
+ * Regex patterns are precompiled and matched once per received line, the line being accumulated
+ * across notifications. Lines longer than MAX_REGEX_LINE are matched in pieces.
+ *
+ * Rules can be given as text, one per line:
+ *
+ *      <action> <literal|regex> <pattern> [reply]
+ *
+ * action is one of highlight, reply, startlog, stoplog or mark. Patterns and replies cannot contain
+ * whitespace; use the escapes \s (space), \t, \r, \n, \\ and \xHH instead. Lines starting with # are comments.
+ *
+ * Data we send ourselves can come straight back (the loopback transport or a device that echoes).
+ * Replies are registered with expectEcho(), and a match lying entirely within the echoed bytes does
+ * not fire, so a reply that contains its own trigger pattern does not keep triggering itself.
+ */
+
+#include <QObject>
+#include <QByteArray>
+#include <QString>
+#include <QList>
+#include <QVector>
+#include <QRegularExpression>
+#include <QQueue>
+#include <QPair>
+#include <array>
+
+class TriggerEngine : public QObject
+{
+    Q_OBJECT
+public:
+    explicit TriggerEngine(QObject *parent = nullptr);
+
+    enum Action{
+        Highlight,
+        AutoReply,
+        StartLogging,
+        StopLogging,
+        Mark,
+    };
+
+    struct Trigger{
+        QString pattern;                //Pattern as entered by the user
+        bool isRegex        = false;
+        Action action       = Highlight;
+        QByteArray reply;               //Data to send for AutoReply
+        qint64 hits         = 0;
+    };
+
+    int addLiteral(QString pattern, Action action, QByteArray reply = QByteArray());
+    int addRegex(QString pattern, Action action, QByteArray reply = QByteArray());
+    void clear();
+
+    bool setRules(QString rules, QString *error = nullptr);
+    QString getRules();
+
+    Trigger getTrigger(int index);
+    int getTriggerCount();
+
+    void feed(const QByteArray &data);
+    void reset();
+
+    void expectEcho(const QByteArray &data);
+
+    static QByteArray unescape(QString text);
+    static QString escape(QByteArray data);
+
+signals:
+    //Emitted for every match. offset is the stream position just past the end of the match.
+    void triggered(int index, qint64 offset);
+
+private:
+    static const int ALPHABET_SIZE = 256;
+    static const int MAX_REGEX_LINE = 4096;
+    static const int MAX_ECHOES = 16;
+    static const int ECHO_WINDOW = 4096;    //An echo not started within this many bytes is not coming
+
+    struct Echo{
+        QByteArray data;
+        qint64 expectedAt;                  //Stream offset when the data was sent
+    };
+
+    QList<Trigger> triggers;
+    QVector<QRegularExpression> regexes;
+    QVector<int> regexTriggers;             //Trigger index of each entry in regexes
+
+    //Aho-Corasick automaton. transitions[state][byte] -> next state, state 0 is the root.
+    QVector<std::array<int, ALPHABET_SIZE>> transitions;
+    QVector<QVector<int>> outputs;          //Trigger indexes that end in each state
+    QVector<int> literalLengths;            //Length of each trigger's literal pattern in bytes
+    bool automatonDirty = false;
+
+    int state = 0;                          //Automaton state carried between feed() calls
+    qint64 streamOffset = 0;                //Total bytes fed since the last reset
+    QByteArray regexLine;                   //Current (incomplete) line for regex matching
+
+    QQueue<Echo> pendingEchoes;             //Sent data not seen on the receive stream yet
+    int echoMatched = 0;                    //Bytes of the first pending echo received so far
+    qint64 echoStart = 0;
+    QVector<QPair<qint64, qint64>> echoedRanges;    //Recent [start, end) stream ranges that were our own data
+
+    void buildAutomaton();
+    void matchRegexes(qint64 endOffset);
+    void trackEchoes(const char *data, int size);
+    bool isEchoed(qint64 start, qint64 end);
+
+    static QString actionName(Action action);
+    static bool parseAction(QString name, Action *action);
+};
+
+#endif // TRIGGERENGINE_H
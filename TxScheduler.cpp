@@ -0,0 +1,387 @@
+#include "TxScheduler.h"
+
+#include <QRegularExpression>
+#include <QStringList>
+
+#include <cmath>
+
+static const char *queueNames[TxScheduler::QUEUE_COUNT] = {"Interactive", "Control", "Bulk"};
+
+TxScheduler::TxScheduler(QObject *parent) : QObject(parent)
+{
+    queues[INTERACTIVE].weight  = 8;
+    queues[CONTROL].weight      = 4;
+    queues[BULK].weight         = 1;
+
+    rateTimer = new QTimer(this);
+    rateTimer->setSingleShot(true);
+    connect(rateTimer, SIGNAL(timeout()), this, SLOT(dispatch()));
+
+    writeTimer = new QTimer(this);
+    writeTimer->setSingleShot(true);
+    connect(writeTimer, SIGNAL(timeout()), this, SLOT(handleWriteTimeout()));
+
+    clock.start();
+}
+
+//Returns the id writeFinished() reports the write with, 0 for an empty write
+quint64 TxScheduler::enqueue(const QByteArray &data, TxScheduler::Priority priority)
+{
+    if(data.isEmpty()){
+        return 0;
+    }
+
+    Queue &queue = queues[priority];
+    QueueStatistics &queueStats = stats.queues[priority];
+    qint64 now = clock.nsecsElapsed();
+    quint64 id = nextId++;
+
+    //Chunks are what gets interleaved, a long write does not hold the link until it is done
+    for(int i = 0; i < data.size(); i += maxWriteSize){
+        Chunk chunk;
+        chunk.data = QByteArray(data.constData() + i, qMin(maxWriteSize, data.size() - i));
+        chunk.id = id;
+        chunk.queuedNs = now;
+        chunk.lastOfWrite = i + maxWriteSize >= data.size();
+        queue.chunks.enqueue(chunk);
+    }
+
+    queueStats.queuedBytes += data.size();
+    queueStats.depthBytes += data.size();
+    queueStats.maxDepthBytes = qMax(queueStats.maxDepthBytes, queueStats.depthBytes);
+
+    dispatch();
+    return id;
+}
+
+//Drop everything still waiting, e.g. when the connection is lost. The senders are told their
+//writes were not written.
+void TxScheduler::clear()
+{
+    QVector<quint64> dropped;
+
+    for(const SentChunk &chunk : inFlight){
+        if(chunk.lastOfWrite){
+            dropped.append(chunk.id);
+        }
+    }
+
+    for(int i = 0; i < QUEUE_COUNT; i++){
+        for(const Chunk &chunk : queues[i].chunks){
+            if(chunk.lastOfWrite){
+                dropped.append(chunk.id);
+            }
+        }
+
+        queues[i].chunks.clear();
+        queues[i].currentWeight = 0;
+        stats.queues[i].droppedBytes += stats.queues[i].depthBytes;
+        stats.queues[i].depthBytes = 0;
+    }
+
+    inFlight.clear();
+    rateTimer->stop();
+    writeTimer->stop();
+
+    reportDropped(dropped);
+}
+
+void TxScheduler::setMaxWriteSize(int bytes)
+{
+    this->maxWriteSize = qMax(1, bytes);
+}
+
+void TxScheduler::setMaxInFlight(int writes)
+{
+    this->maxInFlight = qMax(1, writes);
+    dispatch();
+}
+
+void TxScheduler::setWeight(TxScheduler::Priority priority, int weight)
+{
+    queues[priority].weight = qMax(1, weight);
+}
+
+void TxScheduler::setRateLimit(TxScheduler::Priority priority, qint64 bytesPerSecond)
+{
+    Queue &queue = queues[priority];
+    queue.rateLimit = qMax<qint64>(0, bytesPerSecond);
+    queue.tokens = qMax<qint64>(maxWriteSize, queue.rateLimit / 10);
+    queue.refilledNs = clock.nsecsElapsed();
+
+    dispatch();
+}
+
+QString TxScheduler::getSettings()
+{
+    QString settings;
+
+    for(int i = 0; i < QUEUE_COUNT; i++){
+        settings += QString("%1 weight %2 rate %3\n")
+                .arg(QString(queueNames[i]).toLower())
+                .arg(queues[i].weight)
+                .arg(queues[i].rateLimit);
+    }
+    settings += QString("inflight %1\n").arg(maxInFlight);
+
+    return settings;
+}
+
+bool TxScheduler::setSettings(QString settings, QString *error)
+{
+    int weights[QUEUE_COUNT];
+    qint64 rateLimits[QUEUE_COUNT];
+    for(int i = 0; i < QUEUE_COUNT; i++){
+        weights[i] = queues[i].weight;
+        rateLimits[i] = queues[i].rateLimit;
+    }
+    int writes = maxInFlight;
+
+    //Parse everything first so a bad line leaves the current settings untouched
+    QStringList lines = settings.split('\n');
+    for(int i = 0; i < lines.size(); i++){
+        QString line = lines.at(i).trimmed();
+        if(line.isEmpty() || line.startsWith('#')){
+            continue;
+        }
+
+        QStringList tokens = line.split(QRegularExpression("\\s+"), QString::SkipEmptyParts);
+        QString problem;
+
+        int queue = -1;
+        for(int j = 0; j < QUEUE_COUNT; j++){
+            if(tokens.at(0).compare(queueNames[j], Qt::CaseInsensitive) == 0){
+                queue = j;
+            }
+        }
+
+        if(tokens.at(0) == "inflight"){
+            bool ok = false;
+            int value = tokens.size() == 2 ? tokens.at(1).toInt(&ok) : 0;
+            if(!ok || value < 1){
+                problem = "expected 'inflight <chunks>', at least 1";
+            }
+            else{
+                writes = value;
+            }
+        }
+        else if(queue < 0){
+            problem = QString("unknown queue '%1'").arg(tokens.at(0));
+        }
+        else if(tokens.size() != 5 || tokens.at(1) != "weight" || tokens.at(3) != "rate"){
+            problem = "expected '<queue> weight <weight> rate <bytes per second>'";
+        }
+        else{
+            bool weightOk = false;
+            bool rateOk = false;
+            int weight = tokens.at(2).toInt(&weightOk);
+            qint64 rateLimit = tokens.at(4).toLongLong(&rateOk);
+
+            if(!weightOk || weight < 1){
+                problem = "the weight must be at least 1";
+            }
+            else if(!rateOk || rateLimit < 0){
+                problem = "the rate must be 0 (unlimited) or more bytes per second";
+            }
+            else{
+                weights[queue] = weight;
+                rateLimits[queue] = rateLimit;
+            }
+        }
+
+        if(!problem.isEmpty()){
+            if(error){
+                *error = QString("Line %1: %2").arg(i + 1).arg(problem);
+            }
+            return false;
+        }
+    }
+
+    for(int i = 0; i < QUEUE_COUNT; i++){
+        setWeight(static_cast<Priority>(i), weights[i]);
+        if(rateLimits[i] != queues[i].rateLimit){
+            setRateLimit(static_cast<Priority>(i), rateLimits[i]);
+        }
+    }
+    setMaxInFlight(writes);
+
+    return true;
+}
+
+TxScheduler::Statistics TxScheduler::getStatistics()
+{
+    return stats;
+}
+
+void TxScheduler::resetStatistics()
+{
+    Statistics fresh;
+    for(int i = 0; i < QUEUE_COUNT; i++){
+        fresh.queues[i].depthBytes = stats.queues[i].depthBytes;
+        fresh.queues[i].maxDepthBytes = stats.queues[i].depthBytes;
+    }
+    stats = fresh;
+}
+
+//Confirmations come in the order the chunks were sent
+void TxScheduler::handleWritten()
+{
+    if(inFlight.isEmpty()){
+        return;
+    }
+
+    SentChunk chunk = inFlight.dequeue();
+
+    if(inFlight.isEmpty()){
+        writeTimer->stop();
+    }
+    else{
+        writeTimer->start(WRITE_TIMEOUT_MS);
+    }
+
+    if(chunk.lastOfWrite){
+        emit writeFinished(chunk.id, true);
+    }
+
+    dispatch();
+}
+
+//A write the link never confirmed would otherwise stall every queue for good
+void TxScheduler::handleWriteTimeout()
+{
+    QVector<quint64> dropped;
+    for(const SentChunk &chunk : inFlight){
+        if(chunk.lastOfWrite){
+            dropped.append(chunk.id);
+        }
+    }
+
+    stats.writeTimeouts += inFlight.size();
+    inFlight.clear();
+
+    reportDropped(dropped);
+    dispatch();
+}
+
+//Reported once the scheduler's state is consistent again, a sender may write straight away
+void TxScheduler::reportDropped(const QVector<quint64> &ids)
+{
+    for(quint64 id : ids){
+        emit writeFinished(id, false);
+    }
+}
+
+void TxScheduler::dispatch()
+{
+    //transmit() can lead straight back here (e.g. a write confirmed synchronously)
+    if(dispatching){
+        return;
+    }
+    dispatching = true;
+
+    while(inFlight.size() < maxInFlight){
+        qint64 now = clock.nsecsElapsed();
+        int index = pickQueue(now);
+        if(index < 0){
+            break;
+        }
+
+        Queue &queue = queues[index];
+        QueueStatistics &queueStats = stats.queues[index];
+        Chunk chunk = queue.chunks.dequeue();
+
+        if(queue.chunks.isEmpty()){
+            queue.currentWeight = 0;    //An idle queue does not bank credit
+        }
+        if(queue.rateLimit > 0){
+            queue.tokens -= chunk.data.size();
+        }
+
+        queueStats.depthBytes -= chunk.data.size();
+        queueStats.sentBytes += chunk.data.size();
+        if(chunk.lastOfWrite){
+            qint64 latency = now - chunk.queuedNs;
+            queueStats.latencyCount++;
+            queueStats.latencyTotalNs += latency;
+            queueStats.latencyMaxNs = qMax(queueStats.latencyMaxNs, latency);
+        }
+
+        inFlight.enqueue(SentChunk{chunk.id, chunk.lastOfWrite});
+        writeTimer->start(WRITE_TIMEOUT_MS);
+        emit transmit(chunk.data);
+    }
+
+    dispatching = false;
+}
+
+//Smooth weighted round robin over the queues that have data and are within their rate limit.
+//Ties go to the higher priority queue.
+int TxScheduler::pickQueue(qint64 nowNs)
+{
+    int best = -1;
+    int totalWeight = 0;
+    qint64 waitMs = -1;
+
+    for(int i = 0; i < QUEUE_COUNT; i++){
+        Queue &queue = queues[i];
+        if(queue.chunks.isEmpty()){
+            continue;
+        }
+
+        refill(queue, nowNs);
+        if(queue.rateLimit > 0 && queue.tokens <= 0){
+            qint64 ms = static_cast<qint64>(std::ceil(-queue.tokens * 1000.0 / queue.rateLimit)) + 1;
+            waitMs = waitMs < 0 ? ms : qMin(waitMs, ms);
+            continue;
+        }
+
+        queue.currentWeight += queue.weight;
+        totalWeight += queue.weight;
+        if(best < 0 || queue.currentWeight > queues[best].currentWeight){
+            best = i;
+        }
+    }
+
+    if(best >= 0){
+        queues[best].currentWeight -= totalWeight;
+    }
+    else if(waitMs >= 0 && !rateTimer->isActive()){
+        rateTimer->start(static_cast<int>(waitMs));
+    }
+
+    return best;
+}
+
+void TxScheduler::refill(TxScheduler::Queue &queue, qint64 nowNs)
+{
+    if(queue.rateLimit <= 0){
+        return;
+    }
+
+    //Allow bursts of up to 100 ms worth of data (at least one chunk)
+    double burst = qMax<qint64>(maxWriteSize, queue.rateLimit / 10);
+    queue.tokens = qMin(burst, queue.tokens + (nowNs - queue.refilledNs) / 1e9 * queue.rateLimit);
+    queue.refilledNs = nowNs;
+}
+
+QString TxScheduler::Statistics::toString() const
+{
+    QString str;
+
+    for(int i = 0; i < QUEUE_COUNT; i++){
+        const QueueStatistics &q = queues[i];
+        str += QString("%1: sent %2 of %3 bytes, waiting %4 (max %5), dropped %6\n")
+                .arg(queueNames[i])
+                .arg(q.sentBytes)
+                .arg(q.queuedBytes)
+                .arg(q.depthBytes)
+                .arg(q.maxDepthBytes)
+                .arg(q.droppedBytes);
+        str += QString("    queueing latency mean/max: %1/%2 ms\n")
+                .arg(q.latencyCount ? q.latencyTotalNs / 1e6 / q.latencyCount : 0, 0, 'f', 2)
+                .arg(q.latencyMaxNs / 1e6, 0, 'f', 2);
+    }
+
+    str += QString("Unconfirmed writes: %1").arg(writeTimeouts);
+    return str;
+}
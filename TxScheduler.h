@@ -0,0 +1,137 @@
+#ifndef TXSCHEDULER_H
+#define TXSCHEDULER_H
+
+/*
+ * Transmit scheduler
+ *
+ * Everything written to the device goes through one of three queues:
+ *  - INTERACTIVE:  keystrokes and lines typed into the terminal
+ *  - CONTROL:      short protocol replies (trigger replies, XMODEM EOT/CAN, ...)
+ *  - BULK:         file transfers, macros, bridged and shared traffic
+ *
+ * Writes are split into MTU sized chunks and only 'maxInFlight' chunks are handed to the link
+ * at a time, so a new keystroke never waits behind a deep backlog inside Qt or the radio. When
+ * several queues are waiting, chunks are interleaved by smooth weighted round robin, so bulk
+ * traffic keeps the link busy without starving the others. Each queue can also be rate limited
+ * (token bucket, 0 = unlimited).
+ *
+ * Per queue the scheduler tracks the backlog (current and largest) and the queueing latency,
+ * from a write being queued to its last chunk being handed to the link.
+ *
+ * Every write gets an id. The link confirms chunks in the order they were handed to it, and
+ * writeFinished() reports a write once its last chunk was confirmed, so a sender can tell its
+ * own confirmations from everybody else's. A write dropped by clear(), or whose last chunk the
+ * link never confirmed, is reported as not written.
+ *
+ * Queued data is copied, a write may wait long after the caller's buffer (e.g. a mapped file)
+ * is gone.
+ */
+
+#include <QObject>
+#include <QQueue>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QVector>
+
+class TxScheduler : public QObject
+{
+    Q_OBJECT
+public:
+    explicit TxScheduler(QObject *parent = nullptr);
+
+    enum Priority{
+        INTERACTIVE,
+        CONTROL,
+        BULK,
+    };
+
+    static const int QUEUE_COUNT = 3;
+
+    struct QueueStatistics{
+        qint64 queuedBytes      = 0;    //Total ever queued
+        qint64 sentBytes        = 0;
+        qint64 droppedBytes     = 0;    //Discarded on disconnect
+        qint64 depthBytes       = 0;    //Waiting right now
+        qint64 maxDepthBytes    = 0;
+        qint64 latencyCount     = 0;
+        qint64 latencyTotalNs   = 0;
+        qint64 latencyMaxNs     = 0;
+    };
+
+    struct Statistics{
+        QueueStatistics queues[QUEUE_COUNT];
+        qint64 writeTimeouts    = 0;    //Writes never confirmed by the link
+
+        QString toString() const;
+    };
+
+    quint64 enqueue(const QByteArray &data, Priority priority);
+    void clear();
+
+    void setMaxWriteSize(int bytes);
+    void setMaxInFlight(int writes);
+    void setWeight(Priority priority, int weight);
+    void setRateLimit(Priority priority, qint64 bytesPerSecond);
+
+    //The weights, rate limits and in-flight limit as text, one setting per line:
+    //  <interactive|control|bulk> weight <weight> rate <bytes per second, 0 = unlimited>
+    //  inflight <chunks>
+    QString getSettings();
+    bool setSettings(QString settings, QString *error = nullptr);
+
+    Statistics getStatistics();
+    void resetStatistics();
+
+signals:
+    void transmit(QByteArray data);     //Hand one chunk to the link
+    void writeFinished(quint64 id, bool written);
+
+public slots:
+    void handleWritten();               //The link confirmed a chunk
+
+private:
+    struct Chunk{
+        QByteArray data;
+        quint64 id          = 0;    //Of the write it belongs to
+        qint64 queuedNs     = 0;
+        bool lastOfWrite    = true;
+    };
+
+    struct SentChunk{
+        quint64 id;
+        bool lastOfWrite;
+    };
+
+    struct Queue{
+        QQueue<Chunk> chunks;
+        int weight              = 1;
+        int currentWeight       = 0;    //Smooth weighted round robin state
+        qint64 rateLimit        = 0;    //Bytes per second, 0 = unlimited
+        double tokens           = 0;
+        qint64 refilledNs       = 0;
+    };
+
+    static const int WRITE_TIMEOUT_MS = 5000;
+
+    Queue queues[QUEUE_COUNT];
+    Statistics stats;
+    int maxWriteSize            = 20;
+    int maxInFlight             = 2;
+    QQueue<SentChunk> inFlight;             //Handed to the link, oldest first
+    quint64 nextId              = 1;
+    bool dispatching            = false;
+
+    QElapsedTimer clock;
+    QTimer *rateTimer           = nullptr;  //Wakes the scheduler when a rate limited queue has tokens again
+    QTimer *writeTimer          = nullptr;  //Gives up on a write the link never confirms
+
+    void refill(Queue &queue, qint64 nowNs);
+    int pickQueue(qint64 nowNs);
+    void reportDropped(const QVector<quint64> &ids);
+
+private slots:
+    void dispatch();
+    void handleWriteTimeout();
+};
+
+#endif // TXSCHEDULER_H
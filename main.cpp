@@ -1,11 +1,15 @@
 #include "MainWindow.h"
+#include "StartupTimeline.h"
 #include <QApplication>
 
 int main(int argc, char *argv[])
 {
+    StartupTimeline::mark("main");
+
     QApplication a(argc, argv);
     MainWindow w;
     w.show();
+    StartupTimeline::mark("show() called");
 
     return a.exec();
 }
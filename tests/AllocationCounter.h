@@ -0,0 +1,21 @@
+#ifndef ALLOCATIONCOUNTER_H
+#define ALLOCATIONCOUNTER_H
+
+/*
+ * Heap allocation counter
+ *
+ * Built with BT_COUNT_ALLOCATIONS defined (the benchmarks with 'qmake CONFIG+=alloc_counter'), every
+ * heap allocation made by the process is counted: the global operator new is replaced everywhere, and
+ * with glibc malloc/calloc/realloc are interposed as well, which also covers Qt's containers.
+ *
+ * Used by the tests to verify that the receive path does not allocate in steady state.
+ * Without the define count() always returns 0 and isEnabled() returns false.
+ */
+
+namespace AllocationCounter
+{
+    bool isEnabled();
+    unsigned long long count();
+}
+
+#endif // ALLOCATIONCOUNTER_H
@@ -0,0 +1,43 @@
+# Application classes under test. Everything but the main window is built into each test.
+
+QT       += core gui widgets bluetooth network testlib
+
+CONFIG += c++11 testcase
+DEFINES += QT_DEPRECATED_WARNINGS
+
+APP_DIR = $$PWD/..
+INCLUDEPATH += $$APP_DIR $$PWD
+
+SOURCES += \
+    $$APP_DIR/Bluetooth.cpp \
+    $$APP_DIR/Terminal.cpp \
+    $$APP_DIR/Logger.cpp \
+    $$APP_DIR/TriggerEngine.cpp \
+    $$APP_DIR/SearchIndex.cpp \
+    $$APP_DIR/FrameDecoder.cpp \
+    $$APP_DIR/TelemetryParser.cpp \
+    $$APP_DIR/TelemetryExporter.cpp \
+    $$APP_DIR/BufferPool.cpp \
+    $$APP_DIR/DurableLog.cpp \
+    $$APP_DIR/ExportJob.cpp \
+    $$APP_DIR/TxScheduler.cpp \
+    $$APP_DIR/SessionFile.cpp \
+    $$APP_DIR/ScrollbackText.cpp \
+    $$PWD/AllocationCounter.cpp
+
+HEADERS += \
+    $$APP_DIR/Bluetooth.h \
+    $$APP_DIR/Terminal.h \
+    $$APP_DIR/Logger.h \
+    $$APP_DIR/TriggerEngine.h \
+    $$APP_DIR/SearchIndex.h \
+    $$APP_DIR/FrameDecoder.h \
+    $$APP_DIR/TelemetryParser.h \
+    $$APP_DIR/TelemetryExporter.h \
+    $$APP_DIR/BufferPool.h \
+    $$APP_DIR/DurableLog.h \
+    $$APP_DIR/ExportJob.h \
+    $$APP_DIR/TxScheduler.h \
+    $$APP_DIR/SessionFile.h \
+    $$APP_DIR/ScrollbackText.h \
+    $$PWD/AllocationCounter.h
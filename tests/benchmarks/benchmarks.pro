@@ -0,0 +1,19 @@
+#-------------------------------------------------
+#
+# QBENCHMARK cases for the data path
+#
+# Results can be written in a machine readable format to compare releases, e.g.
+#   tst_benchmarks -o results.xml,xml
+#
+#-------------------------------------------------
+
+TARGET = tst_benchmarks
+TEMPLATE = app
+
+include(../app.pri)
+
+# Count heap allocations as well: qmake CONFIG+=alloc_counter
+alloc_counter: DEFINES += BT_COUNT_ALLOCATIONS
+
+SOURCES += \
+    tst_benchmarks.cpp
@@ -0,0 +1,576 @@
+/*
+ * Data path benchmarks
+ *
+ * QBENCHMARK cases for the classes that sit on the receive/transmit path (Logger, Terminal,
+ * Bluetooth buffering and the hex converters) using synthetic payloads sized like real BLE UART
+ * traffic. Everything is driven through the classes' public interfaces.
+ *
+ * Run with e.g. '-o results.xml,xml' (or csv) to get machine readable results that can be
+ * compared between releases. Built with CONFIG+=alloc_counter the steady state receive path is
+ * also checked not to allocate.
+ */
+
+#include "Logger.h"
+#include "Terminal.h"
+#include "Bluetooth.h"
+#include "FrameDecoder.h"
+#include "ExportJob.h"
+#include "TxScheduler.h"
+#include "SessionFile.h"
+#include "SearchIndex.h"
+#include "AllocationCounter.h"
+
+#include <QtTest>
+#include <QTemporaryDir>
+
+//Number of packets pushed through a fresh logger/terminal per iteration
+static const int PacketsPerSession = 64;
+
+//The data path classes print a lot of qDebug output. Drop it, but keep warnings in the test log.
+static QtMessageHandler previousHandler = nullptr;
+
+static void quietMessageHandler(QtMsgType type, const QMessageLogContext &context, const QString &msg)
+{
+    if(type != QtDebugMsg && type != QtInfoMsg && previousHandler){
+        previousHandler(type, context, msg);
+    }
+}
+
+//Printable bytes, sized like a BLE notification payload
+static QByteArray makePayload(int size)
+{
+    QByteArray payload;
+    payload.reserve(size);
+
+    for(int i = 0; i < size; i++){
+        payload.append(static_cast<char>(' ' + (i * 7) % 95));
+    }
+
+    return payload;
+}
+
+//Text lines of a realistic length (sensor readings, log output) ending in the terminator
+static QByteArray makeLines(int size, QByteArray terminator)
+{
+    QByteArray lines;
+    lines.reserve(size + 64);
+
+    int n = 0;
+    while(lines.size() < size){
+        lines.append("T+");
+        lines.append(QByteArray::number(n * 125));
+        lines.append(",temp=");
+        lines.append(QByteArray::number(20.0 + (n % 50) * 0.1, 'f', 1));
+        lines.append(",rssi=-");
+        lines.append(QByteArray::number(40 + n % 30));
+        lines.append(terminator);
+        n++;
+    }
+
+    return lines;
+}
+
+class DataPathBenchmark : public QObject
+{
+    Q_OBJECT
+
+private:
+    QTemporaryDir dir;
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void logger_data();
+    void logger();
+    void durableLogger_data();
+    void durableLogger();
+    void terminal_data();
+    void terminal();
+    void bluetoothGetLine_data();
+    void bluetoothGetLine();
+    void bluetoothGetAllLines_data();
+    void bluetoothGetAllLines();
+    void hexConversion_data();
+    void hexConversion();
+    void receivePipeline_data();
+    void receivePipeline();
+    void receivePipelineAllocations_data();
+    void receivePipelineAllocations();
+    void receivePool_data();
+    void receivePool();
+    void frameDecoders_data();
+    void frameDecoders();
+    void exportSnapshot_data();
+    void exportSnapshot();
+    void txScheduler();
+    void sessionSave();
+    void sessionRestore();
+};
+
+void DataPathBenchmark::initTestCase()
+{
+    QVERIFY(dir.isValid());
+    previousHandler = qInstallMessageHandler(quietMessageHandler);
+}
+
+void DataPathBenchmark::cleanupTestCase()
+{
+    qInstallMessageHandler(previousHandler);
+}
+
+void DataPathBenchmark::logger_data()
+{
+    QTest::addColumn<bool>("hex");
+    QTest::addColumn<int>("size");
+
+    QTest::newRow("text/20B") << false << 20;
+    QTest::newRow("text/244B") << false << 244;
+    QTest::newRow("hex/20B") << true << 20;
+    QTest::newRow("hex/244B") << true << 244;
+}
+
+void DataPathBenchmark::logger()
+{
+    QFETCH(bool, hex);
+    QFETCH(int, size);
+
+    QString text = QString::fromLatin1(makePayload(size));
+
+    Logger logger;
+    logger.setLogFile(dir.path() + "/logger.txt");
+    logger.logInHex(hex);
+
+    QBENCHMARK{
+        logger.startLogging();
+        for(int i = 0; i < PacketsPerSession; i++){
+            logger.log(text);
+        }
+        logger.stopLogging();
+    }
+}
+
+//The cost of each durability level, in the crash safe record format. The group commit
+//threshold is lowered so a session spans several groups.
+void DataPathBenchmark::durableLogger_data()
+{
+    QTest::addColumn<int>("durability");
+
+    QTest::newRow("flush/244B") << static_cast<int>(Logger::FLUSH_ONLY);
+    QTest::newRow("group-4KB/244B") << static_cast<int>(Logger::GROUP_COMMIT);
+    QTest::newRow("sync/244B") << static_cast<int>(Logger::SYNC_ALWAYS);
+}
+
+void DataPathBenchmark::durableLogger()
+{
+    QFETCH(int, durability);
+
+    QByteArray payload = makePayload(244);
+    QString path = dir.path() + "/logger_durable.btlog";
+
+    Logger logger;
+    logger.setLogFile(path);
+    logger.setLogFormat(Logger::DURABLE);
+    logger.setDurability(static_cast<Logger::Durability>(durability));
+    logger.setGroupCommit(1000, 4096);
+
+    QBENCHMARK{
+        QFile::remove(path);    //Otherwise every session rescans a growing file
+        logger.startLogging();
+        for(int i = 0; i < PacketsPerSession; i++){
+            logger.log(payload, true);
+        }
+        logger.stopLogging();
+    }
+}
+
+void DataPathBenchmark::terminal_data()
+{
+    QTest::addColumn<bool>("hex");
+    QTest::addColumn<int>("size");
+
+    QTest::newRow("ascii/20B") << false << 20;
+    QTest::newRow("ascii/244B") << false << 244;
+    QTest::newRow("hex/20B") << true << 20;
+    QTest::newRow("hex/244B") << true << 244;
+}
+
+void DataPathBenchmark::terminal()
+{
+    QFETCH(bool, hex);
+    QFETCH(int, size);
+
+    QByteArray payload = makePayload(size);
+
+    Terminal terminal(nullptr);
+    terminal.setDisplayMode(hex ? Terminal::HEX : Terminal::ASCII);
+
+    QBENCHMARK{
+        terminal.clearText();
+        for(int i = 0; i < PacketsPerSession; i++){
+            terminal.addText(payload, true);
+        }
+    }
+}
+
+void DataPathBenchmark::bluetoothGetLine_data()
+{
+    QTest::addColumn<int>("size");
+
+    QTest::newRow("256B") << 256;
+    QTest::newRow("4096B") << 4096;
+}
+
+void DataPathBenchmark::bluetoothGetLine()
+{
+    QFETCH(int, size);
+
+    QByteArray lines = makeLines(size, "\r\n");
+
+    Bluetooth bluetooth;
+    bluetooth.setDebugLoggingEnabled(false);
+
+    QBENCHMARK{
+        bluetooth.clearBuffer();
+        bluetooth.simulateNotification(lines);
+        bluetooth.getLine("\r\n");
+    }
+}
+
+void DataPathBenchmark::bluetoothGetAllLines_data()
+{
+    bluetoothGetLine_data();
+}
+
+void DataPathBenchmark::bluetoothGetAllLines()
+{
+    QFETCH(int, size);
+
+    QByteArray lines = makeLines(size, "\r\n");
+
+    Bluetooth bluetooth;
+    bluetooth.setDebugLoggingEnabled(false);
+
+    QBENCHMARK{
+        bluetooth.clearBuffer();
+        bluetooth.simulateNotification(lines);
+        bluetooth.getAllLines("\r\n");
+    }
+}
+
+void DataPathBenchmark::hexConversion_data()
+{
+    QTest::addColumn<int>("size");
+
+    QTest::newRow("20B") << 20;
+    QTest::newRow("244B") << 244;
+    QTest::newRow("4096B") << 4096;
+}
+
+void DataPathBenchmark::hexConversion()
+{
+    QFETCH(int, size);
+
+    QString text = QString::fromLatin1(makePayload(size));
+
+    QBENCHMARK{
+        Terminal::asciiTextToHex(text);
+    }
+}
+
+//Per notification cost of getting received bytes to the display and the log file.
+//Both cases do the same work, wired as in the main window (terminal -> logger):
+//"legacy" makes the conversions the receive path used to make (the notification is copied into the
+//buffer, read out as a copy, decoded to text and the logger encodes the text back to bytes),
+//"decode-once" is the current path: the bytes are queued as they are, decoded once for the display
+//and logged untouched.
+static void receiveSession(bool legacy, const QByteArray &payload, Bluetooth &bluetooth, Terminal &terminal)
+{
+    QByteArray legacyBuffer;
+
+    for(int i = 0; i < PacketsPerSession; i++){
+        QByteArray packet(payload.constData(), payload.size());     //Notification from Qt
+
+        if(legacy){
+            legacyBuffer.append(packet);                            //dataBuffer
+            QByteArray read = legacyBuffer;                         //readAll()
+            legacyBuffer.clear();
+            terminal.addText(QString::fromUtf8(read), true);        //Decoded, logged as text.toUtf8()
+        }
+        else{
+            bluetooth.simulateNotification(packet);
+            terminal.addText(bluetooth.readAll(), true);
+        }
+    }
+}
+
+void DataPathBenchmark::receivePipeline_data()
+{
+    QTest::addColumn<bool>("legacy");
+    QTest::addColumn<int>("encoding");
+    QTest::addColumn<int>("size");
+
+    const int sizes[] = {20, 244};
+    for(int size : sizes){
+        QTest::newRow(qPrintable(QString("legacy/%1B").arg(size))) << true << static_cast<int>(Terminal::ENCODING_UTF8) << size;
+        QTest::newRow(qPrintable(QString("decode-once/utf8/%1B").arg(size))) << false << static_cast<int>(Terminal::ENCODING_UTF8) << size;
+        QTest::newRow(qPrintable(QString("decode-once/latin1/%1B").arg(size))) << false << static_cast<int>(Terminal::ENCODING_LATIN1) << size;
+        QTest::newRow(qPrintable(QString("decode-once/ascii/%1B").arg(size))) << false << static_cast<int>(Terminal::ENCODING_ASCII) << size;
+    }
+}
+
+void DataPathBenchmark::receivePipeline()
+{
+    QFETCH(bool, legacy);
+    QFETCH(int, encoding);
+    QFETCH(int, size);
+
+    QByteArray payload = makePayload(size);
+
+    Bluetooth bluetooth;
+    bluetooth.setDebugLoggingEnabled(false);
+    Terminal terminal(nullptr);
+    terminal.setTextEncoding(static_cast<Terminal::TextEncoding>(encoding));
+
+    Logger logger;
+    logger.setLogFile(dir.path() + "/pipeline.txt");
+    logger.startLogging();
+    connect(&terminal, SIGNAL(dataAdded(QByteArray, bool)), &logger, SLOT(log(QByteArray, bool)));
+
+    QBENCHMARK{
+        terminal.clearText();
+        receiveSession(legacy, payload, bluetooth, terminal);
+    }
+
+    logger.stopLogging();
+}
+
+//Heap allocations per notification for the same cases, reported as the result (needs CONFIG+=alloc_counter)
+void DataPathBenchmark::receivePipelineAllocations_data()
+{
+    receivePipeline_data();
+}
+
+void DataPathBenchmark::receivePipelineAllocations()
+{
+    QFETCH(bool, legacy);
+    QFETCH(int, encoding);
+    QFETCH(int, size);
+
+    if(!AllocationCounter::isEnabled()){
+        QSKIP("Allocations are only counted when built with CONFIG+=alloc_counter");
+    }
+
+    QByteArray payload = makePayload(size);
+
+    Bluetooth bluetooth;
+    bluetooth.setDebugLoggingEnabled(false);
+    Terminal terminal(nullptr);
+    terminal.setTextEncoding(static_cast<Terminal::TextEncoding>(encoding));
+
+    Logger logger;
+    logger.setLogFile(dir.path() + "/pipeline_allocations.txt");
+    logger.startLogging();
+    connect(&terminal, SIGNAL(dataAdded(QByteArray, bool)), &logger, SLOT(log(QByteArray, bool)));
+
+    //Warm up first, the pool and the document grow on the first session
+    receiveSession(legacy, payload, bluetooth, terminal);
+    terminal.clearText();
+
+    unsigned long long before = AllocationCounter::count();
+    receiveSession(legacy, payload, bluetooth, terminal);
+    unsigned long long allocations = AllocationCounter::count() - before;
+
+    logger.stopLogging();
+
+    QTest::setBenchmarkResult(static_cast<qreal>(allocations) / PacketsPerSession, QTest::Events);
+}
+
+//Steady state receive: notifications are queued in pooled chunks and drained into a fixed buffer.
+//Must not allocate once warmed up.
+void DataPathBenchmark::receivePool_data()
+{
+    QTest::addColumn<int>("size");
+
+    QTest::newRow("20B") << 20;
+    QTest::newRow("244B") << 244;
+}
+
+void DataPathBenchmark::receivePool()
+{
+    QFETCH(int, size);
+
+    Bluetooth bluetooth;
+    bluetooth.setDebugLoggingEnabled(false);
+    QByteArray packet = makePayload(size);
+    static char drained[BufferPool::CHUNK_SIZE * 4];
+
+    auto receiveSession = [&]{
+        for(int i = 0; i < PacketsPerSession; i++){
+            bluetooth.simulateNotification(packet);
+            bluetooth.read(drained, sizeof(drained));
+        }
+    };
+
+    QBENCHMARK{
+        receiveSession();
+    }
+
+    if(AllocationCounter::isEnabled()){
+        unsigned long long before = AllocationCounter::count();
+        receiveSession();
+        QCOMPARE(AllocationCounter::count() - before, 0ULL);
+    }
+}
+
+void DataPathBenchmark::frameDecoders_data()
+{
+    QTest::addColumn<QString>("decoder");
+    QTest::addColumn<int>("notificationSize");
+
+    const char *decoders[] = {"slip", "cobs", "length"};
+    for(const char *decoder : decoders){
+        QTest::newRow(qPrintable(QString("%1/20B").arg(decoder))) << QString(decoder) << 20;
+        QTest::newRow(qPrintable(QString("%1/244B").arg(decoder))) << QString(decoder) << 244;
+    }
+}
+
+void DataPathBenchmark::frameDecoders()
+{
+    QFETCH(QString, decoder);
+    QFETCH(int, notificationSize);
+
+    SlipDecoder slip;
+    CobsDecoder cobs;
+    LengthPrefixDecoder lengthPrefix;
+    FrameDecoder *frameDecoder = decoder == "slip" ? static_cast<FrameDecoder *>(&slip)
+                               : decoder == "cobs" ? static_cast<FrameDecoder *>(&cobs)
+                               : static_cast<FrameDecoder *>(&lengthPrefix);
+
+    //Binary payloads that contain every byte value, including the delimiters and escapes
+    QByteArray payload;
+    for(int i = 0; i < 64; i++){
+        payload.append(static_cast<char>((i * 37) & 0xFF));
+    }
+
+    QByteArray stream;
+    while(stream.size() < 64 * 1024){
+        stream.append(frameDecoder->encode(payload));
+    }
+
+    QBENCHMARK{
+        for(int i = 0; i < stream.size(); i += notificationSize){
+            frameDecoder->feed(stream.constData() + i, qMin(notificationSize, stream.size() - i));
+        }
+    }
+}
+
+//Exporting a 1 MB scrollback, including starting the job's thread
+void DataPathBenchmark::exportSnapshot_data()
+{
+    QTest::addColumn<int>("format");
+
+    QTest::newRow("text/1MB") << static_cast<int>(ExportJob::TEXT);
+    QTest::newRow("hex/1MB") << static_cast<int>(ExportJob::HEX);
+    QTest::newRow("html/1MB") << static_cast<int>(ExportJob::HTML);
+    QTest::newRow("capture/1MB") << static_cast<int>(ExportJob::CAPTURE);
+}
+
+void DataPathBenchmark::exportSnapshot()
+{
+    QFETCH(int, format);
+
+    QString text = QString::fromLatin1(makeLines(1024 * 1024, "\r\n"));
+
+    Terminal::Snapshot snapshot;
+    snapshot.text.append(text);
+    snapshot.incomingColor = Qt::white;
+    snapshot.outgoingColor = QColor(0x4F, 0xC3, 0xF7);
+
+    //Alternate directions every few lines, like an interactive session
+    for(int start = 0; start < text.size(); start += 4096){
+        int length = qMin(4096, text.size() - start);
+        snapshot.runs.append(Terminal::TextRun{start, length, (start / 4096) % 2 == 0});
+    }
+
+    ExportJob job(snapshot, dir.path() + "/export", static_cast<ExportJob::Format>(format));
+
+    QBENCHMARK{
+        job.start();
+        job.wait();
+    }
+}
+
+//Scheduling overhead: a session of bulk writes with a keystroke every few writes, each chunk
+//confirmed as soon as it is handed out
+void DataPathBenchmark::txScheduler()
+{
+    const int size = 244;
+    QByteArray payload = makePayload(size);
+    QByteArray keystroke(1, 'x');
+
+    TxScheduler scheduler;
+    scheduler.setMaxWriteSize(size);
+
+    QBENCHMARK{
+        int writes = 0;
+        for(int i = 0; i < PacketsPerSession; i++){
+            scheduler.enqueue(payload, TxScheduler::BULK);
+            writes++;
+
+            if(i % 8 == 0){
+                scheduler.enqueue(keystroke, TxScheduler::INTERACTIVE);
+                writes++;
+            }
+        }
+
+        for(int i = 0; i < writes; i++){
+            scheduler.handleWritten();
+        }
+    }
+}
+
+//A 32 MB scrollback received in one direction, as the terminal would save it
+static void makeSession(ScrollbackText *scrollback, QVector<Terminal::TextRun> *runs, SearchIndex *index)
+{
+    QString text = QString::fromLatin1(makeLines(32 * 1024 * 1024, "\r\n"));
+    runs->append(Terminal::TextRun{0, text.size(), true});
+    index->append(text);
+    scrollback->append(text);
+}
+
+//Saving and restoring a 32 MB scrollback. Restoring should not depend on the size of the session.
+void DataPathBenchmark::sessionSave()
+{
+    ScrollbackText scrollback;
+    QVector<Terminal::TextRun> runs;
+    SearchIndex index;
+    makeSession(&scrollback, &runs, &index);
+
+    QBENCHMARK{
+        QVERIFY(SessionFile::write(dir.path() + "/session.btsess", scrollback, runs, index));
+    }
+}
+
+//Writes its own session, so it also runs on its own
+void DataPathBenchmark::sessionRestore()
+{
+    QString path = dir.path() + "/session_restore.btsess";
+    {
+        ScrollbackText scrollback;
+        QVector<Terminal::TextRun> runs;
+        SearchIndex index;
+        makeSession(&scrollback, &runs, &index);
+        QVERIFY(SessionFile::write(path, scrollback, runs, index));
+    }
+
+    Terminal restored(nullptr);
+
+    QBENCHMARK{
+        QVERIFY(restored.restoreSession(path));
+    }
+}
+
+QTEST_MAIN(DataPathBenchmark)
+
+#include "tst_benchmarks.moc"
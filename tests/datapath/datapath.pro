@@ -0,0 +1,17 @@
+#-------------------------------------------------
+#
+# Functional tests for the data path
+#
+# Heap allocations are always counted here, the receive path is checked not to allocate.
+#
+#-------------------------------------------------
+
+TARGET = tst_datapath
+TEMPLATE = app
+
+include(../app.pri)
+
+DEFINES += BT_COUNT_ALLOCATIONS
+
+SOURCES += \
+    tst_datapath.cpp
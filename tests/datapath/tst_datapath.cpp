@@ -0,0 +1,473 @@
+/*
+ * Data path tests
+ *
+ * Functional checks for the receive and transmit paths (including the frame decoders), driven
+ * through the classes' public interfaces. This target always counts heap allocations (see
+ * AllocationCounter), so the steady state receive path can be checked not to allocate.
+ */
+
+#include "Bluetooth.h"
+#include "ScrollbackText.h"
+#include "FrameDecoder.h"
+#include "DurableLog.h"
+#include "Logger.h"
+#include "AllocationCounter.h"
+
+#include <QtTest>
+#include <QTemporaryDir>
+
+//The data path classes print a lot of qDebug output. Drop it, but keep warnings in the test log.
+static QtMessageHandler previousHandler = nullptr;
+
+static void quietMessageHandler(QtMsgType type, const QMessageLogContext &context, const QString &msg)
+{
+    if(type != QtDebugMsg && type != QtInfoMsg && previousHandler){
+        previousHandler(type, context, msg);
+    }
+}
+
+//Feed a stream to a decoder pieceSize bytes at a time, like notifications, and keep copies of the frames
+static QList<QByteArray> decodeStream(FrameDecoder *decoder, const QByteArray &stream, int pieceSize)
+{
+    QList<QByteArray> frames;
+    QMetaObject::Connection connection = QObject::connect(decoder, &FrameDecoder::frameDecoded, [&frames](QByteArray frame, qint64){
+        frames.append(QByteArray(frame.constData(), frame.size()));     //Only valid in the slot
+    });
+
+    for(int i = 0; i < stream.size(); i += pieceSize){
+        decoder->feed(stream.constData() + i, qMin(pieceSize, stream.size() - i));
+    }
+
+    QObject::disconnect(connection);
+    return frames;
+}
+
+//Printable bytes that differ from packet to packet
+static QByteArray makePayload(int size, int seed = 0)
+{
+    QByteArray payload;
+    payload.reserve(size);
+
+    for(int i = 0; i < size; i++){
+        payload.append(static_cast<char>(' ' + (i * 7 + seed) % 95));
+    }
+
+    return payload;
+}
+
+class DataPathTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void receiveKeepsOrder();
+    void receiveDoesNotAllocate_data();
+    void receiveDoesNotAllocate();
+
+    void scrollbackSealedBlocksAreShared();
+
+    void keystrokeOvertakesBulkBacklog();
+    void clearReportsDroppedWrites();
+
+    void slipEscapes();
+    void cobsFullBlocks();
+    void lengthPrefixCrcMismatchAndResync();
+    void framesSplitAcrossNotifications_data();
+    void framesSplitAcrossNotifications();
+    void crc16KnownValues();
+
+    void durableLogKeepsValidPrefix();
+    void durableLogSplitsLargeWrites();
+};
+
+void DataPathTest::initTestCase()
+{
+    QVERIFY(AllocationCounter::isEnabled());
+    previousHandler = qInstallMessageHandler(quietMessageHandler);
+}
+
+void DataPathTest::cleanupTestCase()
+{
+    qInstallMessageHandler(previousHandler);
+}
+
+//Notifications of every size, including ones larger than a pool chunk, come out as one stream
+void DataPathTest::receiveKeepsOrder()
+{
+    Bluetooth bluetooth;
+    bluetooth.setDebugLoggingEnabled(false);
+
+    QByteArray expected;
+    QByteArray buffer;
+    const int sizes[] = {1, 20, 244, 256, 300, 1000, 7};
+
+    for(int i = 0; i < 3; i++){
+        for(int size : sizes){
+            QByteArray packet = makePayload(size, i * 13 + size);
+            bluetooth.simulateNotification(packet);
+            expected.append(packet);
+        }
+
+        QCOMPARE(bluetooth.readInto(buffer), static_cast<qint64>(expected.size()));
+        QCOMPARE(buffer, expected);
+        QCOMPARE(bluetooth.bytesAvailable(), 0LL);
+        expected.clear();
+    }
+
+    //Nothing received, nothing read
+    QCOMPARE(bluetooth.readInto(buffer), 0LL);
+    QVERIFY(buffer.isEmpty());
+}
+
+//Notifications drained the way the main window does it, one at a time or in bursts
+void DataPathTest::receiveDoesNotAllocate_data()
+{
+    QTest::addColumn<int>("size");
+    QTest::addColumn<int>("burst");
+
+    QTest::newRow("20B") << 20 << 1;
+    QTest::newRow("244B") << 244 << 1;
+    QTest::newRow("244B/burst") << 244 << 8;
+}
+
+void DataPathTest::receiveDoesNotAllocate()
+{
+    QFETCH(int, size);
+    QFETCH(int, burst);
+
+    Bluetooth bluetooth;
+    bluetooth.setDebugLoggingEnabled(false);
+    QByteArray packet = makePayload(size);
+    QByteArray buffer;
+    qint64 received = 0;
+
+    auto receiveSession = [&]{
+        for(int i = 0; i < 64; i++){
+            for(int j = 0; j < burst; j++){
+                bluetooth.simulateNotification(packet);
+            }
+            received += bluetooth.readInto(buffer);
+        }
+    };
+
+    //The pool and the buffer grow to the working set first
+    receiveSession();
+
+    unsigned long long before = AllocationCounter::count();
+    receiveSession();
+    unsigned long long allocations = AllocationCounter::count() - before;
+
+    QCOMPARE(allocations, 0ULL);
+    QCOMPARE(received, 2LL * 64 * burst * size);
+    QCOMPARE(buffer, packet.repeated(burst));
+}
+
+//A copy taken after seal() keeps reading the same text while the original is appended to
+void DataPathTest::scrollbackSealedBlocksAreShared()
+{
+    ScrollbackText text;
+    text.append("first\nline");
+    text.seal();
+
+    ScrollbackText snapshot = text;
+    const QChar *sealed = snapshot.block(0).constData();
+
+    text.append(" continued\nlast");
+    QCOMPARE(text.block(0).constData(), sealed);
+    QCOMPARE(snapshot.size(), 10);
+    QCOMPARE(snapshot.mid(0), QString("first\nline"));
+
+    //Reads across the block boundary see one string
+    QCOMPARE(text.size(), 25);
+    QCOMPARE(text.mid(6, 14), QString("line continued"));
+    QCOMPARE(text.at(10), QChar(' '));
+    QCOMPARE(text.lastIndexOf('\n'), 20);
+    QCOMPARE(text.lastIndexOf('\n', 19), 5);
+
+    QString scratch;
+    QCOMPARE(text.midRef(0, 5, &scratch).toString(), QString("first"));
+    QVERIFY(scratch.isEmpty());
+    QCOMPARE(text.midRef(8, 4, &scratch).toString(), QString("ne c"));
+}
+
+//A keystroke queued behind a deep bulk backlog only waits for the chunks already handed to the link
+void DataPathTest::keystrokeOvertakesBulkBacklog()
+{
+    TxScheduler scheduler;
+    scheduler.setMaxWriteSize(20);
+    scheduler.setMaxInFlight(2);
+    QSignalSpy transmitted(&scheduler, SIGNAL(transmit(QByteArray)));
+    QSignalSpy finished(&scheduler, SIGNAL(writeFinished(quint64, bool)));
+
+    QByteArray bulk = makePayload(64 * 1024);
+    scheduler.enqueue(bulk, TxScheduler::BULK);
+    for(int i = 0; i < 10; i++){
+        scheduler.handleWritten();
+    }
+    QCOMPARE(transmitted.count(), 12);
+
+    QByteArray keystroke("k");
+    quint64 id = scheduler.enqueue(keystroke, TxScheduler::INTERACTIVE);
+    QCOMPARE(transmitted.count(), 12);      //The link is busy
+
+    scheduler.handleWritten();
+    QCOMPARE(transmitted.count(), 13);
+    QCOMPARE(transmitted.last().at(0).toByteArray(), keystroke);
+
+    //Confirmed as soon as the chunk ahead of it is, the backlog is still waiting
+    scheduler.handleWritten();
+    scheduler.handleWritten();
+    QCOMPARE(finished.count(), 1);
+    QCOMPARE(finished.last().at(0).value<quint64>(), id);
+    QCOMPARE(finished.last().at(1).toBool(), true);
+    QVERIFY(scheduler.getStatistics().queues[TxScheduler::BULK].depthBytes > bulk.size() - 20 * 20);
+}
+
+//Writes dropped while waiting or in flight are reported, and queued data does not refer to the caller's buffer
+void DataPathTest::clearReportsDroppedWrites()
+{
+    TxScheduler scheduler;
+    scheduler.setMaxWriteSize(20);
+    scheduler.setMaxInFlight(1);
+    QSignalSpy transmitted(&scheduler, SIGNAL(transmit(QByteArray)));
+    QSignalSpy finished(&scheduler, SIGNAL(writeFinished(quint64, bool)));
+
+    QByteArray buffer = makePayload(30);
+    QByteArray expected(buffer.constData(), buffer.size());
+    quint64 sent = scheduler.enqueue(QByteArray::fromRawData(buffer.constData(), buffer.size()), TxScheduler::BULK);
+    quint64 waiting = scheduler.enqueue(makePayload(10), TxScheduler::CONTROL);
+    buffer.fill('x');
+
+    scheduler.handleWritten();
+    QCOMPARE(transmitted.count(), 2);
+    QCOMPARE(transmitted.at(0).at(0).toByteArray() + transmitted.at(1).at(0).toByteArray(),
+             expected.left(20) + makePayload(10));
+
+    scheduler.clear();
+
+    QCOMPARE(finished.count(), 2);
+    QCOMPARE(finished.at(0).at(0).value<quint64>(), waiting);
+    QCOMPARE(finished.at(0).at(1).toBool(), false);
+    QCOMPARE(finished.at(1).at(0).value<quint64>(), sent);
+    QCOMPARE(finished.at(1).at(1).toBool(), false);
+}
+
+//END and ESC in the payload are escaped, a bad escape drops the frame up to the next END
+void DataPathTest::slipEscapes()
+{
+    SlipDecoder decoder;
+    QByteArray payload("a\xC0" "b\xDB" "c\xDB\xDC", 7);
+
+    QByteArray frame = decoder.encode(payload);
+    QCOMPARE(frame, QByteArray("\xC0" "a\xDB\xDC" "b\xDB\xDD" "c\xDB\xDD\xDC\xC0", 12));
+
+    QByteArray broken("\xC0" "bad\xDB" "x" "rest\xC0", 11);
+    QList<QByteArray> frames = decodeStream(&decoder, frame + broken + frame, 64);
+
+    QCOMPARE(frames, QList<QByteArray>() << payload << payload);
+    QCOMPARE(decoder.getStatistics().framingErrors, 1LL);
+}
+
+//Runs of 254 non-zero bytes fill a block (code 0xFF), which is not followed by an implied zero
+void DataPathTest::cobsFullBlocks()
+{
+    CobsDecoder decoder;
+
+    QByteArray full(254, 'x');
+    QByteArray frame = decoder.encode(full);
+    QCOMPARE(frame.size(), 257);
+    QCOMPARE(static_cast<uchar>(frame.at(0)), uchar(0xFF));
+    QCOMPARE(frame.right(2), QByteArray("\x01\x00", 2));
+
+    QList<QByteArray> payloads;
+    payloads << full
+             << QByteArray(255, 'y')
+             << full + QByteArray(1, '\0') + full
+             << QByteArray(3, '\0')
+             << makePayload(1000);
+
+    QByteArray stream;
+    for(const QByteArray &payload : payloads){
+        stream += decoder.encode(payload);
+    }
+
+    QCOMPARE(decodeStream(&decoder, stream, 244), payloads);
+    QCOMPARE(decoder.getStatistics().framingErrors, 0LL);
+}
+
+//A frame failing its CRC is dropped, an impossible length is skipped and the next frame still decodes
+void DataPathTest::lengthPrefixCrcMismatchAndResync()
+{
+    LengthPrefixDecoder decoder;
+    QByteArray first = makePayload(50, 1);
+    QByteArray second = makePayload(30, 2);
+
+    QByteArray corrupted = decoder.encode(makePayload(40, 3));
+    corrupted[10] = static_cast<char>(corrupted.at(10) ^ 0x01);
+
+    QByteArray oversized("\xFF\xFF", 2);    //Longer than the maximum frame size
+
+    QByteArray stream = decoder.encode(first) + corrupted + oversized + decoder.encode(second);
+
+    //Whole and byte by byte, through the in place and the buffered paths
+    for(int pieceSize : {int(stream.size()), 1}){
+        decoder.reset();
+        decoder.clearStatistics();
+
+        QCOMPARE(decodeStream(&decoder, stream, pieceSize), QList<QByteArray>() << first << second);
+        QCOMPARE(decoder.getStatistics().crcErrors, 1LL);
+        QCOMPARE(decoder.getStatistics().framingErrors, 1LL);
+    }
+}
+
+void DataPathTest::framesSplitAcrossNotifications_data()
+{
+    QTest::addColumn<int>("decoderType");
+    QTest::addColumn<int>("pieceSize");
+
+    const char *names[] = {"SLIP", "COBS", "Length"};
+    for(int type = 0; type < 3; type++){
+        for(int pieceSize : {1, 7, 20, 244}){
+            QTest::newRow(QString("%1/%2B").arg(names[type]).arg(pieceSize).toLatin1().constData()) << type << pieceSize;
+        }
+    }
+}
+
+//Wherever a notification boundary falls, the frames come out whole and in order
+void DataPathTest::framesSplitAcrossNotifications()
+{
+    QFETCH(int, decoderType);
+    QFETCH(int, pieceSize);
+
+    QScopedPointer<FrameDecoder> decoder;
+    switch(decoderType){
+        case 0:
+            decoder.reset(new SlipDecoder());
+            break;
+        case 1:
+            decoder.reset(new CobsDecoder());
+            break;
+        default:
+            decoder.reset(new LengthPrefixDecoder());
+            break;
+    }
+
+    QList<QByteArray> payloads;
+    QByteArray stream;
+    for(int i = 0; i < 20; i++){
+        //Binary payloads, including the bytes each framing has to escape
+        QByteArray payload = makePayload(1 + i * 37 % 300, i);
+        payload[payload.size() / 2] = static_cast<char>(i % 2 ? 0xC0 : 0x00);
+        payload[payload.size() - 1] = static_cast<char>(0xDB);
+        payloads << payload;
+        stream += decoder->encode(payload);
+    }
+
+    QCOMPARE(decodeStream(decoder.data(), stream, pieceSize), payloads);
+
+    FrameDecoder::Statistics statistics = decoder->getStatistics();
+    QCOMPARE(statistics.frames, 20LL);
+    QCOMPARE(statistics.bytes, static_cast<qint64>(stream.size()));
+    QCOMPARE(statistics.framingErrors + statistics.crcErrors, 0LL);
+}
+
+//The shared table computes CRC-16/CCITT-FALSE and, with a zero initial value, CRC-16/XMODEM
+void DataPathTest::crc16KnownValues()
+{
+    QCOMPARE(LengthPrefixDecoder::crc16("123456789", 9), quint16(0x29B1));
+    QCOMPARE(LengthPrefixDecoder::crc16("123456789", 9, 0), quint16(0x31C3));
+}
+
+//A torn last record or a corrupted one is cut off on the next open, the records before it are
+//kept byte for byte and the sequence carries on after the last one kept
+void DataPathTest::durableLogKeepsValidPrefix()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+
+    QFile file(dir.path() + "/durable.btlog");
+    QVERIFY(file.open(QIODevice::ReadWrite));
+    QCOMPARE(DurableLog::prepareForAppend(&file), 1ULL);
+
+    //Offsets just past each record
+    QVector<qint64> ends;
+    for(quint64 sequence = 1; sequence <= 10; sequence++){
+        QByteArray record = DurableLog::encodeRecord(sequence, qint64(1000 + sequence), sequence % 2 == 1, makePayload(int(sequence) * 50, int(sequence)));
+        QCOMPARE(file.write(record), qint64(record.size()));
+        ends.append(file.pos());
+    }
+    QVERIFY(file.flush());
+
+    //Crash in the middle of the last record
+    QVERIFY(file.resize(ends.at(8) + 20));
+    DurableLog::ScanResult result = DurableLog::scan(&file);
+    QVERIFY(result.headerValid);
+    QCOMPARE(result.records, 9LL);
+    QCOMPARE(result.validBytes, ends.at(8));
+    QCOMPARE(result.lastSequence, 9ULL);
+    QCOMPARE(result.sequenceGaps, 0LL);
+
+    QCOMPARE(DurableLog::prepareForAppend(&file), 10ULL);
+    QCOMPARE(file.size(), ends.at(8));
+    QCOMPARE(file.pos(), ends.at(8));
+
+    QByteArray record = DurableLog::encodeRecord(10, 1010, false, makePayload(500, 10));
+    QCOMPARE(file.write(record), qint64(record.size()));
+    QVERIFY(file.flush());
+    QCOMPARE(DurableLog::scan(&file).records, 10LL);
+
+    //A flipped byte in the data of record 7
+    QVERIFY(file.seek(0));
+    QByteArray before = file.read(ends.at(5));
+    qint64 flipped = ends.at(5) + DurableLog::RECORD_OVERHEAD;
+    QVERIFY(file.seek(flipped));
+    char c = 0;
+    QVERIFY(file.getChar(&c));
+    QVERIFY(file.seek(flipped));
+    QVERIFY(file.putChar(static_cast<char>(c ^ 0x20)));
+    QVERIFY(file.flush());
+
+    result = DurableLog::scan(&file);
+    QCOMPARE(result.records, 6LL);
+    QCOMPARE(result.validBytes, ends.at(5));
+    QCOMPARE(result.lastSequence, 6ULL);
+
+    QCOMPARE(DurableLog::prepareForAppend(&file), 7ULL);
+    QCOMPARE(file.size(), ends.at(5));
+    QVERIFY(file.seek(0));
+    QCOMPARE(file.readAll(), before);
+}
+
+//One write larger than a record is logged as several records, none of them read as torn
+void DataPathTest::durableLogSplitsLargeWrites()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    QString path = dir.path() + "/large.btlog";
+
+    Logger logger;
+    logger.setLogFormat(Logger::DURABLE);
+    logger.setLogFile(path);
+    logger.startLogging();
+    QVERIFY(logger.isLogging());
+
+    QByteArray large(DurableLog::MAX_RECORD_SIZE + 100, 'x');
+    logger.log(large, true);
+    logger.log(QByteArray("after"), true);
+    logger.stopLogging();
+
+    QFile file(path);
+    QVERIFY(file.open(QIODevice::ReadWrite));
+    DurableLog::ScanResult result = DurableLog::scan(&file);
+    QCOMPARE(result.records, 3LL);
+    QCOMPARE(result.validBytes, result.fileSize);
+    QCOMPARE(result.lastSequence, 3ULL);
+    QCOMPARE(DurableLog::prepareForAppend(&file), 4ULL);
+}
+
+QTEST_MAIN(DataPathTest)
+
+#include "tst_datapath.moc"
@@ -0,0 +1,13 @@
+#-------------------------------------------------
+#
+# Tests and benchmarks for the BluetoothTerminal data path
+#
+# qmake tests.pro && make && make check
+#
+#-------------------------------------------------
+
+TEMPLATE = subdirs
+
+SUBDIRS += \
+    datapath \
+    benchmarks